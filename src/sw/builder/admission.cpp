@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#include "admission.h"
+
+#include <primitives/exceptions.h>
+
+#include <algorithm>
+#include <fstream>
+
+#ifndef _WIN32
+#include <stdlib.h>
+#endif
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "admission");
+
+namespace sw
+{
+
+AdmissionController::Slot::Slot(AdmissionController &ac)
+    : ac(ac)
+{
+    ac.lock();
+}
+
+AdmissionController::Slot::~Slot()
+{
+    ac.unlock();
+}
+
+AdmissionController::AdmissionController(const Settings &s)
+    : settings(s)
+{
+    if (settings.max < 1)
+        settings.max = 1;
+    settings.min = std::clamp(settings.min, 1, settings.max);
+    limit = settings.max;
+}
+
+AdmissionController::~AdmissionController()
+{
+    stop();
+}
+
+void AdmissionController::start()
+{
+    std::unique_lock lk(m);
+    if (!stopped)
+        return;
+    stopped = false;
+    samples.clear();
+    sampler = std::thread([this]
+    {
+        std::unique_lock lk(m);
+        while (!cv_stop.wait_for(lk, settings.interval, [this] { return stopped; }))
+        {
+            lk.unlock();
+            sample();
+            lk.lock();
+        }
+    });
+}
+
+void AdmissionController::stop()
+{
+    {
+        std::unique_lock lk(m);
+        if (stopped)
+            return;
+        stopped = true;
+    }
+    cv_stop.notify_all();
+    sampler.join();
+}
+
+int AdmissionController::getLimit() const
+{
+    std::unique_lock lk(m);
+    return limit;
+}
+
+void AdmissionController::lock()
+{
+    std::unique_lock lk(m);
+    cv.wait(lk, [this] { return running < limit; });
+    ++running;
+}
+
+void AdmissionController::unlock()
+{
+    std::unique_lock lk(m);
+    --running;
+    lk.unlock();
+    cv.notify_one();
+}
+
+void AdmissionController::sample()
+{
+    auto p = readPressure();
+    auto now = Clock::now();
+    std::unique_lock lk(m);
+    auto old = limit;
+    auto l = nextLimit(limit, running, p, settings);
+    if (l >= limit)
+        limit = l;
+    else if (now - last_decrease >= settings.decrease_interval)
+    {
+        limit = l;
+        last_decrease = now;
+    }
+    samples.push_back({ now, limit, running, p });
+    lk.unlock();
+    if (limit > old)
+        cv.notify_all();
+    if (limit != old)
+        LOG_TRACE(logger, "concurrency limit " << old << " -> " << limit);
+}
+
+// "some avg10=1.23 avg60=..." line of /proc/pressure file
+static std::optional<double> read_psi(const path &fn)
+{
+    std::ifstream ifs(fn);
+    String s;
+    while (std::getline(ifs, s))
+    {
+        if (!s.starts_with("some "))
+            continue;
+        auto p = s.find("avg10=");
+        if (p == s.npos)
+            return {};
+        try
+        {
+            return std::stod(s.substr(p + 6));
+        }
+        catch (std::exception &)
+        {
+            return {};
+        }
+    }
+    return {};
+}
+
+AdmissionController::Pressure AdmissionController::readPressure()
+{
+    Pressure p;
+#ifdef __linux__
+    p.cpu = read_psi("/proc/pressure/cpu");
+    p.memory = read_psi("/proc/pressure/memory");
+    p.io = read_psi("/proc/pressure/io");
+#endif
+#ifndef _WIN32
+    double l;
+    if (getloadavg(&l, 1) == 1)
+        p.load_per_cpu = l / std::max(1u, std::thread::hardware_concurrency());
+#endif
+    return p;
+}
+
+int AdmissionController::nextLimit(int limit, int running, const Pressure &p, const Settings &s)
+{
+    auto over = [](auto &v, double threshold) { return v && *v > threshold; };
+    if (0
+        || over(p.cpu, s.cpu_pressure)
+        || over(p.memory, s.memory_pressure)
+        || over(p.io, s.io_pressure)
+        || over(p.load_per_cpu, s.load_per_cpu)
+        )
+        return std::max(s.min, limit / 2);
+    // do not grow unused limit
+    if (running >= limit)
+        return std::min(s.max, limit + 1);
+    return limit;
+}
+
+} // namespace sw
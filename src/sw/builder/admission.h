@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include <primitives/filesystem.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+namespace sw
+{
+
+// Adaptive limit of concurrently running commands.
+//
+// Every interval machine pressure is sampled: /proc/pressure/{cpu,memory,io} ("some avg10")
+// and load average per cpu. Then the limit is changed with AIMD policy within [min, max]:
+// it is halved when any value is over its threshold, and increased by one when the machine
+// is not under pressure and the limit is fully used.
+// Without pressure information (not linux, old kernels) only load average is used.
+struct SW_BUILDER_API AdmissionController
+{
+    // same as commands use, for traces
+    using Clock = std::chrono::high_resolution_clock;
+
+    struct Settings
+    {
+        int min = 1;
+        int max = 1;
+        Clock::duration interval = std::chrono::seconds(1);
+        // pressure is averaged over 10 seconds, do not react on the same stall twice
+        Clock::duration decrease_interval = std::chrono::seconds(10);
+        // percents of time some tasks were stalled
+        double cpu_pressure = 20;
+        double memory_pressure = 10;
+        double io_pressure = 30;
+        double load_per_cpu = 1.5;
+    };
+
+    struct Pressure
+    {
+        std::optional<double> cpu;
+        std::optional<double> memory;
+        std::optional<double> io;
+        std::optional<double> load_per_cpu;
+    };
+
+    struct Sample
+    {
+        Clock::time_point t;
+        int limit;
+        int running;
+        Pressure p;
+    };
+
+    // running command slot
+    struct SW_BUILDER_API Slot
+    {
+        Slot(AdmissionController &);
+        Slot(const Slot &) = delete;
+        Slot &operator=(const Slot &) = delete;
+        ~Slot();
+
+    private:
+        AdmissionController &ac;
+    };
+
+    AdmissionController(const Settings &);
+    AdmissionController(const AdmissionController &) = delete;
+    AdmissionController &operator=(const AdmissionController &) = delete;
+    ~AdmissionController();
+
+    // starts sampler thread
+    void start();
+    void stop();
+
+    // blocks until running commands are below the limit
+    Slot acquire() { return Slot(*this); }
+    int getLimit() const;
+    // valid after stop()
+    const std::vector<Sample> &getSamples() const { return samples; }
+
+    static Pressure readPressure();
+    // one AIMD step
+    static int nextLimit(int limit, int running, const Pressure &, const Settings &);
+
+private:
+    Settings settings;
+    int limit;
+    int running = 0;
+    std::vector<Sample> samples;
+    Clock::time_point last_decrease;
+    mutable std::mutex m;
+    std::condition_variable cv;
+    std::condition_variable cv_stop;
+    bool stopped = true;
+    std::thread sampler;
+
+    void lock();
+    void unlock();
+    void sample();
+};
+
+} // namespace sw
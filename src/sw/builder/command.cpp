@@ -21,9 +21,11 @@
 #define BOOST_THREAD_VERSION 5
 #include "command.h"
 
+#include "admission.h"
 #include "command_storage.h"
 #include "file.h"
 #include "file_storage.h"
+#include "jobserver.h"
 #include "jumppad.h"
 #include "os.h"
 #include "program.h"
@@ -44,6 +46,7 @@
 #include <primitives/sw/settings_program_name.h>
 #include <pystring.h>
 
+#include <fstream>
 #include <regex>
 
 #include <primitives/log.h>
@@ -278,6 +281,71 @@ CommandNode::~CommandNode()
 namespace builder
 {
 
+void ArgumentStrings::Buffer::add(const String &s)
+{
+    arena += s;
+    offsets.push_back(arena.size());
+}
+
+ArgumentStrings::ArgumentStrings(const Arguments &args)
+{
+    sources.reserve(args.size());
+    strings.offsets.reserve(args.size() + 1);
+    for (auto &a : args)
+    {
+        sources.push_back(a.get());
+        strings.add(a->toString());
+    }
+}
+
+std::string_view ArgumentStrings::quoted(const Arguments &args, size_t i, QuoteType t) const
+{
+    int k;
+    switch (t)
+    {
+    case QuoteType::Escape:
+        k = 0;
+        break;
+    case QuoteType::SimpleAndEscape:
+        k = 1;
+        break;
+    default:
+        throw SW_RUNTIME_ERROR("Quote type is not cached");
+    }
+    auto &q = quoted_forms[k];
+    std::call_once(q.once, [&args, &q, t]()
+    {
+        q.buf.offsets.reserve(args.size() + 1);
+        for (auto &a : args)
+            q.buf.add(a->quote(t));
+    });
+    return q.buf.get(i);
+}
+
+bool ArgumentStrings::isBuiltFrom(const Arguments &args) const
+{
+    if (args.size() != sources.size())
+        return false;
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i].get() != sources[i])
+            return false;
+    }
+    return true;
+}
+
+// same as hashing std::set<String> of arguments, but without copying them
+static void hash_sorted_arguments(size_t &h, const ArgumentStrings &args, size_t start = 0)
+{
+    std::vector<std::string_view> v;
+    for (auto i = start; i < args.size(); i++)
+        v.push_back(args[i]);
+    std::sort(v.begin(), v.end());
+    v.erase(std::unique(v.begin(), v.end()), v.end());
+    for (auto &a : v)
+        hash_combine(h, std::hash<std::string_view>()(a));
+}
+
 Command::Command(const SwBuilderContext &swctx)
     : swctx(&swctx)
 {
@@ -311,21 +379,44 @@ static String getCommandId(const Command &c)
     return s;
 }
 
-bool Command::check_if_file_newer(const path &p, const String &what, bool throw_on_missing) const
+static RebuildCause get_missing_cause(RebuildCause newer)
 {
-    auto s = File(p, getContext().getFileStorage()).isChanged(mtime, throw_on_missing);
-    if (s && isExplainNeeded())
+    switch (newer)
     {
-        EXPLAIN_OUTDATED("command", true, what + " changed " + to_string(p) + " (command_storage = " +
+    case RebuildCause::InputNewer:
+        return RebuildCause::InputMissing;
+    case RebuildCause::OutputNewer:
+        return RebuildCause::OutputMissing;
+    case RebuildCause::ImplicitInputNewer:
+        return RebuildCause::ImplicitInputMissing;
+    default:
+        return newer;
+    }
+}
+
+bool Command::check_if_file_newer(const path &p, RebuildCause newer, bool throw_on_missing) const
+{
+    File f(p, getContext().getFileStorage());
+    auto s = f.isChanged(mtime, throw_on_missing);
+    if (!s)
+        return false;
+    auto lwt = f.getFileData().last_write_time;
+    auto cause = lwt == fs::file_time_type::min() ? get_missing_cause(newer) : newer;
+    command_storage->getRebuildLog().add(cause, getHash(), std::hash<path>()(normalize_path(p)), mtime, lwt);
+    if (isExplainNeeded())
+    {
+        EXPLAIN_OUTDATED("command", true, toString(cause) + " "s + to_string(p) + " (command_storage = " +
             to_string(command_storage->root) + ") : " + *s, getCommandId(*this));
     }
-    return !!s;
+    return true;
 }
 
 bool Command::isOutdated() const
 {
     if (always)
     {
+        if (command_storage)
+            command_storage->getRebuildLog().add(RebuildCause::Always, getHash());
         if (isExplainNeeded())
             EXPLAIN_OUTDATED("command", true, "always build", getCommandId(*this));
         return true;
@@ -344,6 +435,7 @@ bool Command::isOutdated() const
     {
         // we have insertion, no previous value available
         // so outdated
+        command_storage->getRebuildLog().add(RebuildCause::NewCommand, k);
         if (isExplainNeeded())
             EXPLAIN_OUTDATED("command", true, "new command (command_storage = " + to_string(command_storage->root) + "): " + print(), getCommandId(*this));
         return true;
@@ -365,13 +457,13 @@ bool Command::isTimeChanged() const
     try
     {
         return std::any_of(inputs.begin(), inputs.end(), [this](const auto &i) {
-                   return check_if_file_newer(i, "input", true);
+                   return check_if_file_newer(i, RebuildCause::InputNewer, true);
                }) ||
                std::any_of(outputs.begin(), outputs.end(), [this](const auto &i) {
-                   return check_if_file_newer(i, "output", false);
+                   return check_if_file_newer(i, RebuildCause::OutputNewer, false);
                }) ||
                std::any_of(implicit_inputs.begin(), implicit_inputs.end(), [this](const auto &i) {
-                   return check_if_file_newer(i, "implicit input", true);
+                   return check_if_file_newer(i, RebuildCause::ImplicitInputNewer, true);
                });
     }
     catch (std::exception &e)
@@ -399,12 +491,7 @@ size_t Command::getHash1() const
     // actually no, we do not allow unspecified order anymore
     // actually we have different deps order -> different defs, idir order, libs order
     // FIXME: ^
-    std::set<String> args_sorted;
-    Strings sa;
-    for (auto &a : arguments)
-        args_sorted.insert(a->toString());
-    for (auto &a : args_sorted)
-        hash_combine(h, std::hash<String>()(a));
+    hash_sorted_arguments(h, *getArgumentStrings());
     //for (auto &a : arguments)
         //hash_combine(h, std::hash<String>()(a->toString()));
 
@@ -556,6 +643,7 @@ void Command::prepare()
     // program is an input!
     inputs.insert(getProgram());
 
+    saveArgumentStrings();
     getHashAndSave();
 
     // add more deps
@@ -592,6 +680,22 @@ void Command::prepare()
         command_storage->add_user();
 }*/
 
+bool Command::isChangedAfterPrepare()
+{
+    if (!prepared)
+        return false;
+    saveArgumentStrings();
+    return getHash1() != hash;
+}
+
+void Command::resetExecution()
+{
+    prepared = false;
+    executed_ = false;
+    pid = -1;
+    hash = 0;
+}
+
 void Command::execute()
 {
     execute0(nullptr);
@@ -619,6 +723,13 @@ void Command::execute0(std::error_code *ec)
 
     if (!beforeCommand())
         return;
+    // hold job slot only while running
+    std::optional<AdmissionController::Slot> slot;
+    if (admission)
+        slot.emplace(*admission);
+    std::optional<Jobserver::Token> token;
+    if (jobserver)
+        token = jobserver->acquire();
     execute1(ec); // main thing
     if (ec && *ec)
         return;
@@ -718,11 +829,21 @@ void Command::afterCommand()
     // On the next run command times won't be compared with missing deps,
     // so outdated command will not be re-runned
 
+    auto &s = command_storage->getInternalStorage();
+    for (auto &i : inputs)
+        s.updateFileRecord(i, File(i, getContext().getFileStorage()).getFileData().last_write_time);
+    for (auto &i : implicit_inputs)
+        s.updateFileRecord(i, File(i, getContext().getFileStorage()).getFileData().last_write_time);
+
     auto k = getHash();
     auto &r = *command_storage->insert(k).first;
     r.hash = k;
     r.mtime = mtime;
-    r.setImplicitInputs(implicit_inputs, command_storage->getInternalStorage());
+    if (t_end > t_begin)
+        r.duration = std::chrono::duration_cast<std::chrono::milliseconds>(t_end - t_begin).count();
+    r.setImplicitInputs(implicit_inputs, s);
+    r.setInputs(inputs, s);
+    r.setOutputs(outputs, s);
     command_storage->async_command_log(r);
 }
 
@@ -733,12 +854,14 @@ path Command::getResponseFilename() const
 
 String Command::getResponseFileContents(bool showIncludes) const
 {
+    auto args = getArgumentStrings();
+    auto qt = protect_args_with_quotes ? QuoteType::SimpleAndEscape : QuoteType::Escape;
     String rsp;
-    for (auto a = arguments.begin() + getFirstResponseFileArgument(); a != arguments.end(); a++)
+    for (size_t i = getFirstResponseFileArgument(); i < args->size(); i++)
     {
-        if (!showIncludes && (*a)->toString() == "-showIncludes")
+        if (!showIncludes && (*args)[i] == "-showIncludes")
             continue;
-        rsp += (*a)->quote(protect_args_with_quotes ? QuoteType::SimpleAndEscape : QuoteType::Escape);
+        rsp += args->quoted(arguments, i, qt);
         rsp += "\n";
     }
     if (!rsp.empty())
@@ -766,6 +889,19 @@ const Command::Arguments &Command::getArguments() const
     return rsp_args;
 }
 
+std::shared_ptr<const ArgumentStrings> Command::getArgumentStrings() const
+{
+    // some commands replace arguments during execution
+    if (argument_strings && argument_strings->isBuiltFrom(arguments))
+        return argument_strings;
+    return std::make_shared<ArgumentStrings>(arguments);
+}
+
+void Command::saveArgumentStrings()
+{
+    argument_strings = std::make_shared<ArgumentStrings>(arguments);
+}
+
 void Command::execute1(std::error_code *ec)
 {
     primitives::ScopedThreadName tn(": " + getName(), true);
@@ -783,6 +919,7 @@ void Command::execute1(std::error_code *ec)
     // Some systems have limitation on its length.
 
     path rsp_file;
+    rsp_args.clear();
     if (needsResponseFile())
     {
         auto t = support::temp_directory_path() / getResponseFilename();
@@ -820,9 +957,31 @@ void Command::execute1(std::error_code *ec)
         LOG_TRACE(logger, print() + "\n" + ss.str());
     }
 
+    // let cooperating tools share our job slots
+    // not a part of command hash
+    bool set_makeflags = jobserver && environment.find("MAKEFLAGS") == environment.end();
+    if (set_makeflags)
+        environment["MAKEFLAGS"] = jobserver->getMakeflags();
+    SCOPE_EXIT
+    {
+        if (set_makeflags)
+            environment.erase("MAKEFLAGS");
+    };
+
+    // priorities and accounting of command kind
+    auto execute_process = [this](std::error_code &ec)
+    {
+        if (resource_classes)
+            resource_classes->run(kind, [this, &ec] { Base::execute(ec); });
+        else
+            Base::execute(ec);
+    };
+
+    spillOutputs();
     if (ec)
     {
-        Base::execute(*ec);
+        execute_process(*ec);
+        loadSpilledOutputs();
         if (ec)
         {
             // TODO: save error string
@@ -833,10 +992,13 @@ void Command::execute1(std::error_code *ec)
     else
     {
         std::error_code ec;
-        Base::execute(ec);
+        execute_process(ec);
+        loadSpilledOutputs();
         if (ec)
         {
             auto err = make_error_string();
+            // full outputs are referenced in the error
+            releaseOutputs(true);
             throw SW_RUNTIME_ERROR(err);
         }
     }
@@ -848,6 +1010,82 @@ void Command::execute1(std::error_code *ec)
 
     postProcess(); // process deps
     printOutputs();
+    releaseOutputs();
+}
+
+// captured outputs bigger than this are not loaded, only their head and tail
+static const size_t output_memory_limit = 64 * 1024;
+static const size_t output_head_tail_size = 8 * 1024;
+
+void Command::spillOutputs()
+{
+    auto spill = [this](auto &s, auto &fn)
+    {
+        // msvc deps are parsed from full output
+        if (!stream_output || s.inherit || !s.file.empty() || deps_processor == DepsProcessor::Msvc)
+            return;
+        fn = support::temp_directory_path("out") / unique_path();
+        s.file = fn;
+    };
+    spill_truncated = false;
+    spill(out, out_spill);
+    spill(err, err_spill);
+}
+
+void Command::loadSpilledOutputs()
+{
+    auto load = [this](auto &s, auto &fn)
+    {
+        if (fn.empty())
+            return;
+        // redirection must not be visible in saved commands
+        s.file.clear();
+        error_code ec;
+        auto sz = fs::file_size(fn, ec);
+        if (ec || sz == 0)
+        {
+            fs::remove(fn, ec);
+            fn.clear();
+            return;
+        }
+        if (sz <= output_memory_limit)
+        {
+            s.text = read_file(fn);
+            fs::remove(fn, ec);
+            fn.clear();
+            return;
+        }
+        std::ifstream ifs(fn, std::ios::binary);
+        String head(output_head_tail_size, 0), tail(output_head_tail_size, 0);
+        ifs.read(head.data(), head.size());
+        ifs.seekg(sz - tail.size());
+        ifs.read(tail.data(), tail.size());
+        s.text = head + "\n... " + std::to_string(sz - head.size() - tail.size()) +
+            " bytes skipped, full output: " + to_string(fn) + " ...\n" + tail;
+        spill_truncated = true;
+    };
+    load(out, out_spill);
+    load(err, err_spill);
+}
+
+void Command::releaseOutputs(bool keep_spilled)
+{
+    if (!stream_output)
+        return;
+    String().swap(out.text);
+    String().swap(err.text);
+    // truncated outputs were logged with a reference to their files
+    if (!keep_spilled && !(spill_truncated && show_output))
+    {
+        error_code ec;
+        for (auto &fn : { out_spill, err_spill })
+        {
+            if (!fn.empty())
+                fs::remove(fn, ec);
+        }
+    }
+    out_spill.clear();
+    err_spill.clear();
 }
 
 void Command::printOutputs()
@@ -920,8 +1158,16 @@ String Command::saveCommand() const
 
     if (sw::Settings::get_user_settings().save_command_output)
     {
-        write_file(path(base) += "_stdout.txt", out.text);
-        write_file(path(base) += "_stderr.txt", err.text);
+        auto save = [&base](const String &suffix, const auto &s, const path &spill)
+        {
+            path fn = path(base) += suffix;
+            error_code ec;
+            if (!spill.empty() && fs::copy_file(spill, fn, fs::copy_options::overwrite_existing, ec))
+                return;
+            write_file(fn, s.text);
+        };
+        save("_stdout.txt", out, out_spill);
+        save("_stderr.txt", err, err_spill);
     }
 
     String s;
@@ -1075,10 +1321,11 @@ path Command::writeCommand(const path &p, bool print_name) const
             path output;
             for (auto &a : args)
             {
-                if (a->toString() == "-showIncludes")
+                auto s = a->toString();
+                if (s == "-showIncludes")
                     continue;
-                if (a->toString().starts_with("-o/")) {
-                    output = a->toString().substr(2);
+                if (s.starts_with("-o/")) {
+                    output = s.substr(2);
                 }
                 auto a2 = a->quote(QuoteType::Escape);
                 if (bat)
@@ -1087,7 +1334,7 @@ path Command::writeCommand(const path &p, bool print_name) const
                     // see https://www.robvanderwoude.com/escapechars.php
                     boost::replace_all(a2, "%", "%%"); // remove? because we always have double quotes
                 }
-                if (a->toString().starts_with("-fmodule-mapper=")) {
+                if (s.starts_with("-fmodule-mapper=")) {
                     a2 = a->quote("-fmodule-mapper=" + (output.parent_path() / (path{output} += ".map")).string(), QuoteType::Escape);
                 }
                 t += "\"" + a2 + "\" ";
@@ -1220,8 +1467,9 @@ bool Command::needsResponseFile(size_t selected_size) const
 {
     // 3 = 1 + 2 = space + quotes
     size_t sz = getProgram().string().size() + 3;
-    for (auto a = arguments.begin() + getFirstResponseFileArgument(); a != arguments.end(); a++)
-        sz += (*a)->toString().size() + 3;
+    auto args = getArgumentStrings();
+    for (size_t i = getFirstResponseFileArgument(); i < args->size(); i++)
+        sz += (*args)[i].size() + 3;
 
     if (use_response_files)
     {
@@ -1472,19 +1720,17 @@ size_t BuiltinCommand::getHash1() const
 
     // must sort arguments first
     // because some command may generate args in unspecified order
-    std::set<String> args_sorted;
-
     // we ignore args 0-2 inclusive, so our start arg is 3
-    auto start = 3;
-    for (auto a = arguments.begin() + start; a != arguments.end(); a++)
-        args_sorted.insert((*a)->toString());
-
-    for (auto &a : args_sorted)
-        hash_combine(h, std::hash<String>()(a));
+    hash_sorted_arguments(h, *getArgumentStrings(), 3);
 
     return h;
 }
 
+void BuiltinCommand::prepare()
+{
+    saveArgumentStrings();
+}
+
 String getInternalCallBuiltinFunctionName()
 {
     return "internal-call-builtin-function";
@@ -19,6 +19,7 @@
 #pragma once
 
 #include "node.h"
+#include "resource_class.h"
 
 #include <nlohmann/json_fwd.hpp>
 #include <primitives/command.h>
@@ -26,14 +27,18 @@
 
 #include <condition_variable>
 #include <mutex>
+#include <string_view>
 #include <thread>
 
 namespace sw
 {
 
 struct Program;
+struct AdmissionController;
+struct Jobserver;
 struct SwBuilderContext;
 struct CommandStorage;
+enum class RebuildCause : uint8_t;
 
 SW_BUILDER_API
 uint16_t get_module_mapper_port();
@@ -124,6 +129,42 @@ struct SW_BUILDER_API ResolvableCommand : ::primitives::Command
 
 }
 
+// Strings of command arguments in one buffer.
+// Arguments are final after prepare, so strings and their quoted forms are built once
+// instead of on every hash, rsp file or print call.
+struct SW_BUILDER_API ArgumentStrings
+{
+    using Arguments = ::primitives::Command::Arguments;
+
+    ArgumentStrings(const Arguments &);
+
+    size_t size() const { return strings.offsets.size() - 1; }
+    std::string_view operator[](size_t i) const { return strings.get(i); }
+    // Escape and SimpleAndEscape only, args must be the ones this object is built from
+    std::string_view quoted(const Arguments &args, size_t i, QuoteType) const;
+    // same argument objects
+    bool isBuiltFrom(const Arguments &) const;
+
+private:
+    struct Buffer
+    {
+        String arena;
+        std::vector<size_t> offsets{ 0 };
+
+        void add(const String &);
+        std::string_view get(size_t i) const { return std::string_view(arena).substr(offsets[i], offsets[i + 1] - offsets[i]); }
+    };
+    struct Quoted
+    {
+        std::once_flag once;
+        Buffer buf;
+    };
+
+    std::vector<const void *> sources;
+    Buffer strings;
+    mutable Quoted quoted_forms[2];
+};
+
 struct SW_BUILDER_API Command : ICastable, CommandNode, detail::ResolvableCommand // hide?
 {
     using Base = detail::ResolvableCommand;
@@ -176,8 +217,14 @@ public:
     bool silent = false; // no log record
     bool show_output = false; // no command output
     bool write_output_to_file = false;
+    // set during execution: big outputs go to files, texts are released after logging
+    bool stream_output = false;
     int strict_order = 0; // used to execute this before other commands
     std::shared_ptr<ResourcePool> pool;
+    Jobserver *jobserver = nullptr; // set during execution
+    AdmissionController *admission = nullptr; // set during execution
+    ResourceClasses *resource_classes = nullptr; // set during execution
+    CommandKind kind = CommandKind::Custom;
 
     std::thread::id tid;
     Clock::time_point t_begin;
@@ -208,6 +255,9 @@ public:
     void execute(std::error_code &ec) override;
     void clean() const;
     bool isExecuted() const { return pid != -1 || executed_; }
+    // for commands started before the whole plan is known
+    bool isChangedAfterPrepare();
+    void resetExecution();
 
     String getName(bool short_name = false) const override;
     size_t getHash() const override;
@@ -243,6 +293,8 @@ public:
 
     Arguments &getArguments() override;
     const Arguments &getArguments() const override;
+    // cached after prepare, built on the fly if arguments are changed
+    std::shared_ptr<const ArgumentStrings> getArgumentStrings() const;
 
     Command &operator|(Command &);
     Command &operator|=(Command &);
@@ -255,19 +307,29 @@ protected:
     bool executed_ = false;
     //std::atomic_bool executed_ = false;
 
-    virtual bool check_if_file_newer(const path &, const String &what, bool throw_on_missing) const;
+    // newer and missing causes go in pairs
+    virtual bool check_if_file_newer(const path &, RebuildCause newer, bool throw_on_missing) const;
+    // may be called several times by derived commands
+    virtual void execute1(std::error_code *ec = nullptr);
+    void saveArgumentStrings();
 
 private:
     const SwBuilderContext *swctx = nullptr;
     mutable size_t hash = 0;
+    std::shared_ptr<const ArgumentStrings> argument_strings;
+    path out_spill;
+    path err_spill;
+    bool spill_truncated = false;
     Arguments rsp_args;
     mutable String log_string;
 
     void execute0(std::error_code *ec);
-    virtual void execute1(std::error_code *ec = nullptr);
     virtual size_t getHash1() const;
 
     void postProcess(bool ok = true);
+    void spillOutputs();
+    void loadSpilledOutputs();
+    void releaseOutputs(bool keep_spilled = false);
     bool beforeCommand();
     void afterCommand();
     bool isTimeChanged() const;
@@ -321,7 +383,7 @@ struct SW_BUILDER_API BuiltinCommand : Command
 private:
     void execute1(std::error_code *ec = nullptr) override;
     size_t getHash1() const override;
-    void prepare() override {}
+    void prepare() override;
 
 #ifdef BOOST_SERIALIZATION_ACCESS_HPP
     friend class boost::serialization::access;
@@ -374,5 +436,6 @@ template<> struct hash<sw::builder::Command>
 
 #ifdef BOOST_SERIALIZATION_ACCESS_HPP
 // change when you update serialization
-//BOOST_CLASS_VERSION(::sw::builder::Command, 4)
+// 1 - kind
+BOOST_CLASS_VERSION(::sw::builder::Command, 1)
 #endif
@@ -35,7 +35,10 @@
 #include <primitives/log.h>
 DECLARE_STATIC_LOGGER(logger, "db_file");
 
-#define COMMAND_DB_FORMAT_VERSION 8
+#define COMMAND_DB_FORMAT_VERSION 9
+// every Nth build drops records that were not used during last COMMAND_DB_MAX_AGE builds
+#define COMMAND_DB_COMPACTION_PERIOD 64
+#define COMMAND_DB_MAX_AGE 128
 
 namespace sw
 {
@@ -66,6 +69,16 @@ static path getCommandsLogFileName(const path &root)
     return getDir(root) / std::to_string(COMMAND_DB_FORMAT_VERSION) / ("cmd_log_" + cfg + ".bin");
 }
 
+static path getCommandsDbLockFileName(const path &root)
+{
+    return getDir(root) / std::to_string(COMMAND_DB_FORMAT_VERSION) / "commands";
+}
+
+static bool is_dead(const CommandRecord &r, uint32_t generation, uint32_t max_age)
+{
+    return max_age && r.generation + max_age < generation;
+}
+
 template <class T>
 static void write_int(std::vector<uint8_t> &vec, T val)
 {
@@ -84,9 +97,14 @@ static void write_str(std::vector<uint8_t> &vec, const String &val)
 }
 
 CommandRecord::implicit_inputs_t CommandRecord::getImplicitInputs(detail::Storage &s) const
+{
+    return getFiles(implicit_inputs, s);
+}
+
+CommandRecord::implicit_inputs_t CommandRecord::getFiles(const file_ids_t &ids, detail::Storage &s)
 {
     implicit_inputs_t files;
-    for (auto &h : implicit_inputs)
+    for (auto &h : ids)
     {
         boost::upgrade_lock lk(s.m_file_storage_by_hash);
         auto i = s.file_storage_by_hash.find(h);
@@ -100,15 +118,15 @@ CommandRecord::implicit_inputs_t CommandRecord::getImplicitInputs(detail::Storag
     return files;
 }
 
-void CommandRecord::setImplicitInputs(const Files &files, detail::Storage &s)
+static void set_files(CommandRecord::file_ids_t &ids, const Files &files, detail::Storage &s)
 {
-    implicit_inputs.clear(); // clear first!
+    ids.clear(); // clear first!
 
     for (auto &f : files)
     {
         auto str = normalize_path(f);
         auto h = std::hash<path>()(str);
-        implicit_inputs.insert(h);
+        ids.insert(h);
 
         boost::upgrade_lock lk(s.m_file_storage_by_hash);
         auto i = s.file_storage_by_hash.find(h);
@@ -120,6 +138,36 @@ void CommandRecord::setImplicitInputs(const Files &files, detail::Storage &s)
     }
 }
 
+void CommandRecord::setImplicitInputs(const Files &files, detail::Storage &s)
+{
+    set_files(implicit_inputs, files, s);
+}
+
+void CommandRecord::setInputs(const Files &files, detail::Storage &s)
+{
+    set_files(inputs, files, s);
+}
+
+void CommandRecord::setOutputs(const Files &files, detail::Storage &s)
+{
+    set_files(outputs, files, s);
+}
+
+void detail::Storage::updateFileRecord(const path &p, const fs::file_time_type &t)
+{
+    if (t == fs::file_time_type::min())
+        return;
+    auto h = std::hash<path>()(normalize_path(p));
+    boost::unique_lock lk(m_file_storage_by_hash);
+    auto &r = file_records[h];
+    if (r.mtime == t)
+        return;
+    // first time seen is not a change
+    if (r.mtime != fs::file_time_type::min())
+        r.changes++;
+    r.mtime = t;
+}
+
 FileDb::FileDb(const SwBuilderContext &swctx)
     : swctx(swctx)
 {
@@ -139,19 +187,45 @@ void FileDb::write(std::vector<uint8_t> &v, const CommandRecord &f, const detail
 
     write_int(v, f.hash);
     write_int(v, f.mtime);
+    write_int(v, f.duration);
+
+    auto write_files = [&v, &s](auto &&ids)
+    {
+        auto n = ids.size();
+        write_int(v, n);
+        for (auto &h : ids)
+        {
+            boost::upgrade_lock lk(s.m_file_storage_by_hash);
+            auto i = s.file_storage_by_hash.find(h);
+            if (i == s.file_storage_by_hash.end())
+                throw SW_RUNTIME_ERROR("no such file");
+            auto p = i->second;
+            lk.unlock();
+            write_int(v, file_hash(normalize_path(p)));
+        }
+    };
+    write_files(f.implicit_inputs);
+    write_files(f.inputs);
+    write_files(f.outputs);
+    write_int(v, f.generation);
+}
 
-    auto n = f.implicit_inputs.size();
-    write_int(v, n);
-    for (auto &h : f.implicit_inputs)
+void FileDb::writeFile(std::vector<uint8_t> &v, const path &f, const detail::Storage &s)
+{
+    v.clear();
+
+    auto p = normalize_path(f);
+    write_str(v, to_string(p));
+
+    FileRecord r;
     {
         boost::upgrade_lock lk(s.m_file_storage_by_hash);
-        auto i = s.file_storage_by_hash.find(h);
-        if (i == s.file_storage_by_hash.end())
-            throw SW_RUNTIME_ERROR("no such file");
-        auto p = i->second;
-        lk.unlock();
-        write_int(v, file_hash(normalize_path(p)));
+        auto i = s.file_records.find(file_hash(p));
+        if (i != s.file_records.end())
+            r = i->second;
     }
+    write_int(v, r.mtime);
+    write_int(v, r.changes);
 }
 
 static String getFilesSuffix()
@@ -159,8 +233,12 @@ static String getFilesSuffix()
     return ".files";
 }
 
-static void load(const path &fn, Files &files, std::unordered_map<size_t, path> &files2, ConcurrentCommandStorage &commands)
+static void load(const path &fn, detail::Storage &s)
 {
+    auto &files = s.file_storage;
+    auto &files2 = s.file_storage_by_hash;
+    auto &commands = s.storage;
+
     // files
     auto fn_with_suffix = path(fn) += getFilesSuffix();
     if (fs::exists(fn_with_suffix))
@@ -181,12 +259,22 @@ static void load(const path &fn, Files &files, std::unordered_map<size_t, path>
                 continue;
 
             // file
-            String s;
-            b.read(s);
-            auto p = fs::u8path(s);
+            auto start = b.index();
+            String str;
+            b.read(str);
+            auto p = fs::u8path(str);
             files.insert(p);
 
             files2[file_hash(p)] = p;
+
+            // record
+            FileRecord r;
+            if (b.index() - start + sizeof(r.mtime) + sizeof(r.changes) <= sz)
+            {
+                b.read(r.mtime);
+                b.read(r.changes);
+                s.file_records[file_hash(p)] = r;
+            }
         }
     }
 
@@ -209,6 +297,7 @@ static void load(const path &fn, Files &files, std::unordered_map<size_t, path>
             if (sz == 0)
                 continue;
 
+            auto start = b.index();
             size_t h;
             b.read(h);
 
@@ -219,68 +308,109 @@ static void load(const path &fn, Files &files, std::unordered_map<size_t, path>
                 //throw SW_RUNTIME_ERROR("x");
 
             b.read(r.first->mtime);
+            b.read(r.first->duration);
 
-            size_t n;
-            b.read(n);
-            r.first->implicit_inputs.reserve(n);
-            while (n--)
+            auto read_files = [&b, &files2](auto &ids)
             {
-                b.read(h);
-                auto &f = files2[h];
-                if (!f.empty())
+                size_t n;
+                b.read(n);
+                ids.reserve(n);
+                while (n--)
                 {
-                    //r.first->implicit_inputs.insert(files2[h]);
-                    r.first->implicit_inputs.insert(h);
+                    size_t h;
+                    b.read(h);
+                    auto i = files2.find(h);
+                    if (i != files2.end() && !i->second.empty())
+                        ids.insert(h);
                 }
-            }
+            };
+            read_files(r.first->implicit_inputs);
+            read_files(r.first->inputs);
+            read_files(r.first->outputs);
+
+            // absent in older records
+            if (b.index() - start + sizeof(r.first->generation) <= sz)
+                b.read(r.first->generation);
+            s.generation = std::max(s.generation, r.first->generation + 1);
         }
     }
 }
 
-void FileDb::load(Files &files, std::unordered_map<size_t, path> &files2, ConcurrentCommandStorage &commands, const path &root) const
+void FileDb::load(detail::Storage &s, const path &root) const
 {
-    sw::load(getCommandsDbFilename(root), files, files2, commands);
-    sw::load(getCommandsLogFileName(root), files, files2, commands);
+    sw::load(getCommandsDbFilename(root), s);
+    sw::load(getCommandsLogFileName(root), s);
 }
 
-void FileDb::save(const Files &files, const detail::Storage &s, ConcurrentCommandStorage &commands, const path &root) const
+static void save_stream(primitives::BinaryStream &b, const path &p, bool compact)
+{
+    if (b.empty())
+    {
+        // everything is dead
+        error_code ec;
+        if (compact)
+            fs::remove(p, ec);
+        return;
+    }
+    fs::create_directories(p.parent_path());
+    // concurrent readers must not see partially written file
+    auto tmp = path(p) += ".tmp";
+    b.save(tmp);
+    fs::rename(tmp, p);
+}
+
+void FileDb::save(detail::Storage &s, const path &root, uint32_t max_age) const
 {
     std::vector<uint8_t> v;
 
-    // files
+    // commands
+    std::unordered_set<size_t> live_files;
     {
         primitives::BinaryStream b(10'000'000); // reserve amount
-        for (auto &f : files)
+        for (const auto &[k, r] : s.storage)
         {
-            auto s = to_string(normalize_path(f));
-            auto sz = s.size() + 1;
+            if (is_dead(r, s.generation, max_age))
+                continue;
+            if (max_age)
+            {
+                live_files.insert(r.implicit_inputs.begin(), r.implicit_inputs.end());
+                live_files.insert(r.inputs.begin(), r.inputs.end());
+                live_files.insert(r.outputs.begin(), r.outputs.end());
+            }
+            write(v, r, s);
+            auto sz = v.size();
             b.write(sz);
-            b.write(s);
-        }
-        if (!b.empty())
-        {
-            auto p = getCommandsDbFilename(root) += getFilesSuffix();
-            fs::create_directories(p.parent_path());
-            b.save(p);
+            b.write(v.data(), v.size());
         }
+        save_stream(b, getCommandsDbFilename(root), max_age != 0);
     }
 
-    // commands
+    // files
     {
         primitives::BinaryStream b(10'000'000); // reserve amount
-        for (const auto &[k, r] : commands)
+        auto add_file = [this, &b, &v, &s](const path &f)
         {
-            write(v, r, s);
+            writeFile(v, f, s);
             auto sz = v.size();
             b.write(sz);
             b.write(v.data(), v.size());
+        };
+        if (max_age)
+        {
+            // dense table of referenced files only
+            for (auto &h : live_files)
+            {
+                auto i = s.file_storage_by_hash.find(h);
+                if (i != s.file_storage_by_hash.end())
+                    add_file(i->second);
+            }
         }
-        if (!b.empty())
+        else
         {
-            auto p = getCommandsDbFilename(root);
-            fs::create_directories(p.parent_path());
-            b.save(p);
+            for (auto &f : s.file_storage)
+                add_file(f);
         }
+        save_stream(b, getCommandsDbFilename(root) += getFilesSuffix(), max_age != 0);
     }
 
     error_code ec;
@@ -315,6 +445,7 @@ CommandStorage::CommandStorage(const SwBuilderContext &swctx, const path &root)
     : swctx(swctx)
     , root(root)
     , fdb(swctx)
+    , rebuild_log(getRebuildLogFilename(root))
 {
     //lock = getLock();
     load(); // load early
@@ -348,17 +479,23 @@ void CommandStorage::async_command_log(const CommandRecord &r)
 
         {
             auto &l = s.getFileLog(swctx, root);
-            for (auto &&f : r.getImplicitInputs(s))
+            auto log_files = [this, &s, &l](auto &&ids)
             {
-                auto r = s.file_storage.insert(*f);
-                if (!r.second)
-                    continue;
-                auto s = to_string(normalize_path(*f));
-                auto sz = s.size() + 1;
-                fwrite(&sz, sizeof(sz), 1, l.f.getHandle());
-                fwrite(&s[0], sz, 1, l.f.getHandle());
-                fflush(l.f.getHandle());
-            }
+                for (auto &&f : CommandRecord::getFiles(ids, s))
+                {
+                    auto r = s.file_storage.insert(*f);
+                    if (!r.second)
+                        continue;
+                    fdb.writeFile(v, *f, s);
+                    auto sz = v.size();
+                    fwrite(&sz, sizeof(sz), 1, l.f.getHandle());
+                    fwrite(&v[0], sz, 1, l.f.getHandle());
+                }
+            };
+            log_files(r.implicit_inputs);
+            log_files(r.inputs);
+            log_files(r.outputs);
+            fflush(l.f.getHandle());
         }
 
         free_user();
@@ -424,12 +561,78 @@ detail::FileHolder &detail::Storage::getFileLog(const SwBuilderContext &swctx, c
 
 void CommandStorage::load()
 {
-    fdb.load(s.file_storage, s.file_storage_by_hash, s.storage, root);
+    fdb.load(s, root);
 }
 
 void CommandStorage::save1()
 {
-    fdb.save(s.file_storage, s, s.storage, root);
+    auto lfn = getCommandsDbLockFileName(root);
+    fs::create_directories(lfn.parent_path());
+    ScopedFileLock lk(lfn);
+    fdb.save(s, root, s.generation % COMMAND_DB_COMPACTION_PERIOD == 0 ? COMMAND_DB_MAX_AGE : 0);
+}
+
+static uintmax_t get_db_size(const path &root)
+{
+    uintmax_t sz = 0;
+    for (auto &p : { getCommandsDbFilename(root), getCommandsDbFilename(root) += getFilesSuffix() })
+    {
+        error_code ec;
+        auto n = fs::file_size(p, ec);
+        if (!ec)
+            sz += n;
+    }
+    return sz;
+}
+
+static CommandStorage::Stats get_stats(detail::Storage &s, const path &root, uint32_t max_age)
+{
+    CommandStorage::Stats st;
+    st.generation = s.generation;
+    std::unordered_set<size_t> live_files;
+    for (const auto &[k, r] : s.storage)
+    {
+        st.commands++;
+        if (is_dead(r, s.generation, max_age))
+        {
+            st.dead_commands++;
+            continue;
+        }
+        live_files.insert(r.implicit_inputs.begin(), r.implicit_inputs.end());
+        live_files.insert(r.inputs.begin(), r.inputs.end());
+        live_files.insert(r.outputs.begin(), r.outputs.end());
+    }
+    for (auto &[h, _] : s.file_storage_by_hash)
+    {
+        st.files++;
+        if (!live_files.contains(h))
+            st.dead_files++;
+    }
+    st.size = get_db_size(root);
+    return st;
+}
+
+CommandStorage::Stats CommandStorage::getStats(uint32_t max_age)
+{
+    return get_stats(s, root, max_age);
+}
+
+CommandStorage::Stats CommandStorage::compact(uint32_t max_age)
+{
+    if (max_age == 0)
+        throw SW_RUNTIME_ERROR("Max age of command records must be positive");
+
+    auto lfn = getCommandsDbLockFileName(root);
+    fs::create_directories(lfn.parent_path());
+    ScopedFileLock lk(lfn);
+
+    // db might be saved by other processes after we loaded it, so work on fresh copy
+    detail::Storage d;
+    fdb.load(d, root);
+    auto st = get_stats(d, root, max_age);
+    fdb.save(d, root, max_age);
+    st.compacted_size = get_db_size(root);
+    return st;
 }
 
 ConcurrentCommandStorage &CommandStorage::getStorage()
@@ -444,7 +647,15 @@ detail::Storage &CommandStorage::getInternalStorage()
 
 std::pair<CommandRecord *, bool> CommandStorage::insert(size_t hash)
 {
-    return getStorage().insert(hash);
+    auto r = getStorage().insert(hash);
+    // used in this build
+    r.first->generation = s.generation;
+    return r;
+}
+
+path CommandStorage::getRebuildLogFilename(const path &root)
+{
+    return getDir(root) / "rebuild_causes.bin";
 }
 
 path CommandStorage::getLockFileName() const
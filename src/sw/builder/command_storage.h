@@ -19,6 +19,7 @@
 #pragma once
 
 #include "concurrent_map.h"
+#include "rebuild_log.h"
 
 #include <boost/thread/shared_mutex.hpp>
 #include <primitives/lock.h>
@@ -50,14 +51,34 @@ struct FileHolder
 struct CommandRecord
 {
     using implicit_inputs_t = std::unordered_set<path*>;
+    using file_ids_t = std::unordered_set<size_t>;
 
     size_t hash = 0;
     fs::file_time_type mtime = fs::file_time_type::min();
+    // duration of the last execution, ms
+    uint64_t duration = 0;
+    // last build that used the command
+    uint32_t generation = 0;
     //Files implicit_inputs;
-    std::unordered_set<size_t> implicit_inputs;
+    file_ids_t implicit_inputs;
+    // explicit inputs and outputs, used to restore command graph offline
+    file_ids_t inputs;
+    file_ids_t outputs;
 
     implicit_inputs_t getImplicitInputs(detail::Storage &) const;
     void setImplicitInputs(const Files &, detail::Storage &);
+    void setInputs(const Files &, detail::Storage &);
+    void setOutputs(const Files &, detail::Storage &);
+
+    static implicit_inputs_t getFiles(const file_ids_t &, detail::Storage &);
+};
+
+// what we know about file between runs
+struct FileRecord
+{
+    fs::file_time_type mtime = fs::file_time_type::min();
+    // number of observed changes of the file
+    uint32_t changes = 0;
 };
 
 using ConcurrentCommandStorage = ConcurrentMap<size_t, CommandRecord>;
@@ -74,9 +95,13 @@ struct Storage
     Files file_storage;
     mutable boost::upgrade_mutex m_file_storage_by_hash;
     std::unordered_map<size_t, path> file_storage_by_hash;
+    std::unordered_map<size_t, FileRecord> file_records;
     std::unique_ptr<FileHolder> files;
+    // current build, one more than the newest loaded record
+    uint32_t generation = 0;
 
     void closeLogs();
+    void updateFileRecord(const path &, const fs::file_time_type &);
     FileHolder &getCommandLog(const SwBuilderContext &swctx, const path &root);
     FileHolder &getFileLog(const SwBuilderContext &swctx, const path &root);
 };
@@ -89,14 +114,28 @@ struct FileDb
 
     FileDb(const SwBuilderContext &swctx);
 
-    void load(Files &files, std::unordered_map<size_t, path> &files2, ConcurrentCommandStorage &commands, const path &root) const;
-    void save(const Files &files, const detail::Storage &, ConcurrentCommandStorage &commands, const path &root) const;
+    void load(detail::Storage &, const path &root) const;
+    // max_age > 0 - records not used during last max_age builds and files not referenced by others are dropped
+    void save(detail::Storage &, const path &root, uint32_t max_age = 0) const;
 
     static void write(std::vector<uint8_t> &, const CommandRecord &, const detail::Storage &);
+    static void writeFile(std::vector<uint8_t> &, const path &, const detail::Storage &);
 };
 
 struct SW_BUILDER_API CommandStorage
 {
+    struct Stats
+    {
+        uint32_t generation = 0;
+        size_t commands = 0;
+        size_t dead_commands = 0;
+        size_t files = 0;
+        size_t dead_files = 0;
+        // commands db and path table
+        uintmax_t size = 0;
+        uintmax_t compacted_size = 0;
+    };
+
     const SwBuilderContext &swctx;
     path root;
 
@@ -111,10 +150,20 @@ struct SW_BUILDER_API CommandStorage
     void add_user();
     void free_user();
     std::pair<CommandRecord *, bool> insert(size_t hash);
+    RebuildLog &getRebuildLog() { return rebuild_log; }
+
+    // dead records are not used during last max_age builds
+    Stats getStats(uint32_t max_age);
+    // rewrites db without dead records and unreferenced files,
+    // other processes may use it at the same time; returns stats before compaction
+    Stats compact(uint32_t max_age);
+
+    static path getRebuildLogFilename(const path &root);
 
 private:
     FileDb fdb;
     detail::Storage s;
+    RebuildLog rebuild_log;
     std::atomic_int n_users{ 0 };
     std::mutex m;
     std::unique_ptr<ScopedFileLock> lock;
@@ -18,6 +18,8 @@
 
 #include "execution_plan.h"
 
+#include "admission.h"
+
 #include <sw/support/exceptions.h>
 
 // clang(win)+linux workaround
@@ -371,7 +373,12 @@ void ExecutionPlan::execute(Executor &e) const
             static_cast<builder::Command*>(c)->silent |= silent;
             static_cast<builder::Command*>(c)->show_output |= show_output;
             static_cast<builder::Command*>(c)->write_output_to_file |= write_output_to_file;
+            static_cast<builder::Command*>(c)->stream_output |= stream_outputs;
             static_cast<builder::Command*>(c)->always |= build_always;
+            if (!static_cast<builder::Command*>(c)->jobserver)
+                static_cast<builder::Command*>(c)->jobserver = jobserver;
+            static_cast<builder::Command*>(c)->admission = admission;
+            static_cast<builder::Command*>(c)->resource_classes = resource_classes;
         }
         //c->markForExecution();
     }
@@ -526,6 +533,25 @@ void ExecutionPlan::saveChromeTrace(const path &p) const
             e["args"]["environment"][k] = v;
         events.push_back(e);
     }
+
+    // concurrency over time
+    if (admission)
+    {
+        for (auto &s : admission->getSamples())
+        {
+            if (s.t < min)
+                continue;
+            nlohmann::json e;
+            e["name"] = "concurrency";
+            e["cat"] = "BUILD";
+            e["pid"] = 1;
+            e["ts"] = std::chrono::duration_cast<std::chrono::microseconds>(s.t - min).count();
+            e["ph"] = "C";
+            e["args"]["limit"] = s.limit;
+            e["args"]["running"] = s.running;
+            events.push_back(e);
+        }
+    }
     trace["traceEvents"] = events;
     write_file(p, trace.dump(2));
 }
@@ -62,6 +62,11 @@ public:
     bool silent = false;
     bool show_output = false;
     bool write_output_to_file = false;
+    // spill big outputs to files and release them after logging
+    bool stream_outputs = false;
+    Jobserver *jobserver = nullptr;
+    AdmissionController *admission = nullptr;
+    ResourceClasses *resource_classes = nullptr;
 
     ExecutionPlan(USet &cmds);
     ExecutionPlan(const ExecutionPlan &rhs) = delete;
@@ -78,6 +83,7 @@ public:
 
     // functions for builder::Command's
     static Commands load(const path &, const SwBuilderContext &, int type = 0);
+    static void save(const path &, const Commands &, int type = 0);
     void save(const path &, int type = 0) const;
 
     void saveChromeTrace(const path &) const;
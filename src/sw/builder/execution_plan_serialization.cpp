@@ -20,6 +20,7 @@
 #include <boost/serialization/access.hpp>
 #include <boost/serialization/base_object.hpp>
 #include <boost/serialization/export.hpp>
+#include <boost/serialization/version.hpp>
 
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/binary_oarchive.hpp>
@@ -36,7 +37,7 @@
 #include <sw/support/serialization.h>
 
 #define SERIALIZATION_TYPE sw::builder::Command
-SERIALIZATION_BEGIN_UNIFIED
+SERIALIZATION_BEGIN_UNIFIED_VERSIONED
     ar & boost::serialization::base_object<::primitives::Command>(v);
 
     ar & v.name;
@@ -67,6 +68,9 @@ SERIALIZATION_BEGIN_UNIFIED
     ar & v.remove_outputs_before_execution;
     ar & v.strict_order;
     ar & v.output_dirs;
+    // older plans keep default kind
+    if (version >= 1)
+        ar & v.kind;
 
     ar & v.inputs;
     ar & v.outputs;
@@ -111,7 +115,9 @@ SERIALIZATION_BEGIN_SPLIT
         v.insert(c);
     }
 SERIALIZATION_SPLIT_CONTINUE
-    SW_UNIMPLEMENTED;
+    ar & v.size();
+    for (auto &c : v)
+        ar & *c;
 SERIALIZATION_SPLIT_END
 
 namespace sw
@@ -156,11 +162,12 @@ Commands ExecutionPlan::load(const path &p, const SwBuilderContext &swctx, int t
     return commands;
 }
 
-void ExecutionPlan::save(const path &p, int type) const
+template <class C>
+static void save_commands(const path &p, const C &commands, int type)
 {
     fs::create_directories(p.parent_path());
 
-    auto save = [this](auto &ar)
+    auto save = [&commands](auto &ar)
     {
         ar << fs::current_path();
         ar << commands;
@@ -185,4 +192,14 @@ void ExecutionPlan::save(const path &p, int type) const
     }
 }
 
+void ExecutionPlan::save(const path &p, int type) const
+{
+    save_commands(p, commands, type);
+}
+
+void ExecutionPlan::save(const path &p, const Commands &commands, int type)
+{
+    save_commands(p, commands, type);
+}
+
 }
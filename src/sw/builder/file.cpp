@@ -23,9 +23,8 @@
 
 #include <sw/manager/settings.h>
 
-#include <primitives/executor.h>
-
 #include <fstream>
+#include <mutex>
 #include <sstream>
 
 #include <primitives/log.h>
@@ -36,32 +35,31 @@ DECLARE_STATIC_LOGGER(logger, "file");
 namespace sw
 {
 
+// human readable form of rebuild causes,
+// compact records are always written to command storage (see RebuildLog)
 void explainMessage(const String &subject, bool outdated, const String &reason, const String &name)
 {
-    static Executor explain_executor("explain executor", 1);
+    if (!outdated)
+        return;
+
+    std::ostringstream ss;
+    ss << subject << ": " << name << "\n";
+    ss << "outdated\n";
+    ss << "reason = " << reason << "\n\n";
+    auto s = ss.str();
+
+    static std::mutex m;
     static std::ofstream o([]()
     {
         fs::create_directories(path(SW_EXPLAIN_FILE).parent_path());
         return SW_EXPLAIN_FILE;
     }()); // goes first
-    explain_executor.push([=]
     {
-        if (!outdated)
-            return;
-        auto print = [&subject, &name, &reason](auto &o)
-        {
-            o << subject << ": " << name << "\n";
-            o << "outdated\n";
-            o << "reason = " << reason << "\n" << std::endl;
-        };
-        print(o);
-        if (sw::Settings::get_user_settings().gExplainOutdatedToTrace)
-        {
-            std::ostringstream ss;
-            print(ss);
-            LOG_TRACE(logger, ss.str());
-        }
-    });
+        std::unique_lock lk(m);
+        o << s;
+    }
+    if (sw::Settings::get_user_settings().gExplainOutdatedToTrace)
+        LOG_TRACE(logger, s);
 }
 
 FileData::FileData(const FileData &rhs)
@@ -0,0 +1,250 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#include "jobserver.h"
+
+#include <boost/algorithm/string.hpp>
+#include <primitives/exceptions.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "jobserver");
+
+namespace sw
+{
+
+Jobserver::Token::Token(Token &&rhs)
+{
+    *this = std::move(rhs);
+}
+
+Jobserver::Token &Jobserver::Token::operator=(Token &&rhs)
+{
+    if (this == &rhs)
+        return *this;
+    release();
+    js = rhs.js;
+    c = rhs.c;
+    implicit = rhs.implicit;
+    rhs.js = nullptr;
+    return *this;
+}
+
+Jobserver::Token::~Token()
+{
+    release();
+}
+
+void Jobserver::Token::release()
+{
+    if (!js)
+        return;
+    if (implicit)
+        js->implicit_token_free = true;
+    else
+        js->release(c);
+    js = nullptr;
+}
+
+Jobserver::~Jobserver()
+{
+#ifndef _WIN32
+    if (close_fds)
+    {
+        if (rfd != -1)
+            ::close(rfd);
+        if (wfd != -1 && wfd != rfd)
+            ::close(wfd);
+    }
+    if (nbfd != -1)
+        ::close(nbfd);
+    if (!fifo.empty())
+    {
+        error_code ec;
+        fs::remove(fifo, ec);
+    }
+#endif
+}
+
+std::unique_ptr<Jobserver> Jobserver::create(int jobs, const path &dir)
+{
+#ifdef _WIN32
+    // gnu make uses named semaphores here, not supported yet
+    return {};
+#else
+    static std::atomic_int n;
+
+    std::unique_ptr<Jobserver> js(new Jobserver);
+    fs::create_directories(dir);
+    js->fifo = dir / ("fifo." + std::to_string(getpid()) + "." + std::to_string(n++));
+    fs::remove(js->fifo);
+    if (mkfifo(js->fifo.c_str(), 0600) == -1)
+    {
+        auto err = errno;
+        js->fifo.clear();
+        throw SW_RUNTIME_ERROR(String("jobserver: cannot create fifo: ") + strerror(err));
+    }
+    // we are reader and writer, so open won't block
+    js->rfd = js->wfd = ::open(js->fifo.c_str(), O_RDWR | O_CLOEXEC);
+    if (js->rfd == -1)
+        throw SW_RUNTIME_ERROR(String("jobserver: cannot open fifo: ") + strerror(errno));
+
+    // one token is implicit
+    String tokens(std::max(jobs - 1, 0), '+');
+    if (!tokens.empty() && ::write(js->wfd, tokens.data(), tokens.size()) != (ssize_t)tokens.size())
+        throw SW_RUNTIME_ERROR(String("jobserver: cannot write tokens: ") + strerror(errno));
+    js->openNonblocking(js->fifo);
+
+    js->makeflags = "-j" + std::to_string(jobs) + " --jobserver-auth=fifo:" + js->fifo.string();
+    LOG_TRACE(logger, "created jobserver: " << js->makeflags);
+    return js;
+#endif
+}
+
+std::unique_ptr<Jobserver> Jobserver::fromEnvironment()
+{
+#ifdef _WIN32
+    return {};
+#else
+    auto e = getenv("MAKEFLAGS");
+    if (!e)
+        return {};
+    String makeflags = e;
+
+    // last one wins
+    String auth;
+    Strings words;
+    boost::split(words, makeflags, boost::is_any_of(" \t"));
+    for (auto &w : words)
+    {
+        for (String opt : { "--jobserver-auth=", "--jobserver-fds=" })
+        {
+            if (w.starts_with(opt))
+                auth = w.substr(opt.size());
+        }
+    }
+    if (auth.empty())
+        return {};
+
+    std::unique_ptr<Jobserver> js(new Jobserver);
+    js->makeflags = makeflags;
+    if (auth.starts_with("fifo:"))
+    {
+        auto fn = auth.substr(5);
+        js->rfd = js->wfd = ::open(fn.c_str(), O_RDWR | O_CLOEXEC);
+        if (js->rfd == -1)
+        {
+            LOG_DEBUG(logger, "cannot open jobserver fifo " << fn << ": " << strerror(errno));
+            return {};
+        }
+        js->openNonblocking(fn);
+        LOG_TRACE(logger, "using jobserver: " << auth);
+        return js;
+    }
+
+    // R,W pipe fds inherited from make
+    auto p = auth.find(',');
+    if (p == auth.npos)
+        return {};
+    js->rfd = std::stoi(auth.substr(0, p));
+    js->wfd = std::stoi(auth.substr(p + 1));
+    // fds are not ours, parent make may use them after we exit
+    js->close_fds = false;
+    // make closes fds for commands not marked as recursive ('+' prefix or $(MAKE))
+    if (fcntl(js->rfd, F_GETFD) == -1 || fcntl(js->wfd, F_GETFD) == -1)
+    {
+        LOG_DEBUG(logger, "jobserver fds are not available, recipe is not marked as recursive?");
+        return {};
+    }
+#ifdef __linux__
+    // reopening gives a new open file description, so its flags do not affect make
+    js->openNonblocking("/proc/self/fd/" + std::to_string(js->rfd));
+#endif
+    LOG_TRACE(logger, "using jobserver: " << auth);
+    return js;
+#endif
+}
+
+Jobserver::Token Jobserver::acquire()
+{
+    Token t;
+    t.js = this;
+    if (implicit_token_free.exchange(false))
+    {
+        t.implicit = true;
+        return t;
+    }
+#ifndef _WIN32
+    while (1)
+    {
+        auto r = ::read(rfd, &t.c, 1);
+        if (r == 1)
+            break;
+        if (r == -1 && errno == EINTR)
+            continue;
+        if (r == -1 && errno == EAGAIN)
+        {
+            // parent make may set nonblocking mode on pipe
+            pollfd pfd{};
+            pfd.fd = rfd;
+            pfd.events = POLLIN;
+            ::poll(&pfd, 1, -1);
+            continue;
+        }
+        t.js = nullptr;
+        throw SW_RUNTIME_ERROR(String("jobserver: cannot read token: ") + (r == 0 ? "eof" : strerror(errno)));
+    }
+#endif
+    return t;
+}
+
+std::optional<Jobserver::Token> Jobserver::tryAcquire()
+{
+    Token t;
+    t.js = this;
+    if (implicit_token_free.exchange(false))
+    {
+        t.implicit = true;
+        return t;
+    }
+#ifndef _WIN32
+    // without nonblocking fd we cannot try
+    while (nbfd != -1)
+    {
+        auto r = ::read(nbfd, &t.c, 1);
+        if (r == 1)
+            return t;
+        if (r == -1 && errno == EINTR)
+            continue;
+        // EAGAIN - no free slots
+        break;
+    }
+#endif
+    t.js = nullptr;
+    return {};
+}
+
+void Jobserver::openNonblocking(const path &fn)
+{
+#ifndef _WIN32
+    nbfd = ::open(fn.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (nbfd == -1)
+        LOG_DEBUG(logger, "cannot open jobserver fifo " << fn << " in nonblocking mode: " << strerror(errno));
+#endif
+}
+
+void Jobserver::release(char c)
+{
+#ifndef _WIN32
+    while (::write(wfd, &c, 1) == -1 && errno == EINTR)
+        ;
+#endif
+}
+
+} // namespace sw
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include <primitives/filesystem.h>
+
+#include <atomic>
+#include <memory>
+#include <optional>
+
+namespace sw
+{
+
+// GNU make compatible jobserver
+// https://www.gnu.org/software/make/manual/html_node/POSIX-Jobserver.html
+//
+// Every executed command holds one job slot.
+// Child processes receive MAKEFLAGS, so cooperating tools (make, ninja, gcc -flto=auto, cargo)
+// take their additional slots from the same pool instead of oversubscribing.
+struct SW_BUILDER_API Jobserver
+{
+    // job slot, returned to the pool on destruction
+    struct SW_BUILDER_API Token
+    {
+        Token() = default;
+        Token(const Token &) = delete;
+        Token &operator=(const Token &) = delete;
+        Token(Token &&);
+        Token &operator=(Token &&);
+        ~Token();
+
+    private:
+        Jobserver *js = nullptr;
+        char c = 0;
+        bool implicit = false;
+
+        void release();
+
+        friend struct Jobserver;
+    };
+
+    Jobserver(const Jobserver &) = delete;
+    Jobserver &operator=(const Jobserver &) = delete;
+    ~Jobserver();
+
+    // server mode: creates named fifo in dir with (jobs - 1) tokens,
+    // the remaining implicit token is ours
+    // returns nullptr on unsupported platforms
+    static std::unique_ptr<Jobserver> create(int jobs, const path &dir);
+    // client mode: connects to jobserver of the parent make from MAKEFLAGS
+    // returns nullptr if there is no (usable) jobserver
+    static std::unique_ptr<Jobserver> fromEnvironment();
+
+    // blocks until a slot is available
+    Token acquire();
+    // returns empty value when no slot is available now
+    std::optional<Token> tryAcquire();
+
+    // value of MAKEFLAGS for child processes
+    const String &getMakeflags() const { return makeflags; }
+    bool isClient() const { return fifo.empty(); }
+
+private:
+    int rfd = -1;
+    int wfd = -1;
+    // own nonblocking description of the same fifo or pipe for tryAcquire(),
+    // other clients may take the token between poll and read on blocking rfd
+    int nbfd = -1;
+    bool close_fds = true;
+    path fifo; // owned by us
+    String makeflags;
+    std::atomic_bool implicit_token_free = true;
+
+    Jobserver() = default;
+
+    void release(char c);
+    void openNonblocking(const path &fn);
+};
+
+} // namespace sw
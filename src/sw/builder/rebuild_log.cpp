@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#include "rebuild_log.h"
+
+#include <primitives/exceptions.h>
+#include <primitives/lock.h>
+
+#include <cstring>
+#include <fstream>
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "rebuild_log");
+
+#define REBUILD_LOG_FORMAT_VERSION 1
+
+namespace sw
+{
+
+namespace
+{
+
+struct Header
+{
+    char magic[4] = { 'S', 'W', 'R', 'B' };
+    uint32_t version = REBUILD_LOG_FORMAT_VERSION;
+    uint32_t record_size = sizeof(RebuildEvent);
+    uint32_t capacity = 0;
+    // number of events ever written
+    uint64_t next = 0;
+    uint32_t build = 0;
+    uint32_t reserved = 0;
+
+    bool isValid() const
+    {
+        return true
+            && memcmp(magic, Header{}.magic, sizeof(magic)) == 0
+            && version == REBUILD_LOG_FORMAT_VERSION
+            && record_size == sizeof(RebuildEvent)
+            && capacity
+            ;
+    }
+};
+
+}
+
+const char *toString(RebuildCause c)
+{
+    switch (c)
+    {
+    case RebuildCause::Always:
+        return "always build";
+    case RebuildCause::NewCommand:
+        return "new command";
+    case RebuildCause::InputNewer:
+        return "input changed";
+    case RebuildCause::InputMissing:
+        return "input is missing";
+    case RebuildCause::OutputNewer:
+        return "output changed";
+    case RebuildCause::OutputMissing:
+        return "output is missing";
+    case RebuildCause::ImplicitInputNewer:
+        return "implicit input changed";
+    case RebuildCause::ImplicitInputMissing:
+        return "implicit input is missing";
+    default:
+        return "unknown";
+    }
+}
+
+RebuildLog::RebuildLog(const path &fn, uint32_t capacity)
+    : fn(fn), capacity(capacity)
+{
+    if (capacity == 0)
+        throw SW_RUNTIME_ERROR("empty rebuild log");
+}
+
+RebuildLog::~RebuildLog()
+{
+    try
+    {
+        flush();
+    }
+    catch (std::exception &e)
+    {
+        LOG_ERROR(logger, "Cannot write rebuild log: " << e.what());
+    }
+}
+
+void RebuildLog::add(RebuildCause c, size_t command, size_t file,
+    const fs::file_time_type &old_stamp, const fs::file_time_type &new_stamp)
+{
+    std::call_once(once, [this] { events = std::make_unique<RebuildEvent[]>(capacity); });
+    auto &e = events[n++ % capacity];
+    e.command = command;
+    e.file = file;
+    e.old_stamp = old_stamp.time_since_epoch().count();
+    e.new_stamp = new_stamp.time_since_epoch().count();
+    e.cause = c;
+}
+
+void RebuildLog::flush()
+{
+    std::unique_lock lk(m);
+    uint64_t total = n;
+    if (total == 0)
+        return;
+    n = 0;
+
+    // storages are shared by sw processes
+    fs::create_directories(fn.parent_path());
+    ScopedFileLock flk(fn);
+    if (!fs::exists(fn))
+        std::ofstream(fn, std::ios::binary);
+    std::fstream f(fn, std::ios::in | std::ios::out | std::ios::binary);
+    if (!f)
+        throw SW_RUNTIME_ERROR("Cannot open file: " + to_string(fn));
+
+    Header h;
+    if (!f.read((char *)&h, sizeof(h)) || !h.isValid() || h.capacity != capacity)
+    {
+        // start over
+        h = Header{};
+        h.capacity = capacity;
+    }
+    f.clear();
+    h.build++;
+
+    auto count = std::min<uint64_t>(total, capacity);
+    for (auto k = total - count; k < total; k++)
+    {
+        auto e = events[k % capacity];
+        e.build = h.build;
+        f.seekp(sizeof(h) + (h.next++ % h.capacity) * sizeof(e));
+        f.write((const char *)&e, sizeof(e));
+    }
+    f.seekp(0);
+    f.write((const char *)&h, sizeof(h));
+    if (!f)
+        throw SW_RUNTIME_ERROR("Cannot write file: " + to_string(fn));
+}
+
+std::vector<RebuildEvent> RebuildLog::read(const path &fn)
+{
+    if (!fs::exists(fn))
+        return {};
+    ScopedFileLock lk(fn);
+    std::ifstream f(fn, std::ios::binary);
+    Header h;
+    if (!f.read((char *)&h, sizeof(h)) || !h.isValid())
+        return {};
+
+    auto count = std::min<uint64_t>(h.next, h.capacity);
+    std::vector<RebuildEvent> v;
+    v.reserve(count);
+    for (auto k = h.next - count; k < h.next; k++)
+    {
+        RebuildEvent e;
+        f.seekg(sizeof(h) + (k % h.capacity) * sizeof(e));
+        if (!f.read((char *)&e, sizeof(e)))
+            break;
+        v.push_back(e);
+    }
+    return v;
+}
+
+} // namespace sw
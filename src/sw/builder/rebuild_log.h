@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include <primitives/filesystem.h>
+
+#include <atomic>
+#include <mutex>
+
+namespace sw
+{
+
+enum class RebuildCause : uint8_t
+{
+    Always,
+    NewCommand,
+    InputNewer,
+    InputMissing,
+    OutputNewer,
+    OutputMissing,
+    ImplicitInputNewer,
+    ImplicitInputMissing,
+
+    Max,
+};
+
+SW_BUILDER_API
+const char *toString(RebuildCause);
+
+// fixed size, written as is
+struct RebuildEvent
+{
+    uint64_t command = 0; // command hash
+    uint64_t file = 0; // file id as in command storage, 0 - no file
+    int64_t old_stamp = 0; // command mtime
+    int64_t new_stamp = 0; // file mtime
+    uint32_t build = 0; // assigned on flush
+    RebuildCause cause = RebuildCause::Always;
+    uint8_t reserved[3] = {};
+};
+static_assert(sizeof(RebuildEvent) == 40);
+
+// Rebuild causes of commands.
+//
+// Events are recorded into preallocated memory without locks or string formatting,
+// so recording may be always on. On flush they are appended to a ring file
+// that keeps last 'capacity' events of previous builds.
+struct SW_BUILDER_API RebuildLog
+{
+    static constexpr uint32_t default_capacity = 1 << 16;
+
+    RebuildLog(const path &fn, uint32_t capacity = default_capacity);
+    RebuildLog(const RebuildLog &) = delete;
+    RebuildLog &operator=(const RebuildLog &) = delete;
+    ~RebuildLog();
+
+    void add(RebuildCause, size_t command, size_t file = 0,
+        const fs::file_time_type &old_stamp = fs::file_time_type::min(),
+        const fs::file_time_type &new_stamp = fs::file_time_type::min());
+    void flush();
+
+    // events in order, oldest first
+    static std::vector<RebuildEvent> read(const path &fn);
+
+private:
+    path fn;
+    uint32_t capacity;
+    std::unique_ptr<RebuildEvent[]> events;
+    std::once_flag once;
+    std::atomic_uint64_t n = 0;
+    std::mutex m;
+};
+
+} // namespace sw
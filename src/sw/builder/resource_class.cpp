@@ -0,0 +1,319 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#include "resource_class.h"
+
+#include <boost/algorithm/string.hpp>
+#include <primitives/exceptions.h>
+
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "resource_class");
+
+namespace sw
+{
+
+const char *toString(CommandKind k)
+{
+    switch (k)
+    {
+    case CommandKind::Custom:
+        return "custom";
+    case CommandKind::Compile:
+        return "compile";
+    case CommandKind::Link:
+        return "link";
+    case CommandKind::Test:
+        return "test";
+    default:
+        return "unknown";
+    }
+}
+
+ResourceClasses::ResourceClasses()
+{
+}
+
+ResourceClasses::~ResourceClasses()
+{
+#ifdef __linux__
+    if (!cgroup.empty())
+        removeCgroup();
+#endif
+}
+
+void ResourceClasses::parse(const String &in)
+{
+    auto to_int = [&in](const String &s)
+    {
+        try
+        {
+            return std::stoi(s);
+        }
+        catch (std::exception &)
+        {
+            throw SW_RUNTIME_ERROR("Bad number '" + s + "' in resource classes: " + in);
+        }
+    };
+
+    Strings v;
+    boost::split(v, in, boost::is_any_of(";"));
+    for (auto &s : v)
+    {
+        boost::trim(s);
+        if (s.empty())
+            continue;
+        auto p = s.find(':');
+        auto name = boost::trim_copy(s.substr(0, p));
+        int k = 0;
+        for (; k < (int)CommandKind::Max; k++)
+        {
+            if (name == toString((CommandKind)k))
+                break;
+        }
+        if (k == (int)CommandKind::Max)
+            throw SW_RUNTIME_ERROR("Unknown command kind '" + name + "' in resource classes: " + in);
+        auto &c = classes[k];
+        if (p == s.npos)
+            continue;
+
+        Strings kvs;
+        boost::split(kvs, s.substr(p + 1), boost::is_any_of(","));
+        for (auto &kv : kvs)
+        {
+            boost::trim(kv);
+            if (kv.empty())
+                continue;
+            auto p = kv.find('=');
+            if (p == kv.npos)
+                throw SW_RUNTIME_ERROR("Missing value of '" + kv + "' in resource classes: " + in);
+            auto key = kv.substr(0, p);
+            auto val = kv.substr(p + 1);
+            if (key == "nice")
+                c.nice = to_int(val);
+            else if (key == "io")
+            {
+                auto p = val.find('/');
+                auto cls = val.substr(0, p);
+                if (cls == "rt")
+                    c.io_class = 1;
+                else if (cls == "be")
+                    c.io_class = 2;
+                else if (cls == "idle")
+                    c.io_class = 3;
+                else
+                    throw SW_RUNTIME_ERROR("Unknown io class '" + cls + "' in resource classes: " + in);
+                if (p != val.npos)
+                    c.io_level = std::clamp(to_int(val.substr(p + 1)), 0, 7);
+            }
+            else
+                throw SW_RUNTIME_ERROR("Unknown key '" + key + "' in resource classes: " + in);
+        }
+    }
+}
+
+#ifdef __linux__
+static bool write_cgroup_file(const path &fn, const String &s)
+{
+    std::ofstream o(fn);
+    o << s;
+    o.close();
+    return !o.fail();
+}
+
+static String controllers_change(const Strings &controllers, char op)
+{
+    String s;
+    for (auto &c : controllers)
+        s += op + c + " ";
+    return s;
+}
+
+void ResourceClasses::removeCgroup()
+{
+    // children are finished
+    // parent with enabled controllers cannot have processes, so disable them first, then go back
+    if (!cgroup_controllers.empty() && !write_cgroup_file(cgroup_parent / "cgroup.subtree_control", controllers_change(cgroup_controllers, '-')))
+    {
+        LOG_WARN(logger, "cannot restore controllers of cgroup " << to_string(cgroup_parent) << ": " << strerror(errno));
+        return;
+    }
+    if (!write_cgroup_file(cgroup_parent / "cgroup.procs", std::to_string(getpid())))
+    {
+        LOG_WARN(logger, "cannot move back to cgroup " << to_string(cgroup_parent) << ": " << strerror(errno));
+        return;
+    }
+    error_code ec;
+    fs::remove(cgroup, ec);
+    if (ec)
+        LOG_WARN(logger, "cannot remove cgroup " << to_string(cgroup) << ": " << ec.message());
+}
+#endif
+
+bool ResourceClasses::setupCgroup(uint64_t memory_max, int cpu_weight)
+{
+#ifdef __linux__
+    // "0::/user.slice/..." for cgroup v2
+    std::ifstream ifs("/proc/self/cgroup");
+    String line, rel;
+    while (std::getline(ifs, line))
+    {
+        if (line.starts_with("0::"))
+            rel = line.substr(3);
+    }
+    if (rel.empty())
+    {
+        LOG_DEBUG(logger, "cgroup v2 is not available");
+        return false;
+    }
+    auto base = path("/sys/fs/cgroup") / path(rel).relative_path();
+    if (access((base / "cgroup.subtree_control").c_str(), W_OK) != 0 ||
+        access((base / "cgroup.procs").c_str(), W_OK) != 0)
+    {
+        LOG_DEBUG(logger, "cgroup " << rel << " is not delegated, limits are not applied");
+        return false;
+    }
+
+    // do not touch controllers enabled by others
+    Strings controllers;
+    {
+        std::ifstream sc(base / "cgroup.subtree_control");
+        std::set<String> enabled{ std::istream_iterator<String>(sc), std::istream_iterator<String>() };
+        for (auto c : { "memory", "cpu" })
+        {
+            if (!enabled.contains(c))
+                controllers.push_back(c);
+        }
+    }
+
+    auto pid = std::to_string(getpid());
+    auto cg = base / ("sw." + pid);
+    error_code ec;
+    fs::create_directories(cg, ec);
+    if (ec)
+    {
+        LOG_DEBUG(logger, "cannot create cgroup " << to_string(cg) << ": " << ec.message());
+        return false;
+    }
+
+    // processes may live only in leaves, so we move first, then enable controllers for children
+    if (!write_cgroup_file(cg / "cgroup.procs", pid) ||
+        (!controllers.empty() && !write_cgroup_file(base / "cgroup.subtree_control", controllers_change(controllers, '+'))))
+    {
+        LOG_DEBUG(logger, "cannot enable cgroup controllers in " << rel << ", limits are not applied");
+        write_cgroup_file(base / "cgroup.procs", pid);
+        fs::remove(cg, ec);
+        return false;
+    }
+    cgroup_parent = base;
+    cgroup = cg;
+    cgroup_controllers = controllers;
+
+    if (memory_max && !write_cgroup_file(cg / "memory.max", std::to_string(memory_max)))
+        LOG_WARN(logger, "cannot set memory.max of " << to_string(cg));
+    if (cpu_weight && !write_cgroup_file(cg / "cpu.weight", std::to_string(std::clamp(cpu_weight, 1, 10000))))
+        LOG_WARN(logger, "cannot set cpu.weight of " << to_string(cg));
+    LOG_DEBUG(logger, "build is running in cgroup " << to_string(cg));
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef __linux__
+static void apply(const ResourceClass &c)
+{
+    // both calls change calling thread only
+    if (c.nice && setpriority(PRIO_PROCESS, 0, *c.nice) != 0)
+        LOG_TRACE(logger, "cannot set nice level " << *c.nice << ": " << strerror(errno));
+    if (c.io_class && syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, 0, (c.io_class << 13) | c.io_level) != 0)
+        LOG_TRACE(logger, "cannot set io priority: " << strerror(errno));
+}
+#endif
+
+void ResourceClasses::run(CommandKind k, const std::function<void()> &f)
+{
+    auto &s = stats[(int)k];
+    s.commands++;
+    auto r = ++s.running;
+    auto m = s.max_running.load();
+    while (r > m && !s.max_running.compare_exchange_weak(m, r))
+        ;
+
+    struct Finish
+    {
+        Stats &s;
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+        ~Finish()
+        {
+            s.time += std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+            s.running--;
+        }
+    } finish{ s };
+
+    auto &c = classes[(int)k];
+#ifdef __linux__
+    if (!c.empty())
+    {
+        std::exception_ptr e;
+        std::thread t([&c, &f, &e]
+        {
+            apply(c);
+            try
+            {
+                f();
+            }
+            catch (...)
+            {
+                e = std::current_exception();
+            }
+        });
+        t.join();
+        if (e)
+            std::rethrow_exception(e);
+        return;
+    }
+#endif
+    f();
+}
+
+String ResourceClasses::getStats() const
+{
+    String s;
+    for (int k = 0; k < (int)CommandKind::Max; k++)
+    {
+        auto &st = stats[k];
+        if (!st.commands)
+            continue;
+        s += std::format("{:>8}: {} commands, {:.2f} s, max {} running\n",
+            toString((CommandKind)k), st.commands.load(), st.time / 1000.0, st.max_running.load());
+    }
+#ifdef __linux__
+    if (!cgroup.empty())
+    {
+        std::ifstream ifs(cgroup / "memory.peak");
+        uint64_t peak = 0;
+        if (ifs >> peak)
+            s += std::format("cgroup memory peak: {} MB\n", peak / 1024 / 1024);
+    }
+#endif
+    if (!s.empty())
+        s.pop_back();
+    return s;
+}
+
+} // namespace sw
@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include <primitives/filesystem.h>
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <optional>
+
+namespace sw
+{
+
+enum class CommandKind : uint8_t
+{
+    Custom,
+    Compile,
+    Link,
+    Test,
+
+    Max,
+};
+
+SW_BUILDER_API
+const char *toString(CommandKind);
+
+// scheduling of processes of one command kind
+struct ResourceClass
+{
+    std::optional<int> nice;
+    // linux ioprio class: 1 - realtime, 2 - best effort, 3 - idle; 0 - unchanged
+    int io_class = 0;
+    int io_level = 4;
+
+    bool empty() const { return !nice && !io_class; }
+};
+
+// Resource classes of build commands with per class accounting.
+//
+// Nice level and io priority are per thread attributes on linux and they are inherited by forked processes.
+// So commands of a class are started from a short lived thread with these attributes set,
+// builder threads keep their own priorities.
+// Optionally the whole build is moved into a cgroup v2 sub-group with memory.max and cpu.weight,
+// when the current cgroup is delegated to us. Otherwise limits are not applied.
+// On other systems only accounting works.
+struct SW_BUILDER_API ResourceClasses
+{
+    ResourceClasses();
+    ResourceClasses(const ResourceClasses &) = delete;
+    ResourceClasses &operator=(const ResourceClasses &) = delete;
+    ~ResourceClasses();
+
+    // "compile:nice=10,io=idle;link:nice=5,io=be/7;test:io=be"
+    void parse(const String &);
+    ResourceClass &operator[](CommandKind k) { return classes[(int)k]; }
+
+    // memory_max in bytes, 0 - do not set; cpu_weight 1-10000, 0 - do not set
+    bool setupCgroup(uint64_t memory_max, int cpu_weight);
+
+    void run(CommandKind, const std::function<void()> &);
+
+    // text for -measure output
+    String getStats() const;
+
+private:
+    struct Stats
+    {
+        std::atomic_size_t commands = 0;
+        std::atomic_size_t running = 0;
+        std::atomic_size_t max_running = 0;
+        std::atomic_uint64_t time = 0; // ms
+    };
+
+    std::array<ResourceClass, (int)CommandKind::Max> classes;
+    std::array<Stats, (int)CommandKind::Max> stats;
+    path cgroup_parent;
+    path cgroup;
+    // enabled by us in parent subtree_control, disabled back on exit
+    Strings cgroup_controllers;
+
+    void removeCgroup();
+};
+
+} // namespace sw
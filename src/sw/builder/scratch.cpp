@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#include "scratch.h"
+
+#include <primitives/exceptions.h>
+
+#include <algorithm>
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "scratch");
+
+namespace sw
+{
+
+ScratchDirectory::ScratchDirectory(const path &in, uintmax_t capacity)
+    : root(normalize_path(fs::absolute(in)))
+    , capacity(capacity)
+{
+    fs::create_directories(root);
+
+    // files left from previous runs
+    error_code ec;
+    for (auto i = fs::recursive_directory_iterator(root, ec); !ec && i != fs::recursive_directory_iterator(); i.increment(ec))
+    {
+        error_code ec2;
+        if (i->is_regular_file(ec2))
+            used += i->file_size(ec2);
+    }
+
+    // do not fill tmpfs completely, it is the memory
+    auto sp = fs::space(root, ec);
+    if (!ec)
+    {
+        auto limit = used + sp.available / 2;
+        if (this->capacity == 0 || this->capacity > limit)
+            this->capacity = limit;
+    }
+    if (this->capacity == 0)
+        throw SW_RUNTIME_ERROR("cannot determine size of scratch directory: " + to_string(root));
+
+    LOG_DEBUG(logger, "scratch directory " << to_string(root) << ": " << used / 1024 / 1024 << " of "
+        << this->capacity / 1024 / 1024 << " MB used");
+}
+
+path ScratchDirectory::mirror(const path &p) const
+{
+    auto a = normalize_path(fs::absolute(p));
+    auto rn = to_string(a.root_name());
+    // drive letter
+    rn.erase(std::remove(rn.begin(), rn.end(), ':'), rn.end());
+    return root / rn / a.relative_path();
+}
+
+path ScratchDirectory::map(const path &p, uintmax_t estimated_size)
+{
+    if (contains(p))
+        return p;
+    auto s = mirror(p);
+
+    error_code ec;
+    std::unique_lock lk(m);
+    if (fs::exists(s, ec))
+        return s;
+    // do not move existing files, this triggers rebuilds
+    if (fs::exists(p, ec))
+        return p;
+    if (used + estimated_size > capacity)
+    {
+        if (spilled++ == 0)
+            LOG_DEBUG(logger, "scratch directory is full, new files are placed on disk");
+        return p;
+    }
+    used += estimated_size;
+    return s;
+}
+
+bool ScratchDirectory::contains(const path &p) const
+{
+    return is_under_root_by_prefix_path(normalize_path(p), root);
+}
+
+uintmax_t ScratchDirectory::getUsedSize() const
+{
+    std::unique_lock lk(m);
+    return used;
+}
+
+} // namespace sw
@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include <primitives/filesystem.h>
+
+#include <mutex>
+
+namespace sw
+{
+
+// Scratch root for intermediate build products (objects, depfiles, pch binaries),
+// usually on tmpfs.
+//
+// Files are mirrored by their absolute paths: /a/b/obj/x.o -> <root>/a/b/obj/x.o.
+// Placement must be stable between runs, because paths are part of command hashes:
+// existing scratch files stay in scratch, existing disk files stay on disk,
+// new files go to scratch while estimated usage fits the size cap and spill to disk after that.
+// Scratch files vanish on reboot; commands see their outputs missing and run again.
+struct SW_BUILDER_API ScratchDirectory
+{
+    // capacity in bytes, 0 - limited by free space only
+    ScratchDirectory(const path &root, uintmax_t capacity = 0);
+    ScratchDirectory(const ScratchDirectory &) = delete;
+    ScratchDirectory &operator=(const ScratchDirectory &) = delete;
+
+    // returns path in scratch or p itself when file must stay on disk
+    path map(const path &p, uintmax_t estimated_size);
+    bool contains(const path &) const;
+
+    const path &getRoot() const { return root; }
+    uintmax_t getCapacity() const { return capacity; }
+    uintmax_t getUsedSize() const;
+
+private:
+    path root;
+    uintmax_t capacity;
+    uintmax_t used = 0;
+    size_t spilled = 0;
+    mutable std::mutex m;
+
+    path mirror(const path &) const;
+};
+
+} // namespace sw
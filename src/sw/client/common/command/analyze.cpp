@@ -0,0 +1,292 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#include "../commands.h"
+
+#include <sw/builder/command_storage.h>
+#include <sw/builder/sw_context.h>
+
+#include <nlohmann/json.hpp>
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "analyze");
+
+namespace
+{
+
+struct CommandInfo
+{
+    uint64_t duration = 0; // ms
+    bool compile = false; // has implicit inputs (deps)
+    std::vector<size_t> outputs;
+};
+
+struct HeaderInfo
+{
+    size_t id = 0;
+    size_t tus = 0;
+    size_t links = 0;
+    uint64_t tu_cost = 0; // ms
+    uint64_t cost = 0; // ms
+    uint32_t changes = 0;
+};
+
+struct RebuildCauses
+{
+    size_t events = 0;
+    // builds seen in ring files
+    size_t builds = 0;
+    std::unordered_set<size_t> commands;
+    std::map<sw::RebuildCause, size_t> causes;
+    // file, cause -> number of rebuilt commands
+    std::map<std::pair<size_t, sw::RebuildCause>, size_t> files;
+
+    void add(const std::vector<sw::RebuildEvent> &v)
+    {
+        std::unordered_set<uint32_t> bs;
+        for (auto &e : v)
+        {
+            if (e.cause >= sw::RebuildCause::Max)
+                continue;
+            events++;
+            bs.insert(e.build);
+            commands.insert(e.command);
+            causes[e.cause]++;
+            if (e.file)
+                files[{ e.file, e.cause }]++;
+        }
+        builds += bs.size();
+    }
+
+    auto getFiles() const
+    {
+        std::vector<std::pair<std::pair<size_t, sw::RebuildCause>, size_t>> v(files.begin(), files.end());
+        std::sort(v.begin(), v.end(), [](const auto &a, const auto &b) { return a.second > b.second; });
+        return v;
+    }
+};
+
+struct BuildGraph
+{
+    std::vector<CommandInfo> commands;
+    // file -> commands that read it (explicitly or implicitly)
+    std::unordered_map<size_t, std::vector<size_t>> consumers;
+    std::unordered_map<size_t, std::vector<size_t>> includers;
+    std::unordered_map<size_t, path> files;
+    std::unordered_map<size_t, sw::FileRecord> file_records;
+    RebuildCauses rebuilds;
+
+    void load(const path &dir)
+    {
+        sw::SwBuilderContext ctx;
+
+        std::set<path> roots;
+        for (auto &e : fs::recursive_directory_iterator(dir))
+        {
+            if (e.path().filename() != "commands.bin")
+                continue;
+            // root/db/<version>/commands.bin
+            roots.insert(e.path().parent_path().parent_path().parent_path());
+        }
+
+        for (auto &root : roots)
+        {
+            LOG_DEBUG(logger, "loading command storage: " << to_string(normalize_path(root)));
+            // we do not change anything, so storage won't be saved
+            sw::CommandStorage cs(ctx, root);
+            auto &s = cs.getInternalStorage();
+            for (auto &[h, p] : s.file_storage_by_hash)
+                files.emplace(h, p);
+            for (auto &[h, fr] : s.file_records)
+            {
+                auto &r = file_records[h];
+                if (fr.changes >= r.changes)
+                    r = fr;
+            }
+            for (const auto &[k, r] : s.storage)
+                add(r);
+            rebuilds.add(sw::RebuildLog::read(sw::CommandStorage::getRebuildLogFilename(root)));
+        }
+    }
+
+    HeaderInfo getHeaderInfo(size_t h) const
+    {
+        HeaderInfo hi;
+        hi.id = h;
+        if (auto i = file_records.find(h); i != file_records.end())
+            hi.changes = i->second.changes;
+
+        auto i = includers.find(h);
+        if (i == includers.end())
+            return hi;
+
+        std::vector<bool> visited(commands.size());
+        std::deque<size_t> q;
+        for (auto c : i->second)
+        {
+            if (visited[c])
+                continue;
+            visited[c] = true;
+            q.push_back(c);
+            hi.tus++;
+            hi.tu_cost += commands[c].duration;
+        }
+        while (!q.empty())
+        {
+            auto c = q.front();
+            q.pop_front();
+            hi.cost += commands[c].duration;
+            if (!commands[c].compile)
+                hi.links++;
+            for (auto o : commands[c].outputs)
+            {
+                auto j = consumers.find(o);
+                if (j == consumers.end())
+                    continue;
+                for (auto c2 : j->second)
+                {
+                    if (visited[c2])
+                        continue;
+                    visited[c2] = true;
+                    q.push_back(c2);
+                }
+            }
+        }
+        return hi;
+    }
+
+    std::vector<HeaderInfo> getHeaders() const
+    {
+        std::vector<HeaderInfo> v;
+        v.reserve(includers.size());
+        for (auto &[h, _] : includers)
+            v.push_back(getHeaderInfo(h));
+        std::sort(v.begin(), v.end(), [](const auto &h1, const auto &h2)
+        {
+            if (h1.cost != h2.cost)
+                return h1.cost > h2.cost;
+            return h1.tus > h2.tus;
+        });
+        return v;
+    }
+
+    String getFileName(size_t h) const
+    {
+        auto i = files.find(h);
+        if (i == files.end())
+            return std::to_string(h);
+        return to_string(normalize_path(i->second));
+    }
+
+private:
+    void add(const sw::CommandRecord &r)
+    {
+        auto id = commands.size();
+        auto &c = commands.emplace_back();
+        c.duration = r.duration;
+        c.compile = !r.implicit_inputs.empty();
+        c.outputs.assign(r.outputs.begin(), r.outputs.end());
+        for (auto f : r.implicit_inputs)
+        {
+            includers[f].push_back(id);
+            consumers[f].push_back(id);
+        }
+        for (auto f : r.inputs)
+            consumers[f].push_back(id);
+    }
+};
+
+static String seconds(uint64_t ms)
+{
+    return std::format("{:.2f}", ms / 1000.0);
+}
+
+static String print(const BuildGraph &g, const HeaderInfo &h)
+{
+    return std::format("{:>10} s {:>7} TUs {:>5} links {:>5} changes   {}",
+        seconds(h.cost), h.tus, h.links, h.changes, g.getFileName(h.id));
+}
+
+}
+
+SUBCOMMAND_DECL(analyze)
+{
+    path dir = getOptions().options_analyze.analyze_dir;
+    if (!fs::exists(dir))
+        throw SW_RUNTIME_ERROR("Build directory does not exist: " + to_string(normalize_path(dir)));
+
+    BuildGraph g;
+    g.load(dir);
+    LOG_INFO(logger, "Loaded " << g.commands.size() << " commands, " << g.includers.size() << " headers");
+
+    // what if queries
+    if (!getOptions().options_analyze.analyze_file.empty())
+    {
+        for (auto &f : getOptions().options_analyze.analyze_file)
+        {
+            auto p = normalize_path(fs::absolute(f));
+            auto h = g.getHeaderInfo(std::hash<path>()(p));
+            LOG_INFO(logger, "If " << to_string(p) << " changed, rebuild cost is " << seconds(h.cost) << " s ("
+                << h.tus << " TUs, " << h.links << " links)");
+        }
+        return;
+    }
+
+    auto headers = g.getHeaders();
+
+    LOG_INFO(logger, "");
+    LOG_INFO(logger, "Headers by rebuild cost:");
+    for (int i = 0; auto &h : headers)
+    {
+        if (i++ == getOptions().options_analyze.top)
+            break;
+        LOG_INFO(logger, print(g, h));
+    }
+
+    auto rebuild_files = g.rebuilds.getFiles();
+    if (g.rebuilds.events)
+    {
+        LOG_INFO(logger, "");
+        LOG_INFO(logger, "Top reasons for rebuild (" << g.rebuilds.commands.size() << " commands in "
+            << g.rebuilds.builds << " builds):");
+        for (auto &[c, n] : g.rebuilds.causes)
+            LOG_INFO(logger, std::format("{:>10} commands   {}", n, sw::toString(c)));
+        LOG_INFO(logger, "");
+        for (int i = 0; auto &[k, n] : rebuild_files)
+        {
+            if (i++ == getOptions().options_analyze.top)
+                break;
+            LOG_INFO(logger, std::format("{:>10} commands   {}: {}", n, sw::toString(k.second), g.getFileName(k.first)));
+        }
+    }
+
+    if (!getOptions().options_analyze.json.empty())
+    {
+        nlohmann::json j;
+        for (auto &h : headers)
+        {
+            nlohmann::json jh;
+            jh["file"] = g.getFileName(h.id);
+            jh["tus"] = h.tus;
+            jh["links"] = h.links;
+            jh["tu_cost"] = h.tu_cost / 1000.0;
+            jh["rebuild_cost"] = h.cost / 1000.0;
+            jh["changes"] = h.changes;
+            // expected cost spent on this header during observed history
+            jh["total_cost"] = h.cost * h.changes / 1000.0;
+            j["headers"].push_back(jh);
+        }
+        j["commands"] = g.commands.size();
+        for (auto &[c, n] : g.rebuilds.causes)
+            j["rebuild_causes"][sw::toString(c)] = n;
+        for (auto &[k, n] : rebuild_files)
+        {
+            nlohmann::json jf;
+            jf["file"] = g.getFileName(k.first);
+            jf["cause"] = sw::toString(k.second);
+            jf["commands"] = n;
+            j["rebuild_files"].push_back(jf);
+        }
+        write_file(getOptions().options_analyze.json, j.dump(4));
+    }
+}
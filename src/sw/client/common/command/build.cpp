@@ -5,6 +5,9 @@
 
 #include <sw/builder/execution_plan.h>
 #include <sw/core/input.h>
+#include <sw/support/filesystem.h>
+
+#include <primitives/executor.h>
 
 #include <primitives/log.h>
 DECLARE_STATIC_LOGGER(logger, "build");
@@ -57,6 +60,8 @@ static void isolated_build(SwClientContext &swctx)
     auto m = getPackages(b, srcs);
     auto d = b.getBuildDirectory() / "isolated";
 
+    auto &e = *swctx.getContext().executor;
+    Futures<void> futures;
     for (const auto &[pkg, tgts] : b.getTargetsToBuild())
     {
         if (tgts.empty())
@@ -65,12 +70,21 @@ static void isolated_build(SwClientContext &swctx)
         auto dir = d / pkg.toString();
         for (auto &[from, to] : m[pkg]->files_map)
         {
-            fs::create_directories((dir / to).parent_path());
-            fs::copy_file(from, dir / to, fs::copy_options::update_existing);
+            futures.push_back(e.push([from = from, to = dir / to]
+            {
+                // update existing
+                error_code ec;
+                if (fs::exists(to) && fs::last_write_time(to, ec) >= fs::last_write_time(from))
+                    return;
+                sw::support::create_directories(to.parent_path());
+                // sources are edited in place, no hardlinks
+                sw::support::copy_file_fast(from, to);
+            }));
         }
 
         ts["driver"]["source-dir-for-package"][pkg.toString()] = to_string(normalize_path(dir));
     }
+    waitAndGet(futures);
 
     LOG_INFO(logger, "Building in isolated environment");
 
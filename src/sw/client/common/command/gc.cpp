@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#include "../commands.h"
+
+#include <sw/builder/command_storage.h>
+#include <sw/builder/sw_context.h>
+
+#include <format>
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "gc");
+
+static String mb(uintmax_t sz)
+{
+    return std::format("{:.2f} MB", sz / 1024.0 / 1024.0);
+}
+
+SUBCOMMAND_DECL(gc)
+{
+    path dir = getOptions().options_gc.gc_dir;
+    if (!fs::exists(dir))
+        throw SW_RUNTIME_ERROR("Build directory does not exist: " + to_string(normalize_path(dir)));
+    uint32_t max_age = getOptions().options_gc.gc_max_age;
+    if (max_age == 0)
+        throw SW_RUNTIME_ERROR("Max age must be positive");
+
+    std::set<path> roots;
+    for (auto &e : fs::recursive_directory_iterator(dir))
+    {
+        if (e.path().filename() != "commands.bin")
+            continue;
+        // root/db/<version>/commands.bin
+        roots.insert(e.path().parent_path().parent_path().parent_path());
+    }
+
+    sw::SwBuilderContext ctx;
+    uintmax_t size = 0, compacted_size = 0;
+    for (auto &root : roots)
+    {
+        // we do not change anything, so storage won't be saved
+        sw::CommandStorage cs(ctx, root);
+        auto st = getOptions().options_gc.gc_stats ? cs.getStats(max_age) : cs.compact(max_age);
+        LOG_INFO(logger, to_string(normalize_path(root)) << ": build " << st.generation);
+        LOG_INFO(logger, std::format("    commands: {} live, {} dead", st.commands - st.dead_commands, st.dead_commands));
+        LOG_INFO(logger, std::format("    files:    {} live, {} dead", st.files - st.dead_files, st.dead_files));
+        if (getOptions().options_gc.gc_stats)
+            LOG_INFO(logger, "    size:     " << mb(st.size));
+        else
+            LOG_INFO(logger, "    size:     " << mb(st.size) << " -> " << mb(st.compacted_size));
+        size += st.size;
+        compacted_size += st.compacted_size;
+    }
+    if (roots.size() > 1 && !getOptions().options_gc.gc_stats)
+        LOG_INFO(logger, "Total: " << mb(size) << " -> " << mb(compacted_size));
+}
@@ -3,6 +3,7 @@
 
 #include "../commands.h"
 
+#include <sw/manager/blob_store.h>
 #include <sw/manager/storage.h>
 
 #include <primitives/pack.h>
@@ -51,6 +52,15 @@ SUBCOMMAND_DECL(pack)
     if (types.empty())
         types.push_back(sw::StorageFileType::SourceArchive);
 
+    auto &o = getOptions().options_pack;
+    std::unique_ptr<sw::BlobStore> store, remote;
+    if (o.content_addressed || !o.pack_remote.empty())
+    {
+        store = std::make_unique<sw::BlobStore>(o.blob_store.empty() ? getContext().getLocalStorage().storage_dir_blb : fs::absolute(o.blob_store));
+        if (!o.pack_remote.empty())
+            remote = std::make_unique<sw::BlobStore>(fs::absolute(o.pack_remote) / "blobs");
+    }
+
     auto b = createBuildAndPrepare({getInputs(), getOptions().input_settings_pairs});
     b->build();
 
@@ -93,7 +103,23 @@ SUBCOMMAND_DECL(pack)
                 LOG_INFO(logger, "Packing " << pkg.toString() << ": " << toString(ty));
                 for (auto &[k, v] : files2)
                     LOG_TRACE(logger, k << ": " << v);
-                pack_files(std::to_string((int)ty) + "-" + sw::support::make_archive_name(pkg.toString()), files2);
+                auto name = std::to_string((int)ty) + "-" + pkg.toString();
+                if (!store)
+                {
+                    pack_files(sw::support::make_archive_name(name), files2);
+                    continue;
+                }
+
+                // new versions add only changed files to stores
+                auto m = sw::PackManifest::create(files2, *store);
+                m.blobs = to_string(normalize_path(store->getRoot()));
+                m.save(name + ".swpack");
+                if (!remote)
+                    continue;
+                auto n = m.push(*store, *remote);
+                m.blobs = to_string(normalize_path(remote->getRoot()));
+                m.save(remote->getRoot().parent_path() / (name + ".swpack"));
+                LOG_INFO(logger, "Uploaded " << pkg.toString() << ": " << n << " new blobs of " << m.files.size() << " files");
             }
         }
     }
@@ -10,6 +10,7 @@ TODO:
 #include "../commands.h"
 
 #include <sw/core/input.h>
+#include <sw/core/run_manifest.h>
 #include <sw/manager/storage.h>
 
 #include <primitives/command.h>
@@ -32,29 +33,15 @@ void run1(const sw::LocalPackage &pkg, primitives::Command &c, bool gRunAppInCon
 }
 #endif
 
-static void run(sw::SwBuild &b, const sw::PackageId &pkg, primitives::Command &c, bool print, bool gRunAppInContainer)
+static void run(sw::SwBuild &b, const sw::PackageId &pkg, const sw::RunManifest &m, primitives::Command &c, bool print, bool gRunAppInContainer)
 {
-    if (b.getTargetsToBuild()[pkg].empty())
-        throw SW_RUNTIME_ERROR("No such target: " + pkg.toString());
-
-    // take the last target
-    auto i = b.getTargetsToBuild()[pkg].end() - 1;
-    auto &s = (*i)->getInterfaceSettings();
-    if (!s["run_command"])
-        throw SW_RUNTIME_ERROR("Target is not runnable: " + pkg.toString());
-    auto &sc = s["run_command"].getMap();
-
-    c.setProgram(sc["program"].getPathValue(b.getContext().getLocalStorage()));
-    if (sc["arguments"])
-    {
-        for (auto &a : sc["arguments"].getArray())
-            c.push_back(a.getValue());
-    }
-    if (sc["environment"])
-    {
-        for (auto &[k, v] : sc["environment"].getMap())
-            c.environment[k] = v.getValue();
-    }
+    c.setProgram(m.program);
+    for (auto &a : m.arguments)
+        c.push_back(a);
+    for (auto &[k, v] : m.environment)
+        c.environment[k] = v;
+    if (c.working_directory.empty() && !m.working_directory.empty())
+        c.working_directory = m.working_directory;
     //if (sc["create_new_console"] && sc["create_new_console"] == "true")
     //c.create_new_console = true;
 
@@ -68,6 +55,16 @@ static void run(sw::SwBuild &b, const sw::PackageId &pkg, primitives::Command &c
     run1(p, c, gRunAppInContainer);
 }
 
+static void run(sw::SwBuild &b, const sw::PackageId &pkg, primitives::Command &c, bool print, bool gRunAppInContainer)
+{
+    if (b.getTargetsToBuild()[pkg].empty())
+        throw SW_RUNTIME_ERROR("No such target: " + pkg.toString());
+
+    // take the last target
+    auto i = b.getTargetsToBuild()[pkg].end() - 1;
+    run(b, pkg, sw::RunManifest::create(b, **i), c, print, gRunAppInContainer);
+}
+
 void SwClientContext::run(const sw::PackageId &pkg, primitives::Command &c)
 {
     getOptions().targets_to_build.push_back(pkg.toString());
@@ -83,6 +80,20 @@ void SwClientContext::run(const sw::PackageId &pkg, primitives::Command &c)
     else
         inputs.push_back(pkg.toString());
 
+    // build and config are unchanged, run saved commands of the program only
+    if (!getOptions().options_run.full_load)
+    {
+        auto b = createBuild(inputs);
+        if (auto m = sw::RunManifest::load(*b, pkg))
+        {
+            LOG_TRACE(logger, "using run manifest of " << pkg.toString());
+            // internal plan, not the one user saved
+            b->runSavedExecutionPlan(m->commands, false);
+            ::run(*b, pkg, *m, c, getOptions().options_run.print_command, getOptions().options_run.run_app_in_container);
+            return;
+        }
+    }
+
     auto b = createBuildAndPrepare(inputs);
     b->build();
 
@@ -2,9 +2,61 @@
 // Copyright (C) 2020 Egor Pugin <egor.pugin@gmail.com>
 
 #include "../commands.h"
+#include "../local_server.h"
 
 #include <sw/builder_distributed/server.h>
 
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "server");
+
+// request gets its own client context and builds,
+// loaded modules, storages and databases of the server context are reused
+// returns nullopt for requests run by client itself
+static std::optional<int> serve_request(SwClientContext &server, const Strings &in_args)
+{
+    // cl options are global, so parse them again for every request
+    Strings args;
+    args.push_back("sw");
+    args.insert(args.end(), in_args.begin(), in_args.end());
+    ::cl::ResetAllOptionOccurrences();
+    String s;
+    llvm::raw_string_ostream errs(s);
+    if (!::cl::ParseCommandLineOptions(args, "", &errs))
+    {
+        errs.flush();
+        LOG_DEBUG(logger, s);
+        return {};
+    }
+
+    Options options(server.getOptions().getClOptions());
+    if (!options.storage_dir.empty() && options.storage_dir != server.getOptions().storage_dir)
+    {
+        LOG_DEBUG(logger, "Server uses different storage dir");
+        return {};
+    }
+
+    SwClientContext swctx(options, server.getContext());
+    if (swctx.getInputs().empty() && options.input_settings_pairs.empty())
+        swctx.getInputs().push_back(".");
+
+    auto &cl = options.getClOptions();
+#define CMD(n)                  \
+    if (cl.subcommand_##n)      \
+    {                           \
+        swctx.command_##n();    \
+        return 0;               \
+    }
+    CMD(build)
+    CMD(configure)
+    CMD(generate)
+    CMD(list)
+    CMD(test)
+#undef CMD
+
+    LOG_DEBUG(logger, "Command is not supported by server");
+    return {};
+}
+
 SUBCOMMAND_DECL(server)
 {
     if (getOptions().options_server.distributed_builder)
@@ -17,5 +69,15 @@ SUBCOMMAND_DECL(server)
         return;
     }
 
+    if (!getOptions().options_server.local_socket.empty())
+    {
+        auto socket = getOptions().options_server.local_socket;
+        serveLocal(socket, [this](const Strings &args)
+        {
+            return serve_request(*this, args);
+        });
+        return;
+    }
+
     SW_UNIMPLEMENTED;
 }
@@ -7,8 +7,12 @@
 #include <sw/manager/storage_remote.h>
 #include <sw/support/source.h>
 #include <nlohmann/json.hpp>
+#include <primitives/executor.h>
 #include <primitives/http.h>
 
+#include <condition_variable>
+#include <mutex>
+
 #include <primitives/log.h>
 DECLARE_STATIC_LOGGER(logger, "service");
 
@@ -19,39 +23,161 @@ DECLARE_STATIC_LOGGER(logger, "service");
 #define F(n, ...) static void n(F_ARGS, ##__VA_ARGS__)
 #endif
 
+namespace {
+
+// "v1_2_3" -> "1.2.3", "20230102" -> "2023.01.02"
+// returns empty string for pre releases and tags without numbers
+String tag_to_version(std::string_view tag) {
+    String ver;
+    bool number_seen = false;
+    for (size_t i = 0; i < tag.size();) {
+        auto c = (unsigned char)tag[i];
+        if (!isdigit(c)) {
+            // skip pre releases
+            if (number_seen && isalpha(c)) {
+                return {};
+            }
+            ++i;
+            continue;
+        }
+        auto b = i;
+        while (i < tag.size() && isdigit((unsigned char)tag[i])) {
+            ++i;
+        }
+        auto n = tag.substr(b, i - b);
+        if (!number_seen && n.size() == 8) {
+            // YYYYMMDD
+            ver.append(n.substr(0, 4)).append(".");
+            ver.append(n.substr(4, 2)).append(".");
+            ver.append(n.substr(6, 2)).append(".");
+        } else {
+            ver.append(n).append(".");
+        }
+        number_seen = true;
+    }
+    if (!ver.empty()) {
+        ver.pop_back();
+    }
+    return ver;
+}
+
+struct tag_ref {
+    std::string_view name; // after refs/tags/
+    sw::Version version;
+};
+
+// single pass over git-upload-pack ref advertisement
+std::vector<tag_ref> parse_tag_refs(std::string_view refs) {
+    constexpr std::string_view tags_prefix = "refs/tags/";
+    std::vector<tag_ref> tags;
+    while (!refs.empty()) {
+        auto e = refs.find('\n');
+        auto line = refs.substr(0, e);
+        refs.remove_prefix(e == refs.npos ? refs.size() : e + 1);
+
+        // first line carries capabilities after \0
+        line = line.substr(0, line.find('\0'));
+        while (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        auto p = line.find(tags_prefix);
+        if (p == line.npos || line.find('^') != line.npos) {
+            continue;
+        }
+        auto name = line.substr(p + tags_prefix.size());
+        auto ver = tag_to_version(name.substr(name.rfind('/') + 1));
+        if (ver.empty()) {
+            continue;
+        }
+        try {
+            tags.push_back({name, sw::Version{ver}});
+        } catch (std::runtime_error &e) {
+            LOG_WARN(logger, "bad version: " << ver << "(tag: '" << name << "'): " << e.what());
+        }
+    }
+    return tags;
+}
+
+// limits number of simultaneous requests to a single host
+struct host_limiter {
+    int limit;
+    std::mutex m;
+    std::condition_variable cv;
+    std::unordered_map<String, int> active;
+
+    struct slot {
+        host_limiter &hl;
+        String host;
+
+        ~slot() {
+            {
+                std::unique_lock lk(hl.m);
+                --hl.active[host];
+            }
+            hl.cv.notify_all();
+        }
+    };
+
+    static String host(const String &url) {
+        auto b = url.find("://");
+        b = b == url.npos ? 0 : b + 3;
+        return url.substr(b, url.find('/', b) - b);
+    }
+
+    slot lock(const String &url) {
+        auto h = host(url);
+        std::unique_lock lk(m);
+        cv.wait(lk, [this, &h] { return active[h] < limit; });
+        ++active[h];
+        return {*this, h};
+    }
+};
+
+} // namespace
+
 void update_packages(SwClientContext &swctx) {
+    struct package {
+        sw::PackageId id;
+        String tag;
+        String url;
+        int prefix;
+    };
     struct data {
+        std::vector<const package *> packages;
         long http_code = 0;
         String response;
+        std::vector<tag_ref> tags;
         //       new version                old version
-        std::map<sw::Version, std::multimap<sw::Version, sw::PackageId>> packages;
+        std::map<sw::Version, std::multimap<sw::Version, const package *>> new_packages;
     };
-    std::map<std::string, data> new_versions;
     auto &s = *swctx.getContext().getRemoteStorages().at(0);
     auto &rs = dynamic_cast<sw::RemoteStorage&>(s);
     auto &pdb = rs.getPackagesDatabase();
+    auto &opts = swctx.getOptions().options_service;
     String prefix = "org.sw.demo.";
-    if (!swctx.getOptions().options_service.args.empty()) {
-        prefix = swctx.getOptions().options_service.args[0];
+    if (!opts.args.empty()) {
+        prefix = opts.args[0];
+    }
+
+    // 1. read everything from db at once and take max versions
+    std::map<sw::PackagePath, sw::PackagesDatabase::PackageVersionSource> latest;
+    for (auto &&r : pdb.getMatchingPackagesSources(prefix)) {
+        auto [i, inserted] = latest.try_emplace(r.id.getPath(), r);
+        if (!inserted && i->second.id.getVersion() < r.id.getVersion()) {
+            i->second = std::move(r);
+        }
     }
-    auto all_pkgs = pdb.getMatchingPackages(prefix);
-    for (int pkgid = 0; auto &&ppath : all_pkgs) {
-        LOG_INFO(logger, "[" << ++pkgid << "/" << all_pkgs.size() << "] " << ppath.toString());
-        auto versions = pdb.getVersionsForPackage(ppath);
-        if (versions.empty() || versions.rbegin()->isBranch()) {
+    std::vector<package> pkgs;
+    pkgs.reserve(latest.size());
+    for (auto &&[ppath, r] : latest) {
+        if (r.id.getVersion().isBranch()) {
             continue;
         }
-        auto &maxver = *versions.rbegin();
-        sw::UnresolvedPackages pkgs;
-        pkgs.insert({ppath,maxver});
-        sw::UnresolvedPackages upkgs;
-        auto &&resolved = pdb.resolve(pkgs, upkgs);
-        auto &&d = pdb.getPackageData(resolved.begin()->second);
-        if (d.source.empty()) {
-            LOG_DEBUG(logger, "empty source: " << resolved.begin()->second.toString());
+        if (r.source.empty()) {
+            LOG_DEBUG(logger, "empty source: " << r.id.toString());
             continue;
         }
-        auto s = sw::source::load(nlohmann::json::parse(d.source));
+        auto s = sw::source::load(nlohmann::json::parse(r.source));
         if (s->getType() != primitives::source::SourceType::Git) {
             continue;
         }
@@ -59,149 +185,95 @@ void update_packages(SwClientContext &swctx) {
         if (git->tag.empty()) {
             continue;
         }
-        auto &source_id = git->url; // d.source has real tag so it is now useful
-        if (new_versions[source_id].http_code == 0) {
+        pkgs.push_back({r.id, git->tag, git->url, r.prefix});
+    }
+    std::map<String, data> new_versions;
+    for (auto &&p : pkgs) {
+        new_versions[p.url].packages.push_back(&p); // d.source has real tag so it is now useful
+    }
+
+    // 2. fetch refs once per source url
+    std::vector<std::pair<String, String>> rewrites;
+    for (auto &&r : opts.url_rewrite) {
+        auto p = r.find('=');
+        if (p == r.npos) {
+            throw SW_RUNTIME_ERROR("bad url rewrite, expected 'from=to': " + r);
+        }
+        rewrites.emplace_back(r.substr(0, p), r.substr(p + 1));
+    }
+    host_limiter hl{std::max(opts.http_jobs_per_host, 1)};
+    std::atomic_int nfetched = 0;
+    Executor e(std::max(opts.http_jobs, 1));
+    Futures<void> fs;
+    for (auto &&[url, d] : new_versions) {
+        fs.push_back(e.push([&, &url = url, &d = d] {
+            auto u = url;
+            for (auto &&[from, to] : rewrites) {
+                if (u.starts_with(from)) {
+                    u = to + u.substr(from.size());
+                    break;
+                }
+            }
             HttpRequest request{httpSettings};
-            request.url = git->url + "/info/refs?service=git-upload-pack";
+            request.url = u + "/info/refs?service=git-upload-pack";
             try {
+                auto l = hl.lock(u);
                 auto resp = url_request(request);
-                new_versions[source_id].http_code = resp.http_code;
-                new_versions[source_id].response = resp.response;
+                d.http_code = resp.http_code;
+                d.response = std::move(resp.response);
             } catch (std::exception &) {
             }
-        }
-        if (new_versions[source_id].http_code != 200) {
-            LOG_WARN(logger, "http " << new_versions[source_id].http_code << ": " << resolved.begin()->second.toString());
-            continue;
-        }
-        for (auto &&line : split_lines(new_versions[source_id].response)) {
-            if (!line.contains("refs/tags/") || line.contains("^")) {
-                continue;
-            }
-            auto ver = line.substr(line.rfind('/') + 1);
-            constexpr auto digits = "0123456789";
-            std::vector<std::string> numbers;
-            while (1) {
-                size_t p = 0;
-                p = ver.find_first_of(digits, p);
-                if (p == -1) {
-                    break;
-                }
-                auto end = ver.find_first_not_of(digits, p);
-                if (end == -1) {
-                    numbers.push_back(ver.substr(p));
-                    break;
-                }
-                numbers.push_back(ver.substr(p, end - p));
-                ver = ver.substr(end);
-                // skip pre releases
-                if (std::ranges::find_if(ver, isalpha) != ver.end()) {
-                    numbers.clear();
-                    break;
-                }
+            if (d.http_code == 200) {
+                d.tags = parse_tag_refs(d.response);
             }
-            if (numbers.empty()) {
+            LOG_INFO(logger, "[" << ++nfetched << "/" << new_versions.size() << "] " << url);
+        }));
+    }
+    waitAndGet(fs);
+
+    // 3. match tags
+    for (auto &&[_, d] : new_versions) {
+        for (auto &&p : d.packages) {
+            if (d.http_code != 200) {
+                LOG_WARN(logger, "http " << d.http_code << ": " << p->id.toString());
                 continue;
             }
-            ver.clear();
-            for (int i = 0; auto &&n : numbers) {
-                if (i == 0 && n.size() == 8) {
-                    // YYYYMMDD
-                    ver += n.substr(0, 4) + ".";
-                    ver += n.substr(4, 2) + ".";
-                    ver += n.substr(6, 2) + ".";
-                } else {
-                    ver += n + ".";
+            auto &maxver = p->id.getVersion();
+            for (auto &&t : d.tags) {
+                auto &v = t.version;
+                if (!(v > maxver && v.isRelease())) {
+                    continue;
                 }
-                ++i;
-            }
-            ver.pop_back();
-            try {
-                sw::Version v{ver};
-                if (v > maxver && v.isRelease()) {
-                    bool ok = false;
-                    {
-                        auto source = d.source;
-                        auto s = sw::source::load(nlohmann::json::parse(source));
-                        auto git = dynamic_cast<primitives::source::Git *>(s.get());
-                        int pos = 0;
-                        for (int i = 0; i < v.getLevel(); ++i) {
-                            auto tofind = std::to_string(maxver[i]);
-                            pos = git->tag.find(tofind, pos);
-                            if (pos == -1) {
-                                LOG_WARN(logger, std::format("cant find {} in {}", tofind, git->tag));
-                                break;
-                            }
-                            git->tag = git->tag.substr(0, pos) + std::to_string(v[i]) + git->tag.substr(pos + tofind.size());
-                            pos += tofind.size();
-                            //LOG_INFO(logger, git->tag);
-                        }
-                        if (line.ends_with("refs/tags/" + git->tag)) {
-                            new_versions[source_id].packages[v].insert({maxver, resolved.begin()->second});
-                            LOG_INFO(logger, "new version: " << resolved.begin()->second.toString() << ": " << v.toString());
-                            ok = true;
-                        }
-                    }
-
-                    if (0 && !ok) {
-                        auto source = d.source;
-                        boost::replace_all(source, maxver.toString(), "{v}");
-                        auto s = sw::source::load(nlohmann::json::parse(source));
-                        auto git = dynamic_cast<primitives::source::Git *>(s.get());
-                        auto apply = [&](auto g) {
-                            g->applyVersion(v);
-                            if (line.ends_with("refs/tags/" + g->tag)) {
-                                new_versions[source_id].packages[v].insert({maxver, resolved.begin()->second});
-                                LOG_INFO(logger, "new version: " << resolved.begin()->second.toString() << ": " << v.toString());
-                                return true;
-                            }
-                            return false;
-                        };
-                        if (!apply(git)) {
-                            // try other tag check {v} -> {M}.{m}{po}
-                            auto source = d.source;
-                            boost::replace_all(source, maxver.toString(), "{v}");
-                            auto s = sw::source::load(nlohmann::json::parse(source));
-                            auto git = dynamic_cast<primitives::source::Git *>(s.get());
-                            boost::replace_all(git->tag, "{v}", "{M}.{m}{po}");
-                            if (apply(git)) {
-                                LOG_INFO(logger, "tag fixed: " << resolved.begin()->second.toString() << ": " << v.toString());
-                            } else {
-                                if (maxver.getPatch() == 0) {
-                                    auto verstring = maxver.toString();
-                                    verstring.resize(verstring.size() - 2); // remove .0
-                                    auto source = d.source;
-                                    boost::replace_all(source, verstring, "{M}.{m}{po}");
-                                    auto s = sw::source::load(nlohmann::json::parse(source));
-                                    auto git = dynamic_cast<primitives::source::Git *>(s.get());
-                                    if (apply(git)) {
-                                        LOG_INFO(logger, "tag fixed: " << resolved.begin()->second.toString() << ": " << v.toString());
-                                    } else {
-                                        LOG_DEBUG(logger, "tag check error: " << resolved.begin()->second.toString() << ": " << v.toString());
-                                    }
-                                } else {
-                                    LOG_DEBUG(logger, "tag check error: " << resolved.begin()->second.toString() << ": " << v.toString());
-                                }
-                            }
-                        }
+                auto tag = p->tag;
+                int pos = 0;
+                for (int i = 0; i < v.getLevel(); ++i) {
+                    auto tofind = std::to_string(maxver[i]);
+                    pos = tag.find(tofind, pos);
+                    if (pos == -1) {
+                        LOG_WARN(logger, std::format("cant find {} in {}", tofind, tag));
+                        break;
                     }
+                    tag = tag.substr(0, pos) + std::to_string(v[i]) + tag.substr(pos + tofind.size());
+                    pos += tofind.size();
+                }
+                if (t.name == tag) {
+                    d.new_packages[v].insert({maxver, p});
+                    LOG_INFO(logger, "new version: " << p->id.toString() << ": " << v.toString());
                 }
-            } catch (std::runtime_error &e) {
-                LOG_WARN(logger, "bad version: " << ver << "(line: '" << line << "'): " << e.what());
             }
         }
     }
+
     LOG_INFO(logger, "\ncommand list\n");
     std::map<sw::PackageId, std::pair<sw::Version, int>> new_pkgs;
     for (auto &&[_,n] : new_versions) {
-        if (n.packages.empty()) {
+        if (n.new_packages.empty()) {
             continue;
         }
-        auto &&p = n.packages.rbegin();
+        auto &&p = n.new_packages.rbegin();
         auto &&v = p->first;
-        auto &&pkg = n.packages.rbegin()->second.rbegin()->second;
-        auto &&d = pdb.getPackageData(pkg);
-        new_pkgs.emplace(pkg, std::pair<sw::Version, int>{v, d.prefix});
+        auto &&pkg = *p->second.rbegin()->second;
+        new_pkgs.emplace(pkg.id, std::pair<sw::Version, int>{v, pkg.prefix});
     }
     // old packages
     const std::set<String> skipped_packages{
@@ -22,6 +22,7 @@ self-upgrade - upgrade the client. implement via upgrade?
 
 SUBCOMMAND(abi) COMMA // rename? move to --option?
 SUBCOMMAND(alias) COMMA
+SUBCOMMAND(analyze) COMMA
 SUBCOMMAND(build) COMMA
 //SUBCOMMAND(b) COMMA // alias for build
 SUBCOMMAND(configure) COMMA
@@ -31,6 +32,7 @@ SUBCOMMAND(generate) COMMA
 // rename to query?
 SUBCOMMAND(get) COMMA // returns different information
 SUBCOMMAND(fetch) COMMA
+SUBCOMMAND(gc) COMMA // command storage statistics and compaction
 SUBCOMMAND(install) COMMA
 //SUBCOMMAND(i) COMMA // alias for install
 SUBCOMMAND(integrate) COMMA
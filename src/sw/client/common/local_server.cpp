@@ -0,0 +1,344 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#include "local_server.h"
+
+#include <primitives/exceptions.h>
+#include <primitives/templates.h>
+
+#include <csignal>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "local_server");
+
+#ifndef _WIN32
+
+extern char **environ;
+
+static Strings get_environment()
+{
+    Strings env;
+    for (auto e = environ; *e; e++)
+        env.push_back(*e);
+    return env;
+}
+
+static void set_environment(const Strings &env)
+{
+    for (auto &v : get_environment())
+        ::unsetenv(v.substr(0, v.find('=')).c_str());
+    for (auto &v : env)
+    {
+        auto p = v.find('=');
+        if (p == v.npos || p == 0)
+            continue;
+        ::setenv(v.substr(0, p).c_str(), v.substr(p + 1).c_str(), 1);
+    }
+}
+
+static sockaddr_un make_address(const path &socket)
+{
+    sockaddr_un a{};
+    a.sun_family = AF_UNIX;
+    auto s = socket.string();
+    if (s.size() >= sizeof(a.sun_path))
+        throw SW_RUNTIME_ERROR("Socket path is too long: " + s);
+    memcpy(a.sun_path, s.c_str(), s.size());
+    return a;
+}
+
+// requests run arbitrary build code as server user
+static bool is_same_user(int fd)
+{
+#ifdef __linux__
+    ucred c{};
+    socklen_t len = sizeof(c);
+    if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &c, &len) == -1)
+        return false;
+    return c.uid == ::getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    if (::getpeereid(fd, &uid, &gid) == -1)
+        return false;
+    return uid == ::getuid();
+#endif
+}
+
+static bool write_all(int fd, const void *data, size_t size)
+{
+    auto p = (const char *)data;
+    while (size)
+    {
+        auto r = ::write(fd, p, size);
+        if (r == -1 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        p += r;
+        size -= r;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void *data, size_t size)
+{
+    auto p = (char *)data;
+    while (size)
+    {
+        auto r = ::read(fd, p, size);
+        if (r == -1 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        p += r;
+        size -= r;
+    }
+    return true;
+}
+
+struct Fd
+{
+    int fd = -1;
+
+    Fd(int fd = -1) : fd(fd) {}
+    Fd(const Fd &) = delete;
+    Fd &operator=(const Fd &) = delete;
+    ~Fd() { if (fd != -1) ::close(fd); }
+
+    operator int() const { return fd; }
+};
+
+std::optional<int> runOnLocalServer(const path &socket, const Strings &args)
+{
+    Fd s = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s == -1)
+        throw SW_RUNTIME_ERROR(String("Cannot create socket: ") + strerror(errno));
+    auto a = make_address(socket);
+    if (::connect(s, (sockaddr *)&a, sizeof(a)) == -1)
+    {
+        LOG_DEBUG(logger, "No server on " << socket << ": " << strerror(errno));
+        return {};
+    }
+    // do not give our stdio to a server of another user
+    if (!is_same_user(s))
+    {
+        LOG_WARN(logger, "Server on " << socket << " is run by another user, running locally");
+        return {};
+    }
+
+    // builds depend on PATH, CC, CFLAGS etc.
+    String payload = fs::current_path().string();
+    payload += '\0';
+    payload += std::to_string(args.size());
+    for (auto &a : args)
+    {
+        payload += '\0';
+        payload += a;
+    }
+    for (auto &v : get_environment())
+    {
+        payload += '\0';
+        payload += v;
+    }
+
+    uint32_t size = payload.size();
+    iovec iov{ &size, sizeof(size) };
+    int fds[] = { STDOUT_FILENO, STDERR_FILENO };
+    char control[CMSG_SPACE(sizeof(fds))]{};
+    msghdr m{};
+    m.msg_iov = &iov;
+    m.msg_iovlen = 1;
+    m.msg_control = control;
+    m.msg_controllen = sizeof(control);
+    auto c = CMSG_FIRSTHDR(&m);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(c), fds, sizeof(fds));
+
+    std::cout.flush();
+    std::cerr.flush();
+    if (::sendmsg(s, &m, 0) != sizeof(size) || !write_all(s, payload.data(), payload.size()))
+        throw SW_RUNTIME_ERROR(String("Cannot send request to server: ") + strerror(errno));
+
+    int32_t exit_code;
+    if (!read_all(s, &exit_code, sizeof(exit_code)))
+        throw SW_RUNTIME_ERROR("Server closed connection");
+    if (exit_code == LOCAL_SERVER_NOT_HANDLED)
+    {
+        LOG_DEBUG(logger, "Request is not handled by server, running locally");
+        return {};
+    }
+    return exit_code;
+}
+
+static volatile std::sig_atomic_t stop_requested;
+
+static void process_request(int client, const LocalServerHandler &f)
+{
+    uint32_t size = 0;
+    iovec iov{ &size, sizeof(size) };
+    int fds[2];
+    char control[CMSG_SPACE(sizeof(fds))]{};
+    msghdr m{};
+    m.msg_iov = &iov;
+    m.msg_iovlen = 1;
+    m.msg_control = control;
+    m.msg_controllen = sizeof(control);
+    if (::recvmsg(client, &m, MSG_CMSG_CLOEXEC) != sizeof(size))
+        throw SW_RUNTIME_ERROR("Bad request");
+    auto c = CMSG_FIRSTHDR(&m);
+    if (!c || c->cmsg_type != SCM_RIGHTS || c->cmsg_len != CMSG_LEN(sizeof(fds)))
+        throw SW_RUNTIME_ERROR("Request without output descriptors");
+    memcpy(fds, CMSG_DATA(c), sizeof(fds));
+    Fd out = fds[0], err = fds[1];
+
+    String payload(size, 0);
+    if (!read_all(client, payload.data(), payload.size()))
+        throw SW_RUNTIME_ERROR("Truncated request");
+    Strings parts;
+    for (size_t b = 0, e; b <= payload.size(); b = e + 1)
+    {
+        e = payload.find('\0', b);
+        if (e == payload.npos)
+            e = payload.size();
+        parts.push_back(payload.substr(b, e - b));
+    }
+    if (parts.size() < 2)
+        throw SW_RUNTIME_ERROR("Bad request");
+    path cwd = parts[0];
+    auto nargs = std::stoull(parts[1]);
+    if (nargs > parts.size() - 2)
+        throw SW_RUNTIME_ERROR("Bad request");
+    Strings args(parts.begin() + 2, parts.begin() + 2 + nargs);
+    Strings env(parts.begin() + 2 + nargs, parts.end());
+
+    // process wide state, this is why requests are served one by one
+    auto old_cwd = fs::current_path();
+    auto old_env = get_environment();
+    Fd old_out = ::dup(STDOUT_FILENO), old_err = ::dup(STDERR_FILENO);
+    ::dup2(out, STDOUT_FILENO);
+    ::dup2(err, STDERR_FILENO);
+    int32_t exit_code = 1;
+    {
+        SCOPE_EXIT
+        {
+            std::cout.flush();
+            std::cerr.flush();
+            LOG_FLUSH();
+            ::dup2(old_out, STDOUT_FILENO);
+            ::dup2(old_err, STDERR_FILENO);
+            fs::current_path(old_cwd);
+            set_environment(old_env);
+        };
+        try
+        {
+            fs::current_path(cwd);
+            set_environment(env);
+            auto r = f(args);
+            exit_code = r ? *r : LOCAL_SERVER_NOT_HANDLED;
+        }
+        catch (std::exception &e)
+        {
+            LOG_ERROR(logger, e.what());
+        }
+    }
+    write_all(client, &exit_code, sizeof(exit_code));
+}
+
+void serveLocal(const path &socket, const LocalServerHandler &f)
+{
+    Fd s = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s == -1)
+        throw SW_RUNTIME_ERROR(String("Cannot create socket: ") + strerror(errno));
+    auto a = make_address(socket);
+    if (fs::exists(socket))
+    {
+        // stale socket from a crashed server?
+        Fd t = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (::connect(t, (sockaddr *)&a, sizeof(a)) == 0)
+            throw SW_RUNTIME_ERROR("Server is already running on " + to_string(socket));
+        fs::remove(socket);
+    }
+    // only owner may connect, no window with wider permissions
+    auto old_mask = ::umask(077);
+    auto r = ::bind(s, (sockaddr *)&a, sizeof(a));
+    auto e = errno;
+    ::umask(old_mask);
+    if (r == -1)
+        throw SW_RUNTIME_ERROR(String("Cannot bind socket: ") + strerror(e));
+    SCOPE_EXIT
+    {
+        error_code ec;
+        fs::remove(socket, ec);
+    };
+    if (::chmod(socket.c_str(), 0600) == -1)
+        throw SW_RUNTIME_ERROR(String("Cannot set socket permissions: ") + strerror(errno));
+    if (::listen(s, SOMAXCONN) == -1)
+        throw SW_RUNTIME_ERROR(String("Cannot listen socket: ") + strerror(errno));
+
+    stop_requested = 0;
+    auto old_int = std::signal(SIGINT, [](int) { stop_requested = 1; });
+    auto old_term = std::signal(SIGTERM, [](int) { stop_requested = 1; });
+    // client may go away in the middle of request
+    auto old_pipe = std::signal(SIGPIPE, SIG_IGN);
+    SCOPE_EXIT
+    {
+        std::signal(SIGINT, old_int);
+        std::signal(SIGTERM, old_term);
+        std::signal(SIGPIPE, old_pipe);
+    };
+
+    LOG_INFO(logger, "Listening on " << socket);
+    while (!stop_requested)
+    {
+        pollfd p{};
+        p.fd = s;
+        p.events = POLLIN;
+        if (::poll(&p, 1, 500) <= 0)
+            continue;
+        Fd client = ::accept4(s, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client == -1)
+            continue;
+        if (!is_same_user(client))
+        {
+            LOG_WARN(logger, "Rejected connection from another user");
+            continue;
+        }
+        try
+        {
+            process_request(client, f);
+        }
+        catch (std::exception &e)
+        {
+            LOG_ERROR(logger, "Request failed: " << e.what());
+        }
+    }
+    LOG_INFO(logger, "Stopped");
+}
+
+#else
+
+std::optional<int> runOnLocalServer(const path &socket, const Strings &args)
+{
+    return {};
+}
+
+void serveLocal(const path &socket, const LocalServerHandler &f)
+{
+    // no descriptor passing over unix sockets
+    throw SW_RUNTIME_ERROR("Local server is not supported on this platform");
+}
+
+#endif
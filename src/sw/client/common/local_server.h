@@ -0,0 +1,33 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include <primitives/filesystem.h>
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+
+// Local build server over unix socket.
+//
+// Request: u32 size, then "cwd\0nargs\0arg1\0...\0argN\0VAR1=value\0...".
+// Client stdout and stderr are passed along with the size (SCM_RIGHTS),
+// so the command writes directly into client terminal.
+// Client environment replaces server one for the time of request.
+// Reply: i32 exit code or LOCAL_SERVER_NOT_HANDLED.
+
+// request is not served, client must run it itself
+#define LOCAL_SERVER_NOT_HANDLED INT32_MIN
+
+// returns nullopt when there is no server listening on the socket
+// or the server does not handle such requests
+SW_CLIENT_COMMON_API
+std::optional<int> runOnLocalServer(const path &socket, const Strings &args);
+
+// called for every request with client cwd, environment, stdout and stderr already set
+// returns nullopt for requests that must be run by client
+using LocalServerHandler = std::function<std::optional<int>(const Strings &args)>;
+
+// serves requests one by one until SIGINT or SIGTERM
+void serveLocal(const path &socket, const LocalServerHandler &);
@@ -4,6 +4,7 @@
 #include "main.h"
 
 #include "commands.h"
+#include "local_server.h"
 #include "self_upgrade.h"
 
 #include <sw/builder/jumppad.h>
@@ -139,6 +140,12 @@ int StartupData::run()
         if (!version.empty())
             LOG_TRACE(logger, "version:\n" + version);
         print_command_line(args); // after logger; also for builtin call?
+        if (!getOptions().server_socket.empty())
+        {
+            // warm server skips all startup work
+            if (auto r = runOnLocalServer(getOptions().server_socket, Strings(args.begin() + 1, args.end())))
+                return exit(*r);
+        }
         if (after_create_options && after_create_options(*this))
             return exit(0);
 
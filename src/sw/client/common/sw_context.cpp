@@ -360,6 +360,18 @@ SwClientContext::SwClientContext(const Options &options)
     // but since this is a rare operation, maybe it's fine
     getContext().executor = std::make_unique<Executor>(select_number_of_threads(options.global_jobs));
     //getExecutor(executor.get());
+    if (!options.copy_strategy.empty())
+        sw::support::set_copy_strategy(sw::support::parse_copy_strategy(options.copy_strategy));
+}
+
+SwClientContext::SwClientContext(const Options &options, sw::SwContext &swctx)
+    : local_storage_root_dir(options.storage_dir.empty() ? sw::Settings::get_user_settings().storage_dir : options.storage_dir)
+    , shared_swctx(&swctx)
+    , options(std::make_unique<Options>(options))
+{
+    // process wide, so server requests without the option get the default
+    sw::support::set_copy_strategy(options.copy_strategy.empty()
+        ? sw::support::CopyStrategy::Auto : sw::support::parse_copy_strategy(options.copy_strategy));
 }
 
 SwClientContext::~SwClientContext()
@@ -407,6 +419,9 @@ std::unique_ptr<sw::SwBuild> SwClientContext::createBuildInternal()
     //
     SET_BOOL_OPTION(build_always);
     SET_BOOL_OPTION(use_saved_configs);
+    SET_BOOL_OPTION(memoize_inputs);
+    SET_BOOL_OPTION(speculative_execution);
+    SET_BOOL_OPTION(adaptive_jobs);
     if (!options.options_build.ide_copy_to_dir.empty())
         bs["build_ide_copy_to_dir"] = to_string(normalize_path(options.options_build.ide_copy_to_dir));
     if (!options.options_build.ide_fast_path.empty())
@@ -417,6 +432,7 @@ std::unique_ptr<sw::SwBuild> SwClientContext::createBuildInternal()
     SET_BOOL_OPTION(time_trace);
     SET_BOOL_OPTION(show_output);
     SET_BOOL_OPTION(write_output_to_file);
+    SET_BOOL_OPTION(no_jobserver);
 
     if (!options.options_build.time_limit.empty())
         bs["time_limit"] = options.options_build.time_limit;
@@ -444,6 +460,18 @@ std::unique_ptr<sw::SwBuild> SwClientContext::createBuildInternal()
         bs["build-jobs"] = std::to_string(select_number_of_threads(options.build_jobs));
     if (options.prepare_jobs)
         bs["prepare-jobs"] = std::to_string(select_number_of_threads(options.prepare_jobs));
+    if (options.adaptive_jobs_min)
+        bs["adaptive_jobs_min"] = std::to_string(options.adaptive_jobs_min);
+    if (!options.resource_classes.empty())
+        bs["resource_classes"] = options.resource_classes;
+    if (options.cgroup_memory_max)
+        bs["cgroup_memory_max"] = std::to_string(options.cgroup_memory_max);
+    if (options.cgroup_cpu_weight)
+        bs["cgroup_cpu_weight"] = std::to_string(options.cgroup_cpu_weight);
+    if (!options.scratch_dir.empty())
+        bs["scratch_dir"] = to_string(normalize_path(fs::absolute(options.scratch_dir)));
+    if (options.scratch_dir_size)
+        bs["scratch_dir_size"] = std::to_string(options.scratch_dir_size);
     for (auto &t : options.Dvariables)
     {
         auto p = t.find('=');
@@ -769,6 +797,8 @@ void SwClientContext::initNetwork()
 
 sw::SwContext &SwClientContext::getContext(bool in_allow_network)
 {
+    if (shared_swctx)
+        return *shared_swctx;
     if (!swctx_)
     {
         bool allow_network = in_allow_network && !getOptions().no_network;
@@ -59,6 +59,8 @@ struct SW_CLIENT_COMMON_API SwClientContext
     using Base = sw::SwContext;
 
     SwClientContext(const Options &options);
+    // uses existing context (server mode)
+    SwClientContext(const Options &options, sw::SwContext &);
     virtual ~SwClientContext();
 
     sw::SwContext &getContext(bool allow_network = true);
@@ -102,6 +104,7 @@ private:
     path local_storage_root_dir;
     //std::unique_ptr<Executor> executor;
     std::unique_ptr<sw::SwContext> swctx_;
+    sw::SwContext *shared_swctx = nullptr;
     // we can copy options into unique ptr also
     std::unique_ptr<Options> options;
     std::optional<sw::TargetMap> tm;
@@ -3,12 +3,18 @@
 
 #include "build.h"
 
+#include "build_memo.h"
+#include "build_speculation.h"
 #include "driver.h"
 #include "input.h"
+#include "run_manifest.h"
 #include "sw_context.h"
 
+#include <sw/builder/admission.h>
 #include <sw/builder/execution_plan.h>
+#include <sw/builder/jobserver.h>
 #include <sw/builder/jumppad.h>
+#include <sw/builder/scratch.h>
 #include <sw/manager/storage.h>
 
 #include <boost/current_function.hpp>
@@ -57,14 +63,10 @@ static auto get_base_settings_name()
     return "settings." + std::to_string(get_base_settings_version());
 }
 
-static auto use_json()
-{
-    return true;
-}
-
 static auto get_settings_fn()
 {
-    return get_base_settings_name() + (use_json() ? ".json" : ".bin");
+    // TargetSettings::Binary, json copies are written for humans only
+    return get_base_settings_name() + ".bin";
 }
 
 static auto create_target(const path &sfn, const LocalPackage &pkg, const TargetSettings &s)
@@ -72,14 +74,9 @@ static auto create_target(const path &sfn, const LocalPackage &pkg, const Target
     LOG_TRACE(logger, "loading " << pkg.toString() << ": " << s.getHash() << " from settings file");
 
     auto tgt = std::make_shared<PredefinedTarget>(pkg, s);
-    if (!use_json())
-        tgt->public_ts = loadSettings(sfn);
-    else
-    {
-        TargetSettings its;
-        its.mergeFromString(read_file(sfn));
-        tgt->public_ts = its;
-    }
+    TargetSettings its;
+    its.mergeFromString(read_file(sfn), TargetSettings::Binary);
+    tgt->public_ts = its;
 
     return tgt;
 }
@@ -107,6 +104,31 @@ static auto can_use_saved_configs(const SwBuild &b)
         ;
 }
 
+static auto can_memoize_inputs(const SwBuild &b)
+{
+    auto &s = b.getSettings();
+    return true
+        && s["memoize_inputs"] == "true"
+        && s["master_build"] == "true"
+        // selection works on loaded targets only
+        && !s["target-to-build"]
+        && !s["target-to-exclude"]
+        ;
+}
+
+static auto can_speculate(const SwBuild &b)
+{
+    auto &s = b.getSettings();
+    return true
+        && s["speculative_execution"] == "true"
+        && s["master_build"] == "true"
+        // do not run commands that are not going to be built
+        && !s["target-to-build"]
+        && !s["target-to-exclude"]
+        && s["build_always"] != "true"
+        ;
+}
+
 static std::unordered_map<UnresolvedPackage, PackageId> loadLockFile(const path &fn/*, SwContext &swctx*/)
 {
     auto j = nlohmann::json::parse(read_file(fn));
@@ -344,20 +366,38 @@ void SwBuild::loadInputs()
 {
     CHECK_STATE_AND_CHANGE(BuildState::NotStarted, BuildState::InputsLoaded);
 
+    loadEntryPoints();
+
+    if (can_memoize_inputs(*this))
+    {
+        memo = std::make_unique<InputsMemo>(*this);
+        memo->select();
+    }
+
+    // and load packages
+    for (auto &i : inputs)
+    {
+        if (memo && memo->isSkipped(i))
+            continue;
+        loadInput(i);
+    }
+}
+
+void SwBuild::loadEntryPoints()
+{
     std::set<Input *> iv;
     for (auto &i : inputs)
         iv.insert(&i.getInput().getInput());
     swctx.loadEntryPointsBatch(iv);
+}
 
-    // and load packages
-    for (auto &i : inputs)
+void SwBuild::loadInput(const InputWithSettings &i)
+{
+    auto tgts = i.loadTargets(*this);
+    for (auto &tgt : tgts)
     {
-        auto tgts = i.loadTargets(*this);
-        for (auto &tgt : tgts)
-        {
-            getTargets()[tgt->getPackage()].push_back(tgt);
-            targets[tgt->getPackage()].setInput(i.getInput());
-        }
+        getTargets()[tgt->getPackage()].push_back(tgt);
+        targets[tgt->getPackage()].setInput(i.getInput());
     }
 }
 
@@ -399,6 +439,9 @@ void SwBuild::resolvePackages()
                 // filter out local targets
                 if (u.getPath().isRelative() || u.getPath().is_loc())
                     continue;
+                // filter out targets of inputs skipped by memo
+                if (memo && memo->provides(u))
+                    continue;
 
                 upkgs.push_back(d);
             }
@@ -563,6 +606,7 @@ void SwBuild::loadPackages(const TargetMap &predefined)
         LOG_TRACE(logger, "build id " << this << " " << BOOST_CURRENT_FUNCTION << " round " << r++);
 
         std::map<TargetSettings, std::pair<PackageId, TargetContainer *>> load;
+        std::set<const InputWithSettings *> unskipped;
         for (const auto &[pkg, tgts] : getTargets())
         {
             for (const auto &tgt : tgts)
@@ -590,6 +634,16 @@ void SwBuild::loadPackages(const TargetMap &predefined)
                             throw SW_RUNTIME_ERROR(tgt->getPackage().toString() + ": " + tgt->getSettings().toString() + ": predefined target is not resolved: " + d->getUnresolvedPackage().toString());
                         }
 
+                        // input was skipped by memo, but now it is needed
+                        if (memo)
+                        {
+                            if (auto mi = memo->unskip(d->getUnresolvedPackage()))
+                            {
+                                unskipped.insert(mi);
+                                continue;
+                            }
+                        }
+
                         // package was not resolved
                         throw SW_RUNTIME_ERROR(tgt->getPackage().toString() + ": " + tgt->getSettings().toString() + ": No target resolved: " + d->getUnresolvedPackage().toString());
                     }
@@ -610,6 +664,12 @@ void SwBuild::loadPackages(const TargetMap &predefined)
                 }
             }
         }
+        if (!unskipped.empty())
+        {
+            for (auto i : unskipped)
+                loadInput(*i);
+            continue;
+        }
         if (load.empty())
             break;
         bool loaded = false;
@@ -685,6 +745,8 @@ void SwBuild::loadPackages(const TargetMap &predefined)
 bool SwBuild::prepareStep()
 {
     std::atomic_bool next_pass = false;
+    std::mutex m;
+    std::vector<const ITarget *> prepared;
 
     auto &e = getPrepareExecutor();
     Futures<void> fs;
@@ -692,15 +754,23 @@ bool SwBuild::prepareStep()
     {
         for (const auto &tgt : tgts)
         {
-            fs.push_back(e.push([tgt, &next_pass]
+            fs.push_back(e.push([tgt, &next_pass, &m, &prepared]
             {
                 if (tgt->prepare())
                     next_pass = true;
+                else
+                {
+                    std::unique_lock lk(m);
+                    prepared.push_back(tgt.get());
+                }
             }));
         }
     }
     waitAndGet(fs);
 
+    if (speculation)
+        speculation->submit(prepared);
+
     return next_pass;
 }
 
@@ -708,6 +778,16 @@ void SwBuild::prepare()
 {
     CHECK_STATE_AND_CHANGE(BuildState::PackagesLoaded, BuildState::Prepared);
 
+    if (can_speculate(*this))
+        speculation = std::make_unique<SpeculativeExecution>(*this);
+    if (build_settings["scratch_dir"].isValue())
+    {
+        uintmax_t sz = 0;
+        if (build_settings["scratch_dir_size"].isValue())
+            sz = std::stoull(build_settings["scratch_dir_size"].getValue()) * 1024 * 1024;
+        scratch = std::make_unique<ScratchDirectory>(build_settings["scratch_dir"].getValue(), sz);
+    }
+
     while (prepareStep() && !stopped)
         ;
     if (stopped)
@@ -732,19 +812,18 @@ void SwBuild::prepare()
             auto cfg = tgt->getSettings().getHash();
             auto base = p.getDirObj(cfg);
             auto sfn = base / get_settings_fn();
+            auto sfnjson = base / get_base_settings_name() += ".json";
             auto sfncfg = base / get_base_settings_name() += ".cfg";
             auto sptrfn = base / "settings.hash";
 
-            if (!fs::exists(sfn) || !fs::exists(sptrfn) || read_file(sptrfn) != tgt->getInterfaceSettings().getHash())
+            auto &its = tgt->getInterfaceSettings();
+            auto h = its.getHash();
+            if (!fs::exists(sfn) || !fs::exists(sptrfn) || read_file(sptrfn) != h)
             {
-                if (!use_json())
-                    saveSettings(sfn, tgt->getInterfaceSettings());
-                else
-                {
-                    write_file(sfn, nlohmann::json::parse(tgt->getInterfaceSettings().toString()).dump(2));
-                    write_file(sfncfg, nlohmann::json::parse(tgt->getSettings().toString()).dump(2));
-                }
-                write_file(sptrfn, tgt->getInterfaceSettings().getHash());
+                write_file(sfn, its.toString(TargetSettings::Binary));
+                write_file(sfnjson, nlohmann::json::parse(its.toString()).dump(2));
+                write_file(sfncfg, nlohmann::json::parse(tgt->getSettings().toString()).dump(2));
+                write_file(sptrfn, h);
             }
         }
     }
@@ -754,6 +833,17 @@ void SwBuild::execute() const
 {
     auto p = getExecutionPlan();
     execute(*p);
+
+    if (build_settings["master_build"] != "true")
+        return;
+    try
+    {
+        RunManifest::save(*this, *p);
+    }
+    catch (std::exception &e)
+    {
+        LOG_DEBUG(logger, "cannot save run manifests: " << e.what());
+    }
 }
 
 void SwBuild::execute(ExecutionPlan &p) const
@@ -764,15 +854,27 @@ void SwBuild::execute(ExecutionPlan &p) const
 
     p.build_always |= build_settings["build_always"] == "true";
     p.write_output_to_file |= build_settings["write_output_to_file"] == "true";
+    // nobody reads outputs of main build commands after logging
+    p.stream_outputs |= build_settings["master_build"] == "true";
     if (build_settings["skip_errors"].isValue())
         p.skip_errors = std::stoll(build_settings["skip_errors"].getValue());
     if (build_settings["time_limit"].isValue())
         p.setTimeLimit(parseTimeLimit(build_settings["time_limit"].getValue()));
 
+    p.jobserver = getJobserver();
+    SwapAndRestore sr2(p.admission, getAdmissionController());
+    SwapAndRestore sr3(p.resource_classes, getResourceClasses());
+
     ScopedTime t;
     p.execute(getBuildExecutor());
+    if (admission)
+        admission->stop();
     if (build_settings["measure"] == "true")
+    {
         LOG_DEBUG(logger, BOOST_CURRENT_FUNCTION << " time: " << t.getTimeFloat() << " s.");
+        if (auto s = resource_classes->getStats(); !s.empty())
+            LOG_DEBUG(logger, "commands by kind:\n" << s);
+    }
 
     if (build_settings["time_trace"] == "true")
         p.saveChromeTrace(getBuildDirectory() / "misc" / "time_trace.json");
@@ -799,6 +901,10 @@ void SwBuild::execute(ExecutionPlan &p) const
 
 Commands SwBuild::getCommands() const
 {
+    // commands must not run while plan is created
+    if (speculation)
+        speculation->finish();
+
     // calling this for all targets in any case to set proper command dependencies
     for (const auto &[pkg, tgts] : getTargets())
     {
@@ -806,7 +912,7 @@ Commands SwBuild::getCommands() const
             tgt->getCommands();
     }
 
-    if (targets_to_build.empty())
+    if (targets_to_build.empty() && !(memo && memo->hasSkipped()))
         throw SW_RUNTIME_ERROR("no targets were selected for building");
 
     StringSet in_ttb;
@@ -823,6 +929,33 @@ Commands SwBuild::getCommands() const
 
     decltype(targets_to_build) ttb;
 
+    // interface settings do not change after prepare, so their dependency entries
+    // are resolved once for all traversals below
+    struct ResolvedDependency
+    {
+        PackageId pkg;
+        bool found = false;
+        // null when no target with such settings
+        const ITargetPtr *target = nullptr;
+    };
+    std::unordered_map<const TargetSetting *, ResolvedDependency> resolved_deps;
+    auto resolve_dep = [this, &resolved_deps](const String &k, const TargetSetting &v) -> const ResolvedDependency &
+    {
+        auto i = resolved_deps.find(&v);
+        if (i != resolved_deps.end())
+            return i->second;
+        ResolvedDependency d{ PackageId(k) };
+        auto j = getTargets().find(d.pkg);
+        if (j != getTargets().end())
+        {
+            d.found = true;
+            auto t = j->second.findSuitable(v.getMap());
+            if (t != j->second.end())
+                d.target = &*t;
+        }
+        return resolved_deps.emplace(&v, std::move(d)).first->second;
+    };
+
     // detect all targets to build
     // some static builds won't build deps, because there's no dependent link files
     // (e.g. build static png, zlib won't be built)
@@ -852,7 +985,7 @@ Commands SwBuild::getCommands() const
                 //continue;
 
             std::function<void(const TargetSettings &)> gather_ttb;
-            gather_ttb = [this, &gather_ttb, &ttb](const auto &s) mutable
+            gather_ttb = [this, &gather_ttb, &ttb, &resolve_dep](const auto &s) mutable
             {
                 if (s["header_only"] == "true")
                     return;
@@ -861,34 +994,34 @@ Commands SwBuild::getCommands() const
                     return;
 
                 std::function<void(const TargetSettings &)> process_deps;
-                process_deps = [this, &gather_ttb, &process_deps, &ttb](const auto &s) mutable
+                process_deps = [this, &gather_ttb, &process_deps, &ttb, &resolve_dep](const auto &s) mutable
                 {
-                    auto get_deps = [this, &gather_ttb, &process_deps, &ttb](const auto &in)
+                    auto get_deps = [this, &gather_ttb, &process_deps, &ttb, &resolve_dep](const auto &in)
                     {
                         for (auto &p : in)
                         {
                             // msvc bug
                             auto &k = p.first;
                             auto &v = p.second;
-                            if (swctx.getPredefinedTargets().find(PackageId(k)) != swctx.getPredefinedTargets().end())
+                            auto &d = resolve_dep(k, v);
+                            if (swctx.getPredefinedTargets().find(d.pkg) != swctx.getPredefinedTargets().end())
                                 continue;
-                            auto i = getTargets().find(PackageId(k));
-                            if (i == getTargets().end())
+                            if (!d.found)
                                 throw SW_RUNTIME_ERROR("dep not found: " + k);
-                            auto j = i->second.findSuitable(v.getMap());
-                            if (j == i->second.end())
+                            if (!d.target)
                             {
                                 LOG_TRACE(logger, "dep+settings not found: " + k + ": " + v.getMap().toString());
                                 continue; // probably was loaded config
                                 //throw SW_RUNTIME_ERROR("dep+settings not found: " + k + ": " + v.getMap().toString());
                             }
+                            auto &t = *d.target;
 
-                            auto m = ttb[PackageId(k)].findEqual((*j)->getSettings());
-                            if (m != ttb[PackageId(k)].end())
+                            auto &tt = ttb[d.pkg];
+                            if (tt.findEqual(t->getSettings()) != tt.end())
                                 continue;
-                            ttb[PackageId(k)].push_back(*j);
+                            tt.push_back(t);
 
-                            const auto &s = (*j)->getInterfaceSettings();
+                            const auto &s = t->getInterfaceSettings();
                             gather_ttb(s);
                             process_deps(s);
                         }
@@ -939,8 +1072,10 @@ Commands SwBuild::getCommands() const
 
     // copy output files
     path copy_dir = build_settings["build_ide_copy_to_dir"].isValue() ? build_settings["build_ide_copy_to_dir"].getValue() : "";
+    InputsMemo::CommandOwners owners;
     {
         std::unordered_map<path, path> copy_files;
+        std::unordered_map<path, const ITarget *> copy_owners;
         for (auto &[p, tgts] : ttb)
         {
             for (auto &tgt : tgts)
@@ -976,7 +1111,7 @@ Commands SwBuild::getCommands() const
 
                 PackageIdSet visited_pkgs;
                 std::function<void(const TargetSettings &)> copy_file;
-                copy_file = [this, &copy_dir_current, &copy_files, &copy_file, &visited_pkgs](const TargetSettings &s)
+                copy_file = [this, &copy_dir_current, &copy_files, &copy_owners, &tgt, &copy_file, &visited_pkgs, &resolve_dep](const TargetSettings &s)
                 {
                     if (s["header_only"] == "true")
                         return;
@@ -1007,29 +1142,27 @@ Commands SwBuild::getCommands() const
                         if (copy_files.find(in) != copy_files.end())
                             return;
                         copy_files[in] = o;
+                        copy_owners[in] = tgt.get();
                         fast_path_files.insert(o);
                     }
 
                     std::function<void(const TargetSettings &)> process_deps;
-                    process_deps = [this, &copy_file, &process_deps, &visited_pkgs](const auto &s)
+                    process_deps = [&copy_file, &process_deps, &visited_pkgs, &resolve_dep](const auto &s)
                     {
                         for (auto &p : s["dependencies"]["link"].getMap())
                         {
                             // msvc bug
                             auto &k = p.first;
                             auto &v = p.second;
-                            PackageId pkg(k);
-                            if (visited_pkgs.find(pkg) != visited_pkgs.end())
+                            auto &d = resolve_dep(k, v);
+                            if (!visited_pkgs.insert(d.pkg).second)
                                 continue;
-                            visited_pkgs.insert(pkg);
-                            auto i = getTargets().find(pkg);
-                            if (i == getTargets().end())
+                            if (!d.found)
                                 throw SW_RUNTIME_ERROR("dep not found");
-                            auto j = i->second.findSuitable(v.getMap());
-                            if (j == i->second.end())
+                            if (!d.target)
                                 throw SW_RUNTIME_ERROR("dep+settings not found");
 
-                            const auto &s = (*j)->getInterfaceSettings();
+                            const auto &s = (*d.target)->getInterfaceSettings();
                             copy_file(s);
                             process_deps(s);
                         }
@@ -1054,9 +1187,13 @@ Commands SwBuild::getCommands() const
             copy_cmd->command_storage = &getCommandStorage(getBuildDirectory() / "cs");
             cmds.insert(copy_cmd);
             commands_storage.insert(copy_cmd); // prevents early destruction
+            owners[copy_cmd.get()] = copy_owners[f];
         }
     }
 
+    if (memo)
+        memo->process(cmds, commands_storage, owners);
+
     return cmds;
 }
 
@@ -1207,9 +1344,10 @@ void SwBuild::saveExecutionPlan(const path &in) const
     save_last_ep(in);
 }
 
-void SwBuild::runSavedExecutionPlan(const path &in) const
+void SwBuild::runSavedExecutionPlan(const path &in, bool save_as_last) const
 {
-    save_last_ep(in);
+    if (save_as_last)
+        save_last_ep(in);
 
     auto cmds = ExecutionPlan::load(in, *this);
     decltype(cmds) cmds_filtered;
@@ -1271,6 +1409,74 @@ Executor &SwBuild::getPrepareExecutor() const
     return *getContext().executor;
 }
 
+Jobserver *SwBuild::getJobserver() const
+{
+    if (build_settings["no_jobserver"] == "true" || jobserver_failed)
+        return nullptr;
+    if (jobserver)
+        return jobserver.get();
+
+    // jobserver is optional, builds go on without it (e.g. no fifo support on filesystem)
+    try
+    {
+        // we are run under outer make, take job slots from it
+        jobserver = Jobserver::fromEnvironment();
+        if (!jobserver)
+        {
+            jobserver = Jobserver::create(getBuildExecutor().numberOfThreads(),
+                getContext().getLocalStorage().storage_dir_tmp / "jobserver");
+        }
+    }
+    catch (std::exception &e)
+    {
+        LOG_WARN(logger, "Cannot set up jobserver, continuing without it: " << e.what());
+        jobserver.reset();
+        jobserver_failed = true;
+    }
+    return jobserver.get();
+}
+
+AdmissionController *SwBuild::getAdmissionController() const
+{
+    if (build_settings["adaptive_jobs"] != "true")
+        return nullptr;
+    if (admission)
+        return admission.get();
+
+    AdmissionController::Settings s;
+    s.max = getBuildExecutor().numberOfThreads();
+    if (build_settings["adaptive_jobs_min"].isValue())
+        s.min = std::stoi(build_settings["adaptive_jobs_min"].getValue());
+    admission = std::make_unique<AdmissionController>(s);
+    admission->start();
+    return admission.get();
+}
+
+ResourceClasses *SwBuild::getResourceClasses() const
+{
+    if (resource_classes)
+        return resource_classes.get();
+    if (!(build_settings["resource_classes"].isValue() ||
+        build_settings["cgroup_memory_max"].isValue() || build_settings["cgroup_cpu_weight"].isValue() ||
+        build_settings["measure"] == "true"))
+        return nullptr;
+
+    resource_classes = std::make_unique<ResourceClasses>();
+    if (build_settings["resource_classes"].isValue())
+        resource_classes->parse(build_settings["resource_classes"].getValue());
+    if (build_settings["cgroup_memory_max"].isValue() || build_settings["cgroup_cpu_weight"].isValue())
+    {
+        uint64_t memory_max = 0;
+        int cpu_weight = 0;
+        if (build_settings["cgroup_memory_max"].isValue())
+            memory_max = std::stoull(build_settings["cgroup_memory_max"].getValue()) * 1024 * 1024;
+        if (build_settings["cgroup_cpu_weight"].isValue())
+            cpu_weight = std::stoi(build_settings["cgroup_cpu_weight"].getValue());
+        resource_classes->setupCgroup(memory_max, cpu_weight);
+    }
+    return resource_classes.get();
+}
+
 const TargetSettings &SwBuild::getExternalVariables() const
 {
     return getSettings()["D"].getMap();
@@ -1330,6 +1536,7 @@ void SwBuild::test()
                 //
                 c->name = "test: [" + tgt->getPackage().toString() + "]/[" + tgt->getSettings().getHash() + "]/[" + c->name + "]";
                 c->always = true;
+                c->kind = CommandKind::Test;
                 c->working_directory = wdir;
                 //c.addPathDirectory(BinaryDir / getSettings().getConfig());
                 c->out.file = test_dir / "stdout.txt";
@@ -1352,6 +1559,7 @@ void SwBuild::test()
     auto ep = getExecutionPlan(cmds);
     ep->throw_on_errors = false;
     ep->skip_errors = cmds.size();
+    ep->jobserver = getJobserver();
     ep->execute(getBuildExecutor());
 
     // record time
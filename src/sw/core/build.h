@@ -7,12 +7,20 @@
 
 #include <sw/builder/sw_context.h>
 
+#include <atomic>
+
 namespace sw
 {
 
+struct AdmissionController;
 struct ExecutionPlan;
 struct Input;
 struct InputWithSettings;
+struct InputsMemo;
+struct Jobserver;
+struct ResourceClasses;
+struct ScratchDirectory;
+struct SpeculativeExecution;
 struct SwContext;
 
 enum class BuildState
@@ -54,6 +62,8 @@ struct SW_CORE_API SwBuild : SwBuilderContext
 
     // precise
     void loadInputs();
+    // configs only (built if needed), no packages are loaded
+    void loadEntryPoints();
     void setTargetsToBuild();
     void resolvePackages(); // [1/2] step
     void loadPackages();
@@ -62,6 +72,7 @@ struct SW_CORE_API SwBuild : SwBuilderContext
 
     // stop execution
     void stop();
+    bool isStopped() const { return stopped; }
 
     // tune
     bool prepareStep();
@@ -73,7 +84,8 @@ struct SW_CORE_API SwBuild : SwBuilderContext
     void saveExecutionPlan() const;
     void runSavedExecutionPlan() const;
     void saveExecutionPlan(const path &) const;
-    void runSavedExecutionPlan(const path &) const;
+    // save_as_last - remember in .sw/last_ep.txt for later runs
+    void runSavedExecutionPlan(const path &, bool save_as_last = true) const;
     std::unique_ptr<ExecutionPlan> getExecutionPlan() const;
     String getHash() const;
     path getExecutionPlanPath() const;
@@ -91,6 +103,8 @@ struct SW_CORE_API SwBuild : SwBuilderContext
     const TargetMap &getTargetsToBuild() const { return targets_to_build; }
 
     path getBuildDirectory() const;
+    // intermediate files root, set during prepare
+    ScratchDirectory *getScratchDirectory() const { return scratch.get(); }
 
     const std::vector<InputWithSettings> &getInputs() const;
 
@@ -112,19 +126,34 @@ private:
     mutable Commands commands_storage; // we need some place to keep copy cmds
     std::unique_ptr<Executor> build_executor;
     std::unique_ptr<Executor> prepare_executor;
-    bool stopped = false;
+    mutable std::unique_ptr<Jobserver> jobserver;
+    mutable bool jobserver_failed = false;
+    // shared by speculative and main execution
+    mutable std::unique_ptr<AdmissionController> admission;
+    mutable std::unique_ptr<ResourceClasses> resource_classes;
+    std::atomic_bool stopped = false;
     mutable ExecutionPlan *current_explan = nullptr;
     Files explan_files;
+    std::unique_ptr<InputsMemo> memo;
+    std::unique_ptr<SpeculativeExecution> speculation;
+    std::unique_ptr<ScratchDirectory> scratch;
 
     // other data
     String name;
     mutable FilesSorted fast_path_files;
 
     Commands getCommands() const;
+    void loadInput(const InputWithSettings &);
     void loadPackages(const TargetMap &predefined);
     void resolvePackages(const std::vector<IDependency*> &upkgs); // [2/2] step
     Executor &getBuildExecutor() const;
     Executor &getPrepareExecutor() const;
+    // execution limits, created on first use, nullptr when disabled
+    Jobserver *getJobserver() const;
+    AdmissionController *getAdmissionController() const;
+    ResourceClasses *getResourceClasses() const;
+
+    friend struct SpeculativeExecution;
 };
 
 } // namespace sw
@@ -0,0 +1,404 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#include "build_memo.h"
+
+#include "build.h"
+#include "sw_context.h"
+
+#include <sw/builder/execution_plan.h>
+#include <sw/manager/storage.h>
+#include <sw/support/hash.h>
+
+#include <nlohmann/json.hpp>
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "build.memo");
+
+#define SW_CURRENT_MEMO_VERSION 2
+
+namespace sw
+{
+
+static const auto npos = (size_t)-1;
+
+InputsMemo::InputsMemo(const SwBuild &b)
+    : b(b), dir(b.getBuildDirectory() / "memo")
+{
+}
+
+InputsMemo::~InputsMemo()
+{
+}
+
+path InputsMemo::getSnapshotPath(const String &key) const
+{
+    return dir / (key + ".swb");
+}
+
+size_t InputsMemo::getInputIndex(const InputWithSettings &i) const
+{
+    auto &inputs = b.getInputs();
+    for (size_t k = 0; k < inputs.size(); k++)
+    {
+        if (&inputs[k] == &i)
+            return k;
+    }
+    return npos;
+}
+
+static bool dirs_changed(const std::map<path, int64_t> &dirs)
+{
+    for (auto &[d, t] : dirs)
+    {
+        error_code ec;
+        auto t2 = fs::last_write_time(d, ec);
+        if (ec || t2.time_since_epoch().count() != t)
+        {
+            LOG_TRACE(logger, "dir changed: " << d);
+            return true;
+        }
+    }
+    return false;
+}
+
+void InputsMemo::select()
+{
+    auto &inputs = b.getInputs();
+    ids.assign(inputs.size(), {});
+    keys.assign(inputs.size(), {});
+    skipped.assign(inputs.size(), false);
+    unskipped.assign(inputs.size(), false);
+
+    auto fn = dir / "index.json";
+    if (fs::exists(fn))
+    {
+        try
+        {
+            auto j = nlohmann::json::parse(read_file(fn));
+            if (j["version"] == SW_CURRENT_MEMO_VERSION)
+            {
+                for (auto &[id, v] : j["inputs"].items())
+                {
+                    auto &r = records[id];
+                    r.key = v["key"].get<String>();
+                    r.packages = v["packages"].get<Strings>();
+                    r.dependencies = v["dependencies"].get<Strings>();
+                    for (auto &[d, t] : v["dirs"].items())
+                        r.dirs[fs::u8path(d)] = t.get<int64_t>();
+                }
+            }
+        }
+        catch (std::exception &e)
+        {
+            LOG_DEBUG(logger, "cannot read " << fn << ": " << e.what());
+            records.clear();
+        }
+    }
+
+    // same input with different settings cannot be told apart by its targets
+    std::unordered_map<const Input *, int> n;
+    for (auto &i : inputs)
+        n[&i.getInput().getInput()]++;
+
+    auto bh = b.getSettings().getHash();
+    for (size_t k = 0; k < inputs.size(); k++)
+    {
+        auto &i = inputs[k];
+        auto &in = i.getInput().getInput();
+        auto eh = in.getEntryPointHash();
+        if (n[&in] > 1 || !eh)
+            continue;
+        String id = in.getName();
+        for (auto &s : i.getSettings())
+            id += s.getHash();
+        id += bh;
+        ids[k] = shorten_hash(blake2b_512(id), 16);
+        keys[k] = shorten_hash(blake2b_512(std::to_string(in.getHash()) + std::to_string(eh)), 16);
+    }
+
+    // first build or new inputs: we do not know their dependents
+    for (auto &id : ids)
+    {
+        if (id.empty() || records.find(id) == records.end())
+            return;
+    }
+
+    std::vector<bool> changed(inputs.size());
+    std::unordered_map<String, size_t> pkg_input;
+    for (size_t k = 0; k < inputs.size(); k++)
+    {
+        auto &r = records[ids[k]];
+        changed[k] = r.key != keys[k] || !fs::exists(getSnapshotPath(keys[k])) || dirs_changed(r.dirs);
+        // take packages from old record for changed inputs too
+        for (auto &p : r.packages)
+            pkg_input[p] = k;
+    }
+
+    std::vector<std::set<size_t>> deps(inputs.size()), dependents(inputs.size());
+    for (size_t k = 0; k < inputs.size(); k++)
+    {
+        for (auto &p : records[ids[k]].dependencies)
+        {
+            auto i = pkg_input.find(p);
+            if (i == pkg_input.end() || i->second == k)
+                continue;
+            deps[k].insert(i->second);
+            dependents[i->second].insert(k);
+        }
+    }
+
+    auto propagate = [](std::vector<bool> &v, const std::vector<std::set<size_t>> &edges)
+    {
+        std::vector<size_t> q;
+        for (size_t k = 0; k < v.size(); k++)
+        {
+            if (v[k])
+                q.push_back(k);
+        }
+        while (!q.empty())
+        {
+            auto k = q.back();
+            q.pop_back();
+            for (auto e : edges[k])
+            {
+                if (v[e])
+                    continue;
+                v[e] = true;
+                q.push_back(e);
+            }
+        }
+    };
+
+    // changed inputs and their dependents are prepared again,
+    // dependencies of them are loaded to be available
+    auto needed = changed;
+    propagate(needed, dependents);
+    propagate(needed, deps);
+
+    size_t nskipped = 0;
+    for (size_t k = 0; k < inputs.size(); k++)
+    {
+        skipped[k] = !needed[k];
+        nskipped += skipped[k];
+        if (changed[k])
+            LOG_TRACE(logger, "input changed: " << inputs[k].getInput().getInput().getName());
+    }
+    LOG_DEBUG(logger, "reusing prepared commands of " << nskipped << " out of " << inputs.size() << " inputs");
+}
+
+bool InputsMemo::isSkipped(const InputWithSettings &i) const
+{
+    auto k = getInputIndex(i);
+    return k != npos && k < skipped.size() && skipped[k];
+}
+
+bool InputsMemo::hasSkipped() const
+{
+    return std::find(skipped.begin(), skipped.end(), true) != skipped.end();
+}
+
+size_t InputsMemo::findInput(const UnresolvedPackage &u) const
+{
+    for (size_t k = 0; k < skipped.size(); k++)
+    {
+        if (!skipped[k] && !unskipped[k])
+            continue;
+        auto i = records.find(ids[k]);
+        if (i == records.end())
+            continue;
+        for (auto &p : i->second.packages)
+        {
+            if (u.canBe(PackageId(p)))
+                return k;
+        }
+    }
+    return npos;
+}
+
+bool InputsMemo::provides(const UnresolvedPackage &u) const
+{
+    return findInput(u) != npos;
+}
+
+const InputWithSettings *InputsMemo::unskip(const UnresolvedPackage &u)
+{
+    auto k = findInput(u);
+    if (k == npos)
+        return {};
+    // same input may be requested several times until it is loaded
+    if (skipped[k])
+    {
+        LOG_TRACE(logger, "loading skipped input " << b.getInputs()[k].getInput().getInput().getName() << " for " << u.toString());
+        skipped[k] = false;
+        unskipped[k] = true;
+    }
+    return &b.getInputs()[k];
+}
+
+void InputsMemo::process(Commands &cmds, Commands &keep_alive, const CommandOwners &owners)
+{
+    auto &inputs = b.getInputs();
+
+    // add saved commands, fresh ones win
+    {
+        std::unordered_set<path> outputs;
+        for (auto &c : cmds)
+            outputs.insert(c->outputs.begin(), c->outputs.end());
+        for (size_t k = 0; k < inputs.size(); k++)
+        {
+            if (!skipped[k])
+                continue;
+            for (auto &c : ExecutionPlan::load(getSnapshotPath(keys[k]), b))
+            {
+                if (std::any_of(c->outputs.begin(), c->outputs.end(), [&outputs](auto &o) { return outputs.contains(o); }))
+                    continue;
+                outputs.insert(c->outputs.begin(), c->outputs.end());
+                cmds.insert(c);
+                keep_alive.insert(c);
+            }
+        }
+    }
+
+    // which input produced a target
+    std::unordered_map<const Input *, size_t> input_index;
+    for (size_t k = 0; k < inputs.size(); k++)
+        input_index[&inputs[k].getInput().getInput()] = k;
+    auto get_input = [this, &input_index](const ITarget &t)
+    {
+        auto i = b.getTargets().find(t.getPackage());
+        if (i == b.getTargets().end() || !i->second.hasInput())
+            return npos;
+        auto j = input_index.find(&i->second.getInput().getInput());
+        return j == input_index.end() ? npos : j->second;
+    };
+
+    std::vector<std::vector<const ITarget *>> roots(inputs.size());
+    for (const auto &[pkg, tgts] : b.getTargets())
+    {
+        if (!tgts.hasInput())
+            continue;
+        auto i = input_index.find(&tgts.getInput().getInput());
+        if (i == input_index.end())
+            continue;
+        for (auto &t : tgts)
+            roots[i->second].push_back(t.get());
+    }
+
+    auto build_dir = normalize_path(b.getBuildDirectory());
+    auto storage_dir = normalize_path(b.getContext().getLocalStorage().storage_dir);
+    for (size_t k = 0; k < inputs.size(); k++)
+    {
+        if (keys[k].empty() || skipped[k])
+            continue;
+
+        Record r;
+        r.key = keys[k];
+
+        // input targets and their non input dependencies
+        std::unordered_set<const ITarget *> closure(roots[k].begin(), roots[k].end());
+        std::set<String> deps;
+        auto q = roots[k];
+        while (!q.empty())
+        {
+            auto t = q.back();
+            q.pop_back();
+            for (auto &d : t->getDependencies())
+            {
+                if (!d->isResolved())
+                    continue;
+                auto &dt = d->getTarget();
+                if (auto j = get_input(dt); j != npos)
+                {
+                    if (j != k)
+                        deps.insert(dt.getPackage().toString());
+                    continue;
+                }
+                if (closure.insert(&dt).second)
+                    q.push_back(&dt);
+            }
+        }
+        r.dependencies.assign(deps.begin(), deps.end());
+
+        std::set<String> pkgs;
+        for (auto t : roots[k])
+            pkgs.insert(t->getPackage().toString());
+        r.packages.assign(pkgs.begin(), pkgs.end());
+
+        Commands icmds;
+        for (auto t : closure)
+        {
+            for (auto &c : t->getCommands())
+            {
+                if (cmds.contains(c))
+                    icmds.insert(c);
+            }
+        }
+        for (auto &c : cmds)
+        {
+            auto i = owners.find(c.get());
+            if (i != owners.end() && closure.contains(i->second))
+                icmds.insert(c);
+        }
+
+        for (auto &c : icmds)
+        {
+            for (auto &f : c->inputs)
+            {
+                auto d = normalize_path(f.parent_path());
+                if (d.empty() || is_under_root_by_prefix_path(d, build_dir) || is_under_root_by_prefix_path(d, storage_dir))
+                    continue;
+                if (r.dirs.contains(d))
+                    continue;
+                error_code ec;
+                auto t = fs::last_write_time(d, ec);
+                if (!ec)
+                    r.dirs[d] = t.time_since_epoch().count();
+            }
+        }
+
+        ExecutionPlan::save(getSnapshotPath(keys[k]), icmds);
+        records[ids[k]] = r;
+    }
+
+    save();
+}
+
+void InputsMemo::save() const
+{
+    nlohmann::json j;
+    j["version"] = SW_CURRENT_MEMO_VERSION;
+    auto &ji = j["inputs"];
+    std::set<path> snapshots;
+    for (auto &id : ids)
+    {
+        if (id.empty())
+            continue;
+        auto i = records.find(id);
+        if (i == records.end())
+            continue;
+        auto &r = i->second;
+        auto &v = ji[id];
+        v["key"] = r.key;
+        v["packages"] = r.packages;
+        v["dependencies"] = r.dependencies;
+        v["dirs"] = nlohmann::json::object();
+        for (auto &[d, t] : r.dirs)
+            v["dirs"][to_string(d)] = t;
+        snapshots.insert(getSnapshotPath(r.key).filename());
+    }
+    fs::create_directories(dir);
+    write_file(dir / "index.json", j.dump(2));
+
+    // drop snapshots of old keys
+    for (auto &e : fs::directory_iterator(dir))
+    {
+        if (e.path().extension() == ".swb" && !snapshots.contains(e.path().filename()))
+        {
+            error_code ec;
+            fs::remove(e.path(), ec);
+        }
+    }
+}
+
+} // namespace sw
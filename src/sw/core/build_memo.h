@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include "input.h"
+
+#include <sw/builder/command.h>
+
+namespace sw
+{
+
+struct SwBuild;
+
+// Per input memoization of prepared commands.
+//
+// After prepare, commands of every build input (its targets and their non input dependencies)
+// are saved to build_dir/memo. Key is input files, config module, input and build settings.
+// On the next build inputs with the same key that do not depend on changed inputs
+// are not loaded and prepared at all, their saved commands are executed instead.
+//
+// Parent dirs of command inputs are checked by mtime, so added or removed source files
+// invalidate the input too.
+struct InputsMemo
+{
+    // targets of commands created by the build itself (copy commands)
+    using CommandOwners = std::unordered_map<builder::Command *, const ITarget *>;
+
+    InputsMemo(const SwBuild &);
+    ~InputsMemo();
+
+    // decides which inputs are not loaded
+    void select();
+    bool isSkipped(const InputWithSettings &) const;
+    bool hasSkipped() const;
+    // package is provided by skipped input
+    bool provides(const UnresolvedPackage &) const;
+    // returns skipped input providing the package, it must be loaded after all
+    // (new dependency of changed input)
+    const InputWithSettings *unskip(const UnresolvedPackage &);
+
+    // adds saved commands of skipped inputs to cmds and keep_alive,
+    // saves commands of loaded inputs
+    void process(Commands &cmds, Commands &keep_alive, const CommandOwners &);
+
+private:
+    struct Record
+    {
+        String key;
+        Strings packages;
+        Strings dependencies;
+        // dir -> mtime
+        std::map<path, int64_t> dirs;
+    };
+
+    const SwBuild &b;
+    path dir;
+    // per input
+    Strings ids;
+    Strings keys;
+    std::vector<bool> skipped;
+    std::vector<bool> unskipped;
+    // id -> record
+    std::map<String, Record> records;
+
+    size_t getInputIndex(const InputWithSettings &) const;
+    size_t findInput(const UnresolvedPackage &) const;
+    path getSnapshotPath(const String &key) const;
+    void save() const;
+};
+
+} // namespace sw
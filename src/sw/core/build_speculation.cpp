@@ -0,0 +1,177 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#include "build_speculation.h"
+
+#include "build.h"
+#include "sw_context.h"
+
+#include <sw/builder/file.h>
+#include <sw/builder/jobserver.h>
+#include <sw/manager/storage.h>
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "build.speculation");
+
+namespace sw
+{
+
+SpeculativeExecution::SpeculativeExecution(const SwBuild &b)
+    : b(b)
+    , build_dir(normalize_path(b.getBuildDirectory()))
+    , storage_dir(normalize_path(b.getContext().getLocalStorage().storage_dir_pkg))
+{
+    executor = std::make_unique<Executor>("speculative execution", b.getBuildExecutor().numberOfThreads());
+}
+
+SpeculativeExecution::~SpeculativeExecution()
+{
+    cancel();
+}
+
+bool SpeculativeExecution::isReady(const ITarget &t) const
+{
+    // all dependencies must be prepared, commands of target may take their generated commands
+    std::unordered_set<const ITarget *> visited{ &t };
+    std::vector<const ITarget *> q{ &t };
+    while (!q.empty())
+    {
+        auto t = q.back();
+        q.pop_back();
+        if (!prepared.contains(t))
+            return false;
+        for (auto &d : t->getDependencies())
+        {
+            if (!d->isResolved())
+                return false;
+            if (visited.insert(&d->getTarget()).second)
+                q.push_back(&d->getTarget());
+        }
+    }
+    return true;
+}
+
+bool SpeculativeExecution::canStart(const builder::Command &c) const
+{
+    if (c.always || c.prev || c.next || !c.dependencies.empty() || c.isExecuted())
+        return false;
+    if (c.as<const builder::BuiltinCommand *>() || c.as<const builder::CommandSequence *>())
+        return false;
+    if (c.inputs.empty() || c.outputs.empty())
+        return false;
+
+    // source files only: generators of other files may not be known yet
+    auto is_source = [this, &c](const path &p)
+    {
+        auto n = normalize_path(p);
+        if (is_under_root_by_prefix_path(n, build_dir))
+            return false;
+        // package build dirs
+        if (is_under_root_by_prefix_path(n, storage_dir) && to_string(n).find("/obj/") != String::npos)
+            return false;
+        if (File(p, c.getContext().getFileStorage()).isGeneratedAtAll())
+            return false;
+        error_code ec;
+        return fs::exists(p, ec);
+    };
+    if (!is_source(c.getProgram()))
+        return false;
+    return std::all_of(c.inputs.begin(), c.inputs.end(), is_source);
+}
+
+void SpeculativeExecution::submit(const std::vector<const ITarget *> &tgts)
+{
+    if (finished)
+        return;
+    prepared.insert(tgts.begin(), tgts.end());
+
+    auto write_output_to_file = b.getSettings()["write_output_to_file"] == "true";
+    size_t n = 0;
+    for (auto t : prepared)
+    {
+        if (submitted.contains(t) || !isReady(*t))
+            continue;
+        submitted.insert(t);
+
+        for (auto &c : t->getCommands())
+        {
+            if (!canStart(*c))
+                continue;
+
+            c->current_command = &current_command;
+            c->total_commands = &total_commands;
+            c->write_output_to_file |= write_output_to_file;
+            c->stream_output = true;
+            // same limits as for the plan, prepare uses cpu too
+            if (!c->jobserver)
+                c->jobserver = b.getJobserver();
+            if (!c->admission)
+                c->admission = b.getAdmissionController();
+            if (!c->resource_classes)
+                c->resource_classes = b.getResourceClasses();
+
+            auto j = std::make_shared<Job>();
+            j->c = c;
+            jobs.push_back(j);
+            total_commands++;
+            n++;
+            fs.push_back(executor->push([j]
+            {
+                int s = Queued;
+                if (!j->state.compare_exchange_strong(s, Running))
+                    return;
+                try
+                {
+                    j->c->execute();
+                    j->state = Done;
+                }
+                catch (std::exception &e)
+                {
+                    // plan will run it again and report the error
+                    LOG_TRACE(logger, "speculative command failed: " << j->c->getName() << ": " << e.what());
+                    j->state = Failed;
+                }
+            }));
+        }
+    }
+    if (n)
+        LOG_TRACE(logger, "started " << n << " commands speculatively");
+}
+
+void SpeculativeExecution::cancel()
+{
+    finished = true;
+    for (auto &j : jobs)
+    {
+        int s = Queued;
+        j->state.compare_exchange_strong(s, Cancelled);
+    }
+    for (auto &f : fs)
+        f.wait();
+    fs.clear();
+}
+
+void SpeculativeExecution::finish()
+{
+    if (finished)
+        return;
+    cancel();
+
+    // plan checks all commands again, so unchanged ones are just up to date,
+    // changed and failed ones are run as usual
+    size_t done = 0, discarded = 0;
+    for (auto &j : jobs)
+    {
+        if (j->state != Done && j->state != Failed)
+            continue;
+        if (j->state == Done && !j->c->isChangedAfterPrepare())
+            done++;
+        else
+            discarded++;
+        j->c->resetExecution();
+    }
+    LOG_DEBUG(logger, "speculatively executed " << done << " out of " << jobs.size() << " commands, " << discarded << " discarded");
+    jobs.clear();
+}
+
+} // namespace sw
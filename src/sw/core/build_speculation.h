@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include "target.h"
+
+#include <sw/builder/command.h>
+
+#include <primitives/executor.h>
+
+namespace sw
+{
+
+struct SwBuild;
+
+// Speculative execution of commands during prepare.
+//
+// When a target and all its dependencies are prepared, its commands that read only
+// existing source files are started on a separate executor while other targets are still preparing.
+// Before the execution plan is created, not started commands are cancelled and running ones are waited for.
+// Executed commands are reset and checked by the plan again: unchanged ones are up to date there,
+// changed by later passes (different hash) or failed ones are run as usual.
+struct SpeculativeExecution
+{
+    SpeculativeExecution(const SwBuild &);
+    ~SpeculativeExecution();
+
+    // call after every prepare pass with targets that finished preparing
+    void submit(const std::vector<const ITarget *> &prepared);
+    void finish();
+
+private:
+    enum
+    {
+        Queued,
+        Running,
+        Cancelled,
+        Done,
+        Failed,
+    };
+
+    struct Job
+    {
+        std::shared_ptr<builder::Command> c;
+        std::atomic_int state = Queued;
+    };
+
+    const SwBuild &b;
+    path build_dir;
+    path storage_dir;
+    std::unique_ptr<Executor> executor;
+    std::unordered_set<const ITarget *> prepared;
+    std::unordered_set<const ITarget *> submitted;
+    std::vector<std::shared_ptr<Job>> jobs;
+    std::vector<Future<void>> fs;
+    std::atomic_size_t current_command = 1;
+    std::atomic_size_t total_commands = 0;
+    bool finished = false;
+
+    bool isReady(const ITarget &) const;
+    bool canStart(const builder::Command &) const;
+    void cancel();
+};
+
+} // namespace sw
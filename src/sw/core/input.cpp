@@ -57,6 +57,11 @@ size_t Input::getHash() const
     return getSpecification().getHash(swctx.getInputDatabase());
 }
 
+size_t Input::getEntryPointHash() const
+{
+    return ep ? ep->getHash() : 0;
+}
+
 Specification &Input::getSpecification()
 {
     return *specification;
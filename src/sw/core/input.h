@@ -58,6 +58,8 @@ struct SW_CORE_API Input
 
     String getName() const;
     virtual size_t getHash() const;
+    // 0 when not loaded or unknown
+    size_t getEntryPointHash() const;
 
     void setEntryPoint(EntryPointPtr);
 
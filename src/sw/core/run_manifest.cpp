@@ -0,0 +1,248 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#include "run_manifest.h"
+
+#include "build.h"
+#include "sw_context.h"
+
+#include <sw/builder/execution_plan.h>
+#include <sw/manager/storage.h>
+#include <sw/support/hash.h>
+
+#include <boost/algorithm/string.hpp>
+#include <nlohmann/json.hpp>
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "build.run_manifest");
+
+#define SW_CURRENT_RUN_MANIFEST_VERSION 2
+
+namespace sw
+{
+
+static bool dirs_changed(const nlohmann::json &dirs)
+{
+    for (auto &[d, t] : dirs.items())
+    {
+        error_code ec;
+        auto t2 = fs::last_write_time(fs::u8path(d), ec);
+        if (ec || t2.time_since_epoch().count() != t.get<int64_t>())
+        {
+            LOG_TRACE(logger, "dir changed: " << d);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::optional<path> RunManifest::getDir(const SwBuild &b)
+{
+    // specification hash does not cover files included from configs,
+    // entry point is rebuilt on their changes
+    auto h = b.getHash();
+    for (auto &i : b.getInputs())
+    {
+        auto eh = i.getInput().getInput().getEntryPointHash();
+        if (!eh)
+            return {};
+        h += std::to_string(eh);
+    }
+
+    // same manifest for 'sw build' and 'sw run <target>',
+    // target selection and scheduling do not change commands
+    auto s = b.getSettings();
+    for (auto k : { "target-to-build", "target-to-exclude", "build-jobs", "prepare-jobs", "measure", "verbose" })
+        s.erase(k);
+    return b.getBuildDirectory() / "run" / shorten_hash(blake2b_512(h + s.getHash()), 16);
+}
+
+RunManifest RunManifest::create(const SwBuild &b, const ITarget &t)
+{
+    auto &s = t.getInterfaceSettings();
+    if (!s["run_command"])
+        throw SW_RUNTIME_ERROR("Target is not runnable: " + t.getPackage().toString());
+    auto &sc = s["run_command"].getMap();
+
+    RunManifest m;
+    m.program = sc["program"].getPathValue(b.getContext().getLocalStorage());
+    if (sc["arguments"])
+    {
+        for (auto &a : sc["arguments"].getArray())
+            m.arguments.push_back(a.getValue());
+    }
+    if (sc["environment"])
+    {
+        for (auto &[k, v] : sc["environment"].getMap())
+            m.environment[k] = v.getValue();
+    }
+    if (sc["working_directory"])
+        m.working_directory = sc["working_directory"].getPathValue(b.getContext().getLocalStorage());
+    return m;
+}
+
+void RunManifest::save(const SwBuild &b, const ExecutionPlan &p)
+{
+    std::unordered_map<path, builder::Command *> producers;
+    for (auto &c : p.getCommands())
+    {
+        auto c2 = static_cast<builder::Command *>(c);
+        for (auto &o : c2->outputs)
+            producers[o] = c2;
+    }
+
+    auto dir = getDir(b);
+    if (!dir)
+        return;
+    auto build_dir = normalize_path(b.getBuildDirectory());
+    auto storage_dir = normalize_path(b.getContext().getLocalStorage().storage_dir);
+    for (const auto &[pkg, tgts] : b.getTargetsToBuild())
+    {
+        if (tgts.empty())
+            continue;
+        // same target as 'sw run' takes
+        auto &t = **(tgts.end() - 1);
+        if (!t.getInterfaceSettings()["run_command"])
+            continue;
+        auto m = create(b, t);
+
+        // program, its runtime dependencies (from PATH-like variables) and everything they are built from
+        Commands cmds;
+        std::vector<builder::Command *> q;
+        if (auto i = producers.find(m.program); i != producers.end())
+            q.push_back(i->second);
+        std::unordered_set<path> runtime_dirs;
+        for (auto &[_, v] : m.environment)
+        {
+            Strings dirs;
+#ifdef _WIN32
+            boost::split(dirs, v, boost::is_any_of(";"));
+#else
+            boost::split(dirs, v, boost::is_any_of(":"));
+#endif
+            for (auto &d : dirs)
+            {
+                if (!d.empty())
+                    runtime_dirs.insert(normalize_path(fs::u8path(d)));
+            }
+        }
+        if (!runtime_dirs.empty())
+        {
+            for (auto &[o, c] : producers)
+            {
+                if (runtime_dirs.contains(normalize_path(o.parent_path())))
+                    q.push_back(c);
+            }
+        }
+        while (!q.empty())
+        {
+            auto c = q.back();
+            q.pop_back();
+            if (!cmds.insert(std::static_pointer_cast<builder::Command>(c->shared_from_this())).second)
+                continue;
+            for (auto &d : c->dependencies)
+                q.push_back(static_cast<builder::Command *>(d.get()));
+        }
+
+        // added or removed source files require full load
+        std::map<path, int64_t> dirs;
+        for (auto &c : cmds)
+        {
+            for (auto &f : c->inputs)
+            {
+                auto d = normalize_path(f.parent_path());
+                if (d.empty() || is_under_root_by_prefix_path(d, build_dir) || is_under_root_by_prefix_path(d, storage_dir))
+                    continue;
+                if (dirs.contains(d))
+                    continue;
+                error_code ec;
+                auto t = fs::last_write_time(d, ec);
+                if (!ec)
+                    dirs[d] = t.time_since_epoch().count();
+            }
+        }
+
+        // no-op builds must not rewrite whole closures
+        std::vector<size_t> hashes;
+        for (auto &c : cmds)
+            hashes.push_back(c->getHash());
+        std::sort(hashes.begin(), hashes.end());
+        size_t closure = 0;
+        for (auto h : hashes)
+            hash_combine(closure, h);
+
+        auto fn = *dir / pkg.toString();
+        auto jfn = path(fn) += ".json";
+        m.commands = path(fn) += ".swb";
+        String old;
+        if (fs::exists(jfn))
+            old = read_file(jfn);
+
+        nlohmann::json j;
+        j["version"] = SW_CURRENT_RUN_MANIFEST_VERSION;
+        j["closure"] = std::to_string(closure);
+        j["program"] = to_string(normalize_path(m.program));
+        j["arguments"] = m.arguments;
+        for (auto &[k, v] : m.environment)
+            j["environment"][k] = v;
+        if (!m.working_directory.empty())
+            j["working_directory"] = to_string(normalize_path(m.working_directory));
+        j["commands"] = to_string(normalize_path(m.commands));
+        j["dirs"] = nlohmann::json::object();
+        for (auto &[d, t] : dirs)
+            j["dirs"][to_string(d)] = t;
+        bool same_closure = false;
+        try
+        {
+            same_closure = !old.empty() && nlohmann::json::parse(old)["closure"] == j["closure"] && fs::exists(m.commands);
+        }
+        catch (std::exception &)
+        {
+        }
+        if (!same_closure)
+            ExecutionPlan::save(m.commands, cmds);
+        auto s = j.dump(4);
+        if (same_closure && s == old)
+            continue;
+        write_file(jfn, s);
+        LOG_TRACE(logger, "saved run manifest of " << pkg.toString() << ": " << cmds.size() << " commands");
+    }
+}
+
+std::optional<RunManifest> RunManifest::load(SwBuild &b, const PackageId &pkg)
+{
+    b.loadEntryPoints();
+    auto dir = getDir(b);
+    if (!dir)
+        return {};
+    auto fn = *dir / (pkg.toString() + ".json");
+    if (!fs::exists(fn))
+        return {};
+    try
+    {
+        auto j = nlohmann::json::parse(read_file(fn));
+        if (j["version"] != SW_CURRENT_RUN_MANIFEST_VERSION)
+            return {};
+        RunManifest m;
+        m.program = fs::u8path(j["program"].get<String>());
+        m.arguments = j["arguments"].get<Strings>();
+        if (j.contains("environment"))
+        {
+            for (auto &[k, v] : j["environment"].items())
+                m.environment[k] = v.get<String>();
+        }
+        if (j.contains("working_directory"))
+            m.working_directory = fs::u8path(j["working_directory"].get<String>());
+        m.commands = fs::u8path(j["commands"].get<String>());
+        if (!fs::exists(m.commands) || dirs_changed(j["dirs"]))
+            return {};
+        return m;
+    }
+    catch (std::exception &e)
+    {
+        LOG_DEBUG(logger, "cannot read " << fn << ": " << e.what());
+        return {};
+    }
+}
+
+} // namespace sw
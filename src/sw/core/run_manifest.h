@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include "target.h"
+
+#include <optional>
+
+namespace sw
+{
+
+struct ExecutionPlan;
+struct SwBuild;
+
+// How to run a target without loading its build.
+//
+// After successful main build every built target with run_command saves
+// build_dir/run/<key>/<package>.json (program, arguments, environment, working dir)
+// and <package>.swb with commands that produce the program and its dependencies.
+// Key is input specifications, their loaded configs (entry points) and build settings
+// except target selection and scheduling, so manifests of changed configs
+// (including files they include) are not used. Inputs without entry point hash have no manifests.
+// Files are rewritten only when saved commands are changed.
+// Parent dirs of command inputs are checked by mtime, added or removed source files
+// invalidate the manifest.
+// 'sw run' executes saved commands (only outdated ones are run) and starts the program immediately.
+struct SW_CORE_API RunManifest
+{
+    path program;
+    Strings arguments;
+    std::map<String, String> environment;
+    path working_directory;
+    // saved commands
+    path commands;
+
+    // from run_command of target interface settings
+    static RunManifest create(const SwBuild &, const ITarget &);
+
+    static void save(const SwBuild &, const ExecutionPlan &);
+    // build must have inputs added, their entry points are loaded
+    static std::optional<RunManifest> load(SwBuild &, const PackageId &);
+
+private:
+    static std::optional<path> getDir(const SwBuild &);
+};
+
+} // namespace sw
@@ -10,6 +10,8 @@
 #include <nlohmann/json.hpp>
 #include <pystring.h>
 
+#include <algorithm>
+
 namespace sw
 {
 
@@ -428,6 +430,176 @@ String TargetSettings::getHash() const
     return shorten_hash(std::to_string(getHash1()), 6);
 }
 
+void TargetSettings::cacheHash()
+{
+    cached_hash = getHash1();
+}
+
+// binary form
+//
+//  header: magic, version, u64 hash (getHash1())
+//  map:    count, then (key, flags, value) sorted by key
+//  value:  type (variant index), then string | count + values | map
+//
+// counts and string sizes are varints, hash is little endian.
+// Same rules as json apply: non serializable and empty values are skipped,
+// array elements do not carry flags.
+// The stored hash is computed by std::hash, so the blob is for local use only.
+
+static const char binary_magic[] = "swts";
+static const uint8_t binary_version = 1;
+
+enum : uint8_t
+{
+    binary_flag_not_used_in_hash        = 1 << 0,
+    binary_flag_ignore_in_comparison    = 1 << 1,
+};
+
+static void write_varint(String &s, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        s += (char)(v | 0x80);
+        v >>= 7;
+    }
+    s += (char)v;
+}
+
+static void write_string(String &s, const String &v)
+{
+    write_varint(s, v.size());
+    s += v;
+}
+
+static void check_size(const std::string_view &s, size_t n)
+{
+    if (s.size() < n)
+        throw SW_RUNTIME_ERROR("Truncated binary settings");
+}
+
+static uint8_t read_u8(std::string_view &s)
+{
+    check_size(s, 1);
+    auto v = (uint8_t)s[0];
+    s.remove_prefix(1);
+    return v;
+}
+
+static uint64_t read_varint(std::string_view &s)
+{
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        auto b = read_u8(s);
+        v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return v;
+    }
+    throw SW_RUNTIME_ERROR("Bad varint in binary settings");
+}
+
+static String read_string(std::string_view &s)
+{
+    auto n = read_varint(s);
+    check_size(s, n);
+    String v(s.substr(0, n));
+    s.remove_prefix(n);
+    return v;
+}
+
+void TargetSetting::toBinary(String &s) const
+{
+    s += (char)value.index();
+    switch (value.index())
+    {
+    case 0:
+    case 4:
+        break;
+    case 1:
+        write_string(s, getValue());
+        break;
+    case 2:
+    {
+        auto &a = std::get<Array>(value);
+        write_varint(s, a.size());
+        for (auto &v : a)
+            v.toBinary(s);
+    }
+        break;
+    case 3:
+        std::get<Map>(value).toBinary(s);
+        break;
+    default:
+        SW_UNREACHABLE;
+    }
+}
+
+void TargetSetting::fromBinary(std::string_view &s)
+{
+    switch (read_u8(s))
+    {
+    case 0:
+        break;
+    case 1:
+        value = read_string(s);
+        break;
+    case 2:
+    {
+        auto &a = value.emplace<Array>();
+        auto n = read_varint(s);
+        // every element takes at least one byte
+        check_size(s, n);
+        a.resize(n);
+        for (auto &v : a)
+            v.fromBinary(s);
+    }
+        break;
+    case 3:
+        value.emplace<Map>().fromBinary(s);
+        break;
+    case 4:
+        value = NullType{};
+        break;
+    default:
+        throw SW_RUNTIME_ERROR("Bad value type in binary settings");
+    }
+}
+
+void TargetSettings::toBinary(String &s) const
+{
+    auto skip = [](auto &v) { return !v.serializable() || v.isEmpty(); };
+
+    write_varint(s, std::count_if(settings.begin(), settings.end(), [&skip](auto &p) { return !skip(p.second); }));
+    for (auto &[k, v] : settings)
+    {
+        if (skip(v))
+            continue;
+        write_string(s, k);
+        uint8_t flags = 0;
+        if (!v.used_in_hash)
+            flags |= binary_flag_not_used_in_hash;
+        if (v.ignore_in_comparison)
+            flags |= binary_flag_ignore_in_comparison;
+        s += (char)flags;
+        v.toBinary(s);
+    }
+}
+
+void TargetSettings::fromBinary(std::string_view &s)
+{
+    cached_hash.reset();
+    auto n = read_varint(s);
+    while (n--)
+    {
+        // keys are sorted, so hint is always right
+        auto &v = settings.try_emplace(settings.end(), read_string(s))->second;
+        auto flags = read_u8(s);
+        v.used_in_hash = !(flags & binary_flag_not_used_in_hash);
+        v.ignore_in_comparison = flags & binary_flag_ignore_in_comparison;
+        v.fromBinary(s);
+    }
+}
+
 void TargetSettings::mergeFromString(const String &s, int type)
 {
     switch (type)
@@ -438,6 +610,35 @@ void TargetSettings::mergeFromString(const String &s, int type)
         mergeFromJson(j);
     }
         break;
+    case Binary:
+    {
+        std::string_view v = s;
+        check_size(v, sizeof(binary_magic) - 1 + 1 + 8);
+        if (v.substr(0, sizeof(binary_magic) - 1) != binary_magic)
+            throw SW_RUNTIME_ERROR("Not a binary settings");
+        v.remove_prefix(sizeof(binary_magic) - 1);
+        if (auto ver = read_u8(v); ver != binary_version)
+            throw SW_RUNTIME_ERROR("Unknown binary settings version: " + std::to_string(ver));
+        uint64_t h = 0;
+        for (int i = 0; i < 8; i++)
+            h |= uint64_t(read_u8(v)) << (i * 8);
+
+        // fast path, take stored hash as is
+        if (empty())
+        {
+            fromBinary(v);
+            cached_hash = h;
+        }
+        else
+        {
+            TargetSettings ts;
+            ts.fromBinary(v);
+            mergeAndAssign(ts);
+        }
+        if (!v.empty())
+            throw SW_RUNTIME_ERROR("Trailing data in binary settings");
+    }
+        break;
     default:
         SW_UNIMPLEMENTED;
     }
@@ -449,6 +650,16 @@ String TargetSettings::toString(int type) const
     {
     case Json:
         return toJson().dump();
+    case Binary:
+    {
+        String s(binary_magic, sizeof(binary_magic) - 1);
+        s += (char)binary_version;
+        uint64_t h = getHash1();
+        for (int i = 0; i < 8; i++)
+            s += (char)(h >> (i * 8));
+        toBinary(s);
+        return s;
+    }
     default:
         SW_UNIMPLEMENTED;
     }
@@ -521,6 +732,8 @@ size_t TargetSetting::getHash1() const
 
 size_t TargetSettings::getHash1() const
 {
+    if (cached_hash)
+        return *cached_hash;
     size_t h = 0;
     for (auto &[k, v] : *this)
     {
@@ -537,6 +750,7 @@ size_t TargetSettings::getHash1() const
 
 TargetSetting &TargetSettings::operator[](const TargetSettingKey &k)
 {
+    cached_hash.reset();
     return settings.try_emplace(k, TargetSetting{}).first->second;
 }
 
@@ -655,6 +869,7 @@ void TargetSettings::mergeFromJson(const nlohmann::json &j)
 
 void TargetSettings::erase(const TargetSettingKey &k)
 {
+    cached_hash.reset();
     settings.erase(k);
 }
 
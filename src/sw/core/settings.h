@@ -8,6 +8,7 @@
 
 #include <memory>
 #include <optional>
+#include <string_view>
 #include <variant>
 
 namespace sw
@@ -29,6 +30,9 @@ struct SW_CORE_API TargetSettings
         Json,
         // yml
 
+        // compact form for on-disk caches and ipc, stores hash alongside
+        Binary,
+
         Simple      = KeyValue,
     };
 
@@ -44,14 +48,16 @@ struct SW_CORE_API TargetSettings
     void mergeFromJson(const nlohmann::json &);
 
     String getHash() const;
+    // for settings that are not changed anymore, any non-const access drops it
+    void cacheHash();
     String toString(int type = Json) const;
 
     bool operator==(const TargetSettings &) const;
     bool operator<(const TargetSettings &) const;
     bool isSubsetOf(const TargetSettings &) const;
 
-    auto begin() { return settings.begin(); }
-    auto end() { return settings.end(); }
+    auto begin() { cached_hash.reset(); return settings.begin(); }
+    auto end() { cached_hash.reset(); return settings.end(); }
     auto begin() const { return settings.begin(); }
     auto end() const { return settings.end(); }
 
@@ -59,10 +65,14 @@ struct SW_CORE_API TargetSettings
 
 private:
     std::map<TargetSettingKey, TargetSetting> settings;
+    // set when loaded from binary form or by cacheHash(), reset on any non-const access
+    std::optional<size_t> cached_hash;
 
     //String toStringKeyValue() const;
     nlohmann::json toJson() const;
     size_t getHash1() const;
+    void toBinary(String &) const;
+    void fromBinary(std::string_view &);
 
     friend struct TargetSetting;
 
@@ -194,6 +204,8 @@ private:
 
     nlohmann::json toJson() const;
     size_t getHash1() const;
+    void toBinary(String &) const;
+    void fromBinary(std::string_view &);
     void copy_fields(const TargetSetting &);
 
     friend struct TargetSettings;
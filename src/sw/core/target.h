@@ -314,6 +314,10 @@ struct SW_CORE_API TargetEntryPoint
 
     [[nodiscard]]
     virtual std::vector<ITargetPtr> loadPackages(SwBuild &, const TargetSettings &, const PackageIdSet &allowed_packages, const PackagePath &prefix) const = 0;
+
+    // identifies code producing targets (e.g. config module)
+    // 0 means unknown, such targets are not memoized
+    virtual size_t getHash() const { return 0; }
 };
 
 struct TargetData
@@ -5,9 +5,13 @@
 
 #include "../build.h"
 #include "../command.h"
+#include "../go.h"
+#include "../java.h"
 #include "compiler_helpers.h"
 #include "../target/native.h"
 
+#include <sw/builder/scratch.h>
+#include <sw/core/build.h>
 #include <sw/core/sw_context.h>
 #include <sw/manager/storage.h>
 
@@ -84,6 +88,10 @@ std::shared_ptr<builder::Command> CompilerBaseProgram::prepareCommand(const Targ
     if (prepared)
         return cmd;
     createCommand(t.getMainBuild()); // do some init
+    if (dynamic_cast<Compiler *>(this))
+        cmd->kind = CommandKind::Compile;
+    else if (dynamic_cast<Linker *>(this))
+        cmd->kind = CommandKind::Link;
     prepareCommand1(t);
     prepared = true;
     return cmd;
@@ -207,6 +215,13 @@ static path getOutputFile(const Target &t, const C &c, const path &input)
     auto o = t.BinaryDir.parent_path() / "obj" /
         (SourceFile::getObjectFilename(t, input) += c.getObjectExtension(t.getBuildSettings().TargetOS));
     o = fs::absolute(o);
+    if (auto s = t.getMainBuild().getScratchDirectory())
+    {
+        // objects are usually several times bigger than sources
+        error_code ec;
+        auto sz = fs::file_size(input, ec);
+        o = s->map(o, std::max<uintmax_t>(ec ? 0 : sz * 4, 256 * 1024));
+    }
     return o;
 }
 
@@ -399,8 +414,22 @@ void ClangCompiler::prepareCommand1(const ::sw::Target &t)
         !appleclang, appleclang, getVersion(t.getContext(), file)));
     CPPStandard.skip = true;
 
+    if (PreprocessedInput)
+    {
+        WriteDependencies = false;
+        WriteDependenciesNearOutput = false;
+        ForcedIncludeFiles().clear();
+        cmd->deps_processor = builder::Command::DepsProcessor::Undefined;
+        cmd->deps_file.clear();
+        // clang does not take it from the preprocessed file
+        cmd->push_back("-fdebug-compilation-dir=" + to_string(normalize_path(cmd->working_directory)));
+    }
+
     getCommandLineOptions<ClangOptions>(cmd.get(), *this);
-    addEverything(*this->cmd/*, "-isystem"*/);
+    if (PreprocessedInput)
+        addCompileOptions(*this->cmd);
+    else
+        addEverything(*this->cmd/*, "-isystem"*/);
     getCommandLineOptions<ClangOptions>(cmd.get(), *this, "", true);
 }
 
@@ -610,8 +639,20 @@ void GNUCompiler::prepareCommand1(const Target &t)
         false, false, getVersion(t.getContext(), file)));
     CPPStandard.skip = true;
 
+    if (PreprocessedInput)
+    {
+        // compilation dir is taken from preprocessed file (-fworking-directory)
+        WriteDependenciesNearOutput = false;
+        ForcedIncludeFiles().clear();
+        cmd->deps_processor = builder::Command::DepsProcessor::Undefined;
+        cmd->deps_file.clear();
+    }
+
     getCommandLineOptions<GNUOptions>(cmd.get(), *this);
-    addEverything(*this->cmd/*, "-isystem"*/);
+    if (PreprocessedInput)
+        addCompileOptions(*this->cmd);
+    else
+        addEverything(*this->cmd/*, "-isystem"*/);
     getCommandLineOptions<GNUOptions>(cmd.get(), *this, "", true);
 
     if (t.isReproducibleBuild())
@@ -1178,10 +1219,18 @@ void RustCompiler::setSourceFile(const path &input_file)
 }
 
 SW_DEFINE_PROGRAM_CLONE(GoCompiler)
+SW_CREATE_COMPILER_COMMAND(GoCompiler, driver::GoBuildCommand)
 
 void GoCompiler::prepareCommand1(const Target &t)
 {
     getCommandLineOptions<GoCompilerOptions>(cmd.get(), *this);
+
+    // go cache is safe for concurrent use
+    if (!CacheDir.empty())
+        cmd->environment["GOCACHE"] = to_string(normalize_path(CacheDir));
+    if (!Flags.empty())
+        cmd->environment["GOFLAGS"] = Flags;
+    std::static_pointer_cast<driver::GoBuildCommand>(cmd)->jobs = Jobs;
 }
 
 void GoCompiler::setOutputFile(const path &output_file)
@@ -1214,16 +1263,31 @@ void FortranCompiler::setSourceFile(const path &input_file)
 }
 
 SW_DEFINE_PROGRAM_CLONE(JavaCompiler)
+SW_CREATE_COMPILER_COMMAND(JavaCompiler, driver::JavaCompileCommand)
 
 void JavaCompiler::prepareCommand1(const Target &t)
 {
     getCommandLineOptions<JavaCompilerOptions>(cmd.get(), *this);
 
-    for (auto &f : InputFiles())
-    {
-        auto o = OutputDir() / (f.filename().stem() += ".class");
-        cmd->addOutput(o);
-    }
+    // own output dir goes first, so unchanged classes are visible during incremental compilation
+#ifdef _WIN32
+    static const auto sep = ";";
+#else
+    static const auto sep = ":";
+#endif
+    String cp = to_string(normalize_path(OutputDir()));
+    for (auto &d : ClassPath)
+        cp += sep + to_string(normalize_path(d));
+    cmd->arguments.push_back("-cp");
+    cmd->arguments.push_back(cp);
+
+    // real class files are discovered during execution (nested, anonymous classes),
+    // so we track state and abi files instead
+    auto c = std::static_pointer_cast<driver::JavaCompileCommand>(cmd);
+    c->output_dir = OutputDir();
+    c->sources = InputFiles();
+    c->addOutput(c->getStateFile());
+    c->addOutput(c->getAbiFile());
 }
 
 void JavaCompiler::setOutputDir(const path &output_dir)
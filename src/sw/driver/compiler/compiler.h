@@ -170,6 +170,10 @@ struct SW_DRIVER_CPP_API NativeCompiler : Compiler,
     NativeCompilerOptions//, OptionsGroup<NativeCompilerOptions>
 {
     CompilerType Type = CompilerType::UnspecifiedCompiler;
+    // input is produced by a separate preprocess command,
+    // so definitions, include dirs and deps are not needed here
+    // and command depends only on its input file and the compiler
+    bool PreprocessedInput = false;
 
     using Compiler::Compiler;
     virtual ~NativeCompiler() = default;
@@ -537,6 +541,13 @@ struct SW_DRIVER_CPP_API RustCompiler : Compiler,
 struct SW_DRIVER_CPP_API GoCompiler : Compiler,
     CommandLineOptions<GoCompilerOptions>
 {
+    // GOCACHE, shared between targets and configs
+    path CacheDir;
+    // GOFLAGS
+    String Flags;
+    // go build -p
+    int Jobs = 0;
+
     using Compiler::Compiler;
 
     SW_COMMON_COMPILER_API;
@@ -544,6 +555,9 @@ struct SW_DRIVER_CPP_API GoCompiler : Compiler,
     void setOutputFile(const path &output_file);
     void setSourceFile(const path &input_file);
 
+protected:
+    std::shared_ptr<driver::Command> createCommand1(const SwBuilderContext &swctx) const override;
+
 private:
     //Version gatherVersion() const override { return Program::gatherVersion(file, "version"); }
 };
@@ -566,9 +580,15 @@ struct SW_DRIVER_CPP_API JavaCompiler : Compiler,
 
     SW_COMMON_COMPILER_API;
 
+    // output dirs of dependencies
+    FilesOrdered ClassPath;
+
     void setOutputDir(const path &output_dir);
     void setSourceFile(const path &input_file);
 
+protected:
+    std::shared_ptr<driver::Command> createCommand1(const SwBuilderContext &swctx) const override;
+
 private:
     //Version gatherVersion() const override { return Program::gatherVersion(file, "-version", "(\\d+)\\.(\\d+)\\.(\\d+)(_(\\d+))?"); }
 };
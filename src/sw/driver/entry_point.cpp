@@ -334,6 +334,11 @@ NativeModuleTargetEntryPoint::NativeModuleTargetEntryPoint(const Module &m)
 {
 }
 
+size_t NativeModuleTargetEntryPoint::getHash() const
+{
+    return m.getHash();
+}
+
 void NativeModuleTargetEntryPoint::loadPackages1(Build &b) const
 {
     m.check(b, b.checker);
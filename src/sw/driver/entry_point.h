@@ -51,6 +51,8 @@ struct NativeModuleTargetEntryPoint : NativeTargetEntryPoint
 {
     NativeModuleTargetEntryPoint(const Module &m);
 
+    size_t getHash() const override;
+
 private:
     const Module &m;
 
@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#include "go.h"
+
+#include <sw/builder/jobserver.h>
+
+#include <nlohmann/json.hpp>
+#include <primitives/templates.h>
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "go");
+
+namespace sw::driver
+{
+
+std::shared_ptr<Command> GoBuildCommand::clone() const
+{
+    return std::make_shared<GoBuildCommand>(*this);
+}
+
+void GoBuildCommand::execute1(std::error_code *ec)
+{
+    // go does not use jobserver itself, so we take additional slots for it (one is ours already)
+    // without jobserver jobs are divided among concurrently running go builds
+    static std::atomic_int running;
+    running++;
+    SCOPE_EXIT
+    {
+        running--;
+    };
+    std::vector<Jobserver::Token> tokens;
+    int p = 0;
+    if (jobs > 0)
+    {
+        if (jobserver)
+        {
+            while ((int)tokens.size() < jobs - 1)
+            {
+                auto t = jobserver->tryAcquire();
+                if (!t)
+                    break;
+                tokens.push_back(std::move(*t));
+            }
+            p = tokens.size() + 1;
+        }
+        else
+            p = std::max(1, jobs / running);
+    }
+
+    {
+        // program, build command, then our flags
+        Arguments args;
+        for (size_t i = 0; i < arguments.size(); i++)
+        {
+            args.push_back(arguments[i]->clone());
+            if (i == 1 && p > 0)
+            {
+                args.push_back("-p");
+                args.push_back(std::to_string(p));
+            }
+        }
+        std::swap(args, arguments);
+        SCOPE_EXIT
+        {
+            std::swap(args, arguments);
+        };
+        builder::Command::execute1(ec);
+        if (ec && *ec)
+            return;
+    }
+
+    addImplicitInput(getDependencies());
+}
+
+Files GoBuildCommand::getDependencies() const
+{
+    primitives::Command c;
+    c.setProgram(getProgram());
+    c.working_directory = working_directory;
+    c.environment = environment;
+    c.push_back("list");
+    c.push_back("-deps");
+    c.push_back("-json");
+    for (auto &i : inputs)
+    {
+        if (i.extension() == ".go")
+            c.push_back(normalize_path(i));
+    }
+    std::error_code ec;
+    c.execute(ec);
+    if (ec)
+    {
+        LOG_DEBUG(logger, "go list failed, dependencies won't be tracked: " << getName() << "\n" << c.err.text);
+        return {};
+    }
+
+    // output is a sequence of json objects
+    Files deps;
+    std::istringstream ss(c.out.text);
+    while (ss >> std::ws, !ss.eof())
+    {
+        nlohmann::json j;
+        ss >> j;
+        // std packages are tracked by compiler identity
+        if (j.contains("Standard") && j["Standard"].get<bool>())
+            continue;
+        if (j.contains("Module") && j["Module"].contains("GoMod"))
+            deps.insert(fs::u8path(j["Module"]["GoMod"].get<String>()));
+        if (!j.contains("Dir"))
+            continue;
+        auto dir = fs::u8path(j["Dir"].get<String>());
+        for (auto &k : { "GoFiles", "CgoFiles", "CFiles", "CXXFiles", "HFiles", "SFiles", "EmbedFiles" })
+        {
+            if (!j.contains(k))
+                continue;
+            for (auto &f : j[k])
+                deps.insert(dir / fs::u8path(f.get<String>()));
+        }
+    }
+    return deps;
+}
+
+} // namespace sw::driver
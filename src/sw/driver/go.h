@@ -0,0 +1,27 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include "command.h"
+
+namespace sw::driver
+{
+
+// Runs 'go build' and records package files reported by 'go list -deps'
+// as implicit inputs, so up-to-date checks see changes in dependent packages.
+struct SW_DRIVER_CPP_API GoBuildCommand : Command
+{
+    // upper limit for go build -p, it is set on execution and not a part of command hash
+    int jobs = 0;
+
+    using Command::Command;
+
+    std::shared_ptr<Command> clone() const override;
+
+private:
+    void execute1(std::error_code *ec = nullptr) override;
+    Files getDependencies() const;
+};
+
+} // namespace sw::driver
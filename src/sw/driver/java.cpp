@@ -0,0 +1,716 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#include "java.h"
+
+#include <sw/support/hash.h>
+
+#include <nlohmann/json.hpp>
+#include <primitives/templates.h>
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "java");
+
+namespace sw
+{
+
+namespace java
+{
+
+namespace
+{
+
+enum
+{
+    ACC_PRIVATE = 0x0002,
+};
+
+enum ConstantTag : uint8_t
+{
+    CONSTANT_Utf8 = 1,
+    CONSTANT_Integer = 3,
+    CONSTANT_Float = 4,
+    CONSTANT_Long = 5,
+    CONSTANT_Double = 6,
+    CONSTANT_Class = 7,
+    CONSTANT_String = 8,
+    CONSTANT_Fieldref = 9,
+    CONSTANT_Methodref = 10,
+    CONSTANT_InterfaceMethodref = 11,
+    CONSTANT_NameAndType = 12,
+    CONSTANT_MethodHandle = 15,
+    CONSTANT_MethodType = 16,
+    CONSTANT_Dynamic = 17,
+    CONSTANT_InvokeDynamic = 18,
+    CONSTANT_Module = 19,
+    CONSTANT_Package = 20,
+};
+
+struct Constant
+{
+    uint8_t tag = 0;
+    uint16_t ref1 = 0;
+    uint16_t ref2 = 0;
+    // utf8 or raw value bytes
+    String value;
+};
+
+struct Reader
+{
+    const String &data;
+    size_t pos = 0;
+
+    Reader(const String &data) : data(data) {}
+
+    void need(size_t n) const
+    {
+        if (pos + n > data.size())
+            throw SW_RUNTIME_ERROR("Unexpected end of class file");
+    }
+
+    uint8_t u1()
+    {
+        need(1);
+        return (uint8_t)data[pos++];
+    }
+
+    uint16_t u2()
+    {
+        auto h = u1();
+        return (h << 8) | u1();
+    }
+
+    uint32_t u4()
+    {
+        auto h = u2();
+        return ((uint32_t)h << 16) | u2();
+    }
+
+    String bytes(size_t n)
+    {
+        need(n);
+        auto s = data.substr(pos, n);
+        pos += n;
+        return s;
+    }
+
+    void skip(size_t n)
+    {
+        need(n);
+        pos += n;
+    }
+};
+
+// extract L...; class names from descriptor
+void add_descriptor_references(const String &d, StringSet &refs)
+{
+    for (size_t p = d.find('L'); p != d.npos; p = d.find('L', p))
+    {
+        auto e = d.find(';', p);
+        if (e == d.npos)
+            break;
+        refs.insert(d.substr(p + 1, e - p - 1));
+        p = e;
+    }
+}
+
+} // namespace
+
+ClassFile::ClassFile(const path &fn)
+{
+    auto data = read_file(fn);
+    Reader r(data);
+
+    if (r.u4() != 0xCAFEBABE)
+        throw SW_RUNTIME_ERROR("Bad class file: " + to_string(fn));
+    r.skip(4); // versions
+
+    std::vector<Constant> cp(r.u2());
+    for (size_t i = 1; i < cp.size(); i++)
+    {
+        auto &c = cp[i];
+        c.tag = r.u1();
+        switch (c.tag)
+        {
+        case CONSTANT_Utf8:
+            c.value = r.bytes(r.u2());
+            break;
+        case CONSTANT_Integer:
+        case CONSTANT_Float:
+            c.value = r.bytes(4);
+            break;
+        case CONSTANT_Long:
+        case CONSTANT_Double:
+            c.value = r.bytes(8);
+            i++; // takes two entries
+            break;
+        case CONSTANT_Class:
+        case CONSTANT_String:
+        case CONSTANT_MethodType:
+        case CONSTANT_Module:
+        case CONSTANT_Package:
+            c.ref1 = r.u2();
+            break;
+        case CONSTANT_Fieldref:
+        case CONSTANT_Methodref:
+        case CONSTANT_InterfaceMethodref:
+        case CONSTANT_NameAndType:
+        case CONSTANT_Dynamic:
+        case CONSTANT_InvokeDynamic:
+            c.ref1 = r.u2();
+            c.ref2 = r.u2();
+            break;
+        case CONSTANT_MethodHandle:
+            c.ref1 = r.u1();
+            c.ref2 = r.u2();
+            break;
+        default:
+            throw SW_RUNTIME_ERROR("Unknown constant pool tag " + std::to_string(c.tag) + ": " + to_string(fn));
+        }
+    }
+
+    auto utf8 = [&cp](uint16_t i) -> const String &
+    {
+        if (i == 0 || i >= cp.size() || cp[i].tag != CONSTANT_Utf8)
+            throw SW_RUNTIME_ERROR("Bad utf8 constant reference");
+        return cp[i].value;
+    };
+    auto class_name = [&cp, &utf8](uint16_t i) -> String
+    {
+        if (i == 0)
+            return {};
+        if (i >= cp.size() || cp[i].tag != CONSTANT_Class)
+            throw SW_RUNTIME_ERROR("Bad class constant reference");
+        return utf8(cp[i].ref1);
+    };
+
+    // references
+    for (auto &c : cp)
+    {
+        switch (c.tag)
+        {
+        case CONSTANT_Class:
+        {
+            auto &n = utf8(c.ref1);
+            if (n.starts_with("["))
+                add_descriptor_references(n, references);
+            else
+                references.insert(n);
+            break;
+        }
+        case CONSTANT_NameAndType:
+            add_descriptor_references(utf8(c.ref2), references);
+            break;
+        case CONSTANT_MethodType:
+            add_descriptor_references(utf8(c.ref1), references);
+            break;
+        }
+    }
+
+    String abi, constants;
+    auto access = r.u2();
+    name = class_name(r.u2());
+    auto super = class_name(r.u2());
+    abi += std::to_string(access) + " " + name + " : " + super;
+    for (auto n = r.u2(); n--;)
+        abi += " " + class_name(r.u2());
+    abi += "\n";
+
+    auto read_attributes = [&r, &utf8](auto &&f)
+    {
+        for (auto n = r.u2(); n--;)
+        {
+            auto &aname = utf8(r.u2());
+            auto len = r.u4();
+            auto end = r.pos + len;
+            f(aname);
+            r.pos = end;
+        }
+    };
+
+    auto read_members = [&](bool fields)
+    {
+        for (auto n = r.u2(); n--;)
+        {
+            auto flags = r.u2();
+            auto &mname = utf8(r.u2());
+            auto &desc = utf8(r.u2());
+            add_descriptor_references(desc, references);
+            bool visible = !(flags & ACC_PRIVATE);
+            if (visible)
+                abi += (fields ? "f " : "m ") + std::to_string(flags) + " " + mname + " " + desc + "\n";
+            read_attributes([&](const String &aname)
+            {
+                if (!fields || aname != "ConstantValue")
+                    return;
+                auto &c = cp.at(r.u2());
+                auto v = c.tag == CONSTANT_String ? utf8(c.ref1) : c.value;
+                constants += mname + "=" + v + "\n";
+                if (visible)
+                    abi += "= " + v + "\n";
+            });
+        }
+    };
+    read_members(true);
+    read_members(false);
+
+    read_attributes([&](const String &aname)
+    {
+        if (aname == "SourceFile")
+            source_file = utf8(r.u2());
+    });
+
+    references.erase(name);
+    abi_hash = shorten_hash(blake2b_512(abi), 16);
+    constants_hash = constants.empty() ? String{} : shorten_hash(blake2b_512(constants), 16);
+}
+
+String ClassFile::getPackage() const
+{
+    auto p = name.rfind('/');
+    if (p == name.npos)
+        return {};
+    return name.substr(0, p);
+}
+
+} // namespace java
+
+namespace driver
+{
+
+namespace
+{
+
+struct ClassState
+{
+    path file;
+    String abi;
+    String constants;
+    StringSet references;
+};
+
+struct SourceState
+{
+    String hash;
+    StringSet classes;
+};
+
+struct DependencyState
+{
+    String abi;
+    String constants;
+};
+
+struct JavaState
+{
+    String options;
+    std::map<path, SourceState> sources;
+    std::map<String, ClassState> classes;
+    // by abi file
+    std::map<path, DependencyState> dependencies;
+
+    void load(const path &fn)
+    {
+        if (!fs::exists(fn))
+            return;
+        try
+        {
+            auto j = nlohmann::json::parse(read_file(fn));
+            options = j["options"].get<String>();
+            for (auto &[k, v] : j["sources"].items())
+            {
+                auto &s = sources[fs::u8path(k)];
+                s.hash = v["hash"].get<String>();
+                for (auto &c : v["classes"])
+                    s.classes.insert(c.get<String>());
+            }
+            for (auto &[k, v] : j["classes"].items())
+            {
+                auto &c = classes[k];
+                c.file = fs::u8path(v["file"].get<String>());
+                c.abi = v["abi"].get<String>();
+                c.constants = v["constants"].get<String>();
+                for (auto &r : v["references"])
+                    c.references.insert(r.get<String>());
+            }
+            for (auto &[k, v] : j["dependencies"].items())
+            {
+                auto &d = dependencies[fs::u8path(k)];
+                d.abi = v["abi"].get<String>();
+                d.constants = v["constants"].get<String>();
+            }
+        }
+        catch (std::exception &e)
+        {
+            LOG_DEBUG(logger, "Bad java state file " << to_string(fn) << ": " << e.what());
+            *this = {};
+        }
+    }
+
+    void save(const path &fn) const
+    {
+        nlohmann::json j;
+        j["options"] = options;
+        for (auto &[k, s] : sources)
+        {
+            auto &v = j["sources"][to_string(normalize_path(k))];
+            v["hash"] = s.hash;
+            v["classes"] = s.classes;
+        }
+        for (auto &[k, c] : classes)
+        {
+            auto &v = j["classes"][k];
+            v["file"] = to_string(normalize_path(c.file));
+            v["abi"] = c.abi;
+            v["constants"] = c.constants;
+            v["references"] = c.references;
+        }
+        j["dependencies"] = nlohmann::json::object();
+        for (auto &[k, d] : dependencies)
+        {
+            auto &v = j["dependencies"][to_string(normalize_path(k))];
+            v["abi"] = d.abi;
+            v["constants"] = d.constants;
+        }
+        write_file(fn, j.dump());
+    }
+
+    String getAbiHash() const
+    {
+        String s;
+        for (auto &[k, c] : classes)
+            s += k + " " + c.abi + "\n";
+        return shorten_hash(blake2b_512(s), 32);
+    }
+
+    String getConstantsHash() const
+    {
+        String s;
+        for (auto &[k, c] : classes)
+        {
+            if (!c.constants.empty())
+                s += k + " " + c.constants + "\n";
+        }
+        return s.empty() ? String{} : shorten_hash(blake2b_512(s), 32);
+    }
+
+    void removeClasses(const path &src)
+    {
+        auto i = sources.find(src);
+        if (i == sources.end())
+            return;
+        for (auto &n : i->second.classes)
+        {
+            auto c = classes.find(n);
+            if (c == classes.end())
+                continue;
+            error_code ec;
+            fs::remove(c->second.file, ec);
+            classes.erase(c);
+        }
+        i->second.classes.clear();
+    }
+};
+
+} // namespace
+
+std::shared_ptr<Command> JavaCompileCommand::clone() const
+{
+    return std::make_shared<JavaCompileCommand>(*this);
+}
+
+path JavaCompileCommand::getStateFile() const
+{
+    return getStateFile(output_dir);
+}
+
+path JavaCompileCommand::getStateFile(const path &output_dir)
+{
+    return path(output_dir) += ".state.json";
+}
+
+path JavaCompileCommand::getAbiFile() const
+{
+    return getAbiFile(output_dir);
+}
+
+path JavaCompileCommand::getAbiFile(const path &output_dir)
+{
+    return path(output_dir) += ".abi";
+}
+
+void JavaCompileCommand::execute1(std::error_code *ec)
+{
+    std::set<String> source_args;
+    for (auto &s : sources)
+        source_args.insert(to_string(normalize_path(s)));
+
+    // options are everything except source files
+    Arguments options_args;
+    String options;
+    for (auto &a : arguments)
+    {
+        if (source_args.contains(to_string(normalize_path(a->toString()))))
+            continue;
+        options_args.push_back(a->clone());
+        options += a->toString() + "\n";
+    }
+    options = shorten_hash(blake2b_512(options), 16);
+
+    JavaState st;
+    st.load(getStateFile());
+
+    // full rebuild on options change
+    bool full = st.options != options;
+    if (full)
+    {
+        for (auto &[s, _] : st.sources)
+            st.removeClasses(s);
+        st = {};
+        st.options = options;
+        // remove stale classes from unknown sources
+        if (fs::exists(output_dir))
+        {
+            for (auto &e : fs::recursive_directory_iterator(output_dir))
+            {
+                error_code ec;
+                if (e.path().extension() == ".class")
+                    fs::remove(e.path(), ec);
+            }
+        }
+    }
+
+    // removed sources
+    {
+        Files current(sources.begin(), sources.end());
+        for (auto i = st.sources.begin(); i != st.sources.end();)
+        {
+            if (current.contains(i->first))
+            {
+                ++i;
+                continue;
+            }
+            st.removeClasses(i->first);
+            i = st.sources.erase(i);
+        }
+    }
+
+    Files to_compile;
+    std::map<path, String> hashes;
+    for (auto &s : sources)
+    {
+        auto h = support::get_file_hash(s);
+        hashes[s] = h;
+        auto i = st.sources.find(s);
+        if (i == st.sources.end() || i->second.hash != h || i->second.classes.empty())
+            to_compile.insert(s);
+    }
+
+    // changed api of dependency targets
+    std::map<path, DependencyState> dependencies;
+    {
+        StringSet changed;
+        bool all = false;
+        for (auto &i : inputs)
+        {
+            if (i.extension() != ".abi")
+                continue;
+            auto dir = path(i).replace_extension();
+            JavaState ds;
+            ds.load(getStateFile(dir));
+            auto &d = dependencies[i];
+            d.abi = fs::exists(i) ? read_file(i) : String{};
+            d.constants = ds.getConstantsHash();
+            auto old = st.dependencies.find(i);
+            if (old != st.dependencies.end() && old->second.abi == d.abi)
+                continue;
+            // constants are inlined, we cannot track their users
+            // also we cannot tell classes of unknown dependency
+            if ((old != st.dependencies.end() && old->second.constants != d.constants) || ds.classes.empty())
+            {
+                all = true;
+                continue;
+            }
+            for (auto &[n, _] : ds.classes)
+                changed.insert(n);
+        }
+        for (auto &s : sources)
+        {
+            if (all)
+            {
+                to_compile.insert(s);
+                continue;
+            }
+            if (changed.empty() || to_compile.contains(s))
+                continue;
+            for (auto &n : st.sources[s].classes)
+            {
+                auto &refs = st.classes[n].references;
+                if (std::any_of(changed.begin(), changed.end(), [&refs](auto &&c) { return refs.contains(c); }))
+                {
+                    to_compile.insert(s);
+                    break;
+                }
+            }
+        }
+    }
+
+    Files compiled;
+    while (!to_compile.empty())
+    {
+        LOG_TRACE(logger, getName() << ": compiling " << to_compile.size() << " of " << sources.size() << " sources");
+
+        // remember old api
+        std::map<String, ClassState> old_classes;
+        for (auto &s : to_compile)
+        {
+            auto i = st.sources.find(s);
+            if (i == st.sources.end())
+                continue;
+            for (auto &n : i->second.classes)
+            {
+                if (auto c = st.classes.find(n); c != st.classes.end())
+                    old_classes.insert(*c);
+            }
+            st.removeClasses(s);
+        }
+
+        // compile
+        auto start = fs::file_time_type::clock::now();
+        {
+            auto args = std::move(arguments);
+            arguments.clear();
+            for (auto &a : options_args)
+                arguments.push_back(a->clone());
+            for (auto &s : to_compile)
+                arguments.push_back(normalize_path(s));
+            SCOPE_EXIT
+            {
+                arguments = std::move(args);
+            };
+            // classes of these sources are already removed,
+            // so they must be compiled next time even if sources are reverted
+            auto save_failed = [this, &st, &to_compile]()
+            {
+                for (auto &s : to_compile)
+                    st.sources[s].hash.clear();
+                st.save(getStateFile());
+            };
+            try
+            {
+                builder::Command::execute1(ec);
+            }
+            catch (...)
+            {
+                save_failed();
+                throw;
+            }
+            if (ec && *ec)
+            {
+                save_failed();
+                return;
+            }
+        }
+        compiled.insert(to_compile.begin(), to_compile.end());
+
+        // gather new classes
+        for (auto &s : to_compile)
+        {
+            auto &ss = st.sources[s];
+            ss.hash = hashes[s];
+        }
+        if (fs::exists(output_dir))
+        {
+            for (auto &e : fs::recursive_directory_iterator(output_dir))
+            {
+                if (e.path().extension() != ".class")
+                    continue;
+                // a bit earlier to handle coarse timestamps
+                if (fs::last_write_time(e.path()) + std::chrono::seconds(2) < start)
+                    continue;
+                java::ClassFile cf(e.path());
+                if (st.classes.contains(cf.name))
+                    continue; // not ours
+                // find source
+                path src;
+                for (auto &s : to_compile)
+                {
+                    if (s.filename() != cf.source_file)
+                        continue;
+                    src = s;
+                    // prefer sources laid out by package
+                    auto pkg = cf.getPackage();
+                    if (pkg.empty() || to_string(normalize_path(s.parent_path())).ends_with(pkg))
+                        break;
+                }
+                if (src.empty())
+                {
+                    LOG_DEBUG(logger, "Cannot find source for class " << cf.name);
+                    continue;
+                }
+                st.sources[src].classes.insert(cf.name);
+                auto &c = st.classes[cf.name];
+                c.file = e.path();
+                c.abi = cf.abi_hash;
+                c.constants = cf.constants_hash;
+                c.references = std::move(cf.references);
+            }
+        }
+
+        // find changed api
+        StringSet changed;
+        bool constants_changed = false;
+        for (auto &[n, c] : old_classes)
+        {
+            auto i = st.classes.find(n);
+            if (i == st.classes.end() || i->second.abi != c.abi)
+                changed.insert(n);
+            if (i == st.classes.end() || i->second.constants != c.constants)
+                constants_changed |= !c.constants.empty();
+        }
+        for (auto &s : to_compile)
+        {
+            for (auto &n : st.sources[s].classes)
+            {
+                if (!old_classes.contains(n))
+                    changed.insert(n);
+            }
+        }
+
+        to_compile.clear();
+        if (changed.empty())
+            break;
+        for (auto &s : sources)
+        {
+            if (compiled.contains(s))
+                continue;
+            // constants are inlined, we cannot track their users
+            if (constants_changed)
+            {
+                to_compile.insert(s);
+                continue;
+            }
+            for (auto &n : st.sources[s].classes)
+            {
+                auto &refs = st.classes[n].references;
+                if (std::any_of(changed.begin(), changed.end(), [&refs](auto &&c) { return refs.contains(c); }))
+                {
+                    to_compile.insert(s);
+                    break;
+                }
+            }
+        }
+    }
+
+    st.dependencies = std::move(dependencies);
+    st.save(getStateFile());
+
+    // touch abi file only on real change
+    auto abi = st.getAbiHash();
+    if (!fs::exists(getAbiFile()) || read_file(getAbiFile()) != abi)
+        write_file(getAbiFile(), abi);
+}
+
+} // namespace driver
+
+} // namespace sw
@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include "command.h"
+
+namespace sw
+{
+
+namespace java
+{
+
+// minimal class file reader
+// https://docs.oracle.com/javase/specs/jvms/se17/html/jvms-4.html
+struct SW_DRIVER_CPP_API ClassFile
+{
+    // internal form: a/b/C$D
+    String name;
+    // SourceFile attribute, may be empty when compiled with -g:none
+    String source_file;
+    // all classes referenced from constant pool and descriptors
+    StringSet references;
+    // hash of non-private api (class signature, fields, methods)
+    String abi_hash;
+    // hash of compile time constants, they are inlined into dependents
+    String constants_hash;
+
+    ClassFile() = default;
+    ClassFile(const path &fn);
+
+    String getPackage() const;
+};
+
+} // namespace java
+
+namespace driver
+{
+
+// Compiles only changed sources and sources depending on classes with changed api.
+// Classes of dependency targets (inputs with .abi extension) are tracked by their abi files.
+// Keeps its state near output dir.
+// ABI file is rewritten only when public api of the whole target is changed,
+// so dependent targets are not rebuilt on implementation changes.
+struct SW_DRIVER_CPP_API JavaCompileCommand : Command
+{
+    path output_dir;
+    FilesOrdered sources;
+
+    using Command::Command;
+
+    std::shared_ptr<Command> clone() const override;
+
+    path getStateFile() const;
+    static path getStateFile(const path &output_dir);
+    path getAbiFile() const;
+    static path getAbiFile(const path &output_dir);
+
+private:
+    void execute1(std::error_code *ec = nullptr) override;
+};
+
+} // namespace driver
+
+} // namespace sw
@@ -8,7 +8,11 @@
 
 #include <boost/dll.hpp>
 #include <boost/dll/import_mangled.hpp>
+#include <boost/dll/smart_library.hpp>
 #include <boost/thread/lock_types.hpp>
+#include <sw/support/hash.h>
+
+#include <mutex>
 
 #include <primitives/log.h>
 DECLARE_STATIC_LOGGER(logger, "module");
@@ -16,40 +20,62 @@ DECLARE_STATIC_LOGGER(logger, "module");
 namespace sw
 {
 
+using MangledLibrary = boost::dll::experimental::smart_library;
+
 template <class F>
-static auto get_function(const Module::DynamicLibrary &dll, const String &fn, bool required)
+static auto get_function(const Module::DynamicLibrary &shlib, std::unique_ptr<MangledLibrary> &dll, const String &fn, bool required)
 {
-    auto mangled_name = dll.symbol_storage().get_function<F>(fn);
+    // parses symbol tables, so do it once and only for modules without entry points table
+    if (!dll)
+        dll = std::make_unique<MangledLibrary>(shlib.location(), boost::dll::load_mode::rtld_lazy | boost::dll::load_mode::rtld_local);
+
+    auto mangled_name = dll->symbol_storage().get_function<F>(fn);
     if (mangled_name.empty())
         mangled_name = fn;
 
     // we use shlib directly, because we already demangled name (or not)
-    auto &shlib = dll.shared_lib();
     if (shlib.has(mangled_name))
         return shlib.get<F>(mangled_name);
     else if (shlib.has(fn))
         return shlib.get<F>(fn);
     else if (required)
-        throw SW_RUNTIME_ERROR("Required function '" + fn + "' is not found in module: " + to_string(normalize_path(dll.shared_lib().location())));
+        throw SW_RUNTIME_ERROR("Required function '" + fn + "' is not found in module: " + to_string(normalize_path(shlib.location())));
 
     return (F*)nullptr;
 }
 
-Module::Module(std::unique_ptr<Module::DynamicLibrary> dll, bool do_not_remove_bad_module)
+Module::Module(std::shared_ptr<Module::DynamicLibrary> dll, bool do_not_remove_bad_module)
     : module(std::move(dll)), do_not_remove_bad_module(do_not_remove_bad_module)
 {
-#define LOAD(f)                                                                                    \
-    do                                                                                             \
-    {                                                                                              \
-        f##_.name = #f;                                                                            \
-        f##_.m = this;                                                                             \
-        f##_ = get_function<decltype(f##_)::function_type>(*module, f##_.name, f##_.isRequired()); \
-    } while (0)
-
-    LOAD(build);
-    LOAD(check);
-    LOAD(configure);
-    LOAD(sw_get_module_abi_version);
+    build_.name = "build";
+    check_.name = "check";
+    configure_.name = "configure";
+    sw_get_module_abi_version_.name = "sw_get_module_abi_version";
+    build_.m = check_.m = configure_.m = sw_get_module_abi_version_.m = this;
+
+    if (module->has("sw_get_module_table"))
+    {
+        auto t = module->get<const sw_module_table *()>("sw_get_module_table")();
+        sw_get_module_abi_version_ = [v = t->abi_version]() { return v; };
+        // layout of the rest may differ on abi mismatch
+        if (t->abi_version == ::sw_get_module_abi_version())
+        {
+            build_ = t->build;
+            check_ = t->check;
+            configure_ = t->configure;
+        }
+    }
+    else
+    {
+        std::unique_ptr<MangledLibrary> mangled;
+#define LOAD(f) f##_ = get_function<decltype(f##_)::function_type>(*module, mangled, f##_.name, f##_.isRequired())
+
+        LOAD(build);
+        LOAD(check);
+        LOAD(configure);
+        LOAD(sw_get_module_abi_version);
+#undef LOAD
+    }
 
     // regardless of config version we must check abi
     // example: new abi pushed to SW Network, but user has old client
@@ -58,7 +84,7 @@ Module::Module(std::unique_ptr<Module::DynamicLibrary> dll, bool do_not_remove_b
     auto module_abi = sw_get_module_abi_version_();
     if (current_driver_abi != module_abi)
     {
-        auto p = module->shared_lib().location();
+        auto p = module->location();
         module.reset();
         String rebuild;
         if (!do_not_remove_bad_module)
@@ -80,8 +106,6 @@ Module::Module(std::unique_ptr<Module::DynamicLibrary> dll, bool do_not_remove_b
                 "). Update sw driver headers (or ask driver maintainer)." + rebuild);
         }
     }
-
-#undef LOAD
 }
 
 path Module::getLocation() const
@@ -91,7 +115,7 @@ path Module::getLocation() const
         // for some reason getLocation may fail on windows with
         // GetLastError() == 126 (module not found)
         // so we return this boost error instead
-        return module->shared_lib().location();
+        return module->location();
     }
     catch (std::exception &e)
     {
@@ -99,6 +123,23 @@ path Module::getLocation() const
     }
 }
 
+size_t Module::getHash() const
+{
+    // file is replaced on rebuild, so location and mtime are enough
+    try
+    {
+        path p = module->location();
+        size_t h = 0;
+        hash_combine(h, to_string(normalize_path(p)));
+        hash_combine(h, fs::last_write_time(p).time_since_epoch().count());
+        return h;
+    }
+    catch (std::exception &)
+    {
+        return 0;
+    }
+}
+
 template <class F, bool Required>
 template <class ... Args>
 typename Module::LibraryCall<F, Required>::std_function_type::result_type
@@ -168,11 +209,49 @@ int Module::sw_get_module_abi_version() const
     return sw_get_module_abi_version_();
 }
 
+namespace
+{
+
+struct LoadedLibrary
+{
+    std::shared_ptr<Module::DynamicLibrary> dl;
+    fs::file_time_type mtime;
+};
+
+std::mutex loaded_libraries_mutex;
+std::map<path, LoadedLibrary> loaded_libraries;
+
+}
+
+static path getLazyStampFile(const path &dll)
+{
+    auto p = dll;
+    p += ".lazy";
+    return p;
+}
+
 std::unique_ptr<Module> loadSharedLibrary(const path &dll, const FilesOrdered &PATH, bool do_not_remove_bad_module)
 {
     if (dll.empty())
         throw SW_RUNTIME_ERROR("Empty module path");
 
+    // we keep libraries loaded, unloading is unsafe anyway
+    std::unique_lock lk(loaded_libraries_mutex);
+    auto mtime = fs::last_write_time(dll);
+    if (auto i = loaded_libraries.find(dll); i != loaded_libraries.end())
+    {
+        if (i->second.mtime == mtime)
+            return std::make_unique<Module>(i->second.dl, do_not_remove_bad_module);
+        // rebuilt, other contexts may still use the old one
+        loaded_libraries.erase(i);
+    }
+
+    // lazy binding hides missing symbols until the call,
+    // so we use it only for files that were bound successfully before
+    auto stamp = getLazyStampFile(dll);
+    auto mtime_string = std::to_string(mtime.time_since_epoch().count());
+    bool lazy = fs::exists(stamp) && read_file(stamp) == mtime_string;
+
 #ifdef _WIN32
     // set dll deps
     std::vector<void *> cookies;
@@ -194,14 +273,15 @@ std::unique_ptr<Module> loadSharedLibrary(const path &dll, const FilesOrdered &P
     };
 #endif
 
-    std::unique_ptr<Module::DynamicLibrary> dl;
+    std::shared_ptr<Module::DynamicLibrary> dl;
 
     String err;
     err = "Module " + to_string(normalize_path(dll)) + " is in bad shape";
     try
     {
-        dl = std::make_unique<Module::DynamicLibrary>(dll,
-            boost::dll::load_mode::rtld_now | boost::dll::load_mode::rtld_global
+        // modules do not use symbols of each other, so keep them local
+        dl = std::make_shared<Module::DynamicLibrary>(dll,
+            (lazy ? boost::dll::load_mode::rtld_lazy : boost::dll::load_mode::rtld_now) | boost::dll::load_mode::rtld_local
             //, ec
             );
     }
@@ -230,7 +310,11 @@ std::unique_ptr<Module> loadSharedLibrary(const path &dll, const FilesOrdered &P
         throw;
     }
 
-    return std::make_unique<Module>(std::move(dl), do_not_remove_bad_module);
+    auto m = std::make_unique<Module>(dl, do_not_remove_bad_module);
+    if (!lazy)
+        write_file(stamp, mtime_string);
+    loaded_libraries[dll] = { dl, mtime };
+    return m;
 }
 
 }
@@ -3,7 +3,7 @@
 
 #pragma once
 
-#include <boost/dll/smart_library.hpp>
+#include <boost/dll/shared_library.hpp>
 #include <boost/thread/shared_mutex.hpp>
 #include <primitives/filesystem.h>
 
@@ -15,7 +15,7 @@ struct Checker;
 
 struct SW_DRIVER_CPP_API Module
 {
-    using DynamicLibrary = boost::dll::experimental::smart_library;
+    using DynamicLibrary = boost::dll::shared_library;
 
     template <class F, bool Required = false>
     struct LibraryCall
@@ -40,16 +40,19 @@ struct SW_DRIVER_CPP_API Module
         bool isRequired() const { return Required; }
     };
 
-    Module(std::unique_ptr<Module::DynamicLibrary>, bool do_not_remove_bad_module);
+    Module(std::shared_ptr<Module::DynamicLibrary>, bool do_not_remove_bad_module);
 
     // api
     void build(Build &s) const;
     void configure(Build &s) const;
     void check(Build &s, Checker &c) const;
     int sw_get_module_abi_version() const;
+    // changes when module file is rebuilt
+    size_t getHash() const;
 
 private:
-    std::unique_ptr<Module::DynamicLibrary> module;
+    // shared between contexts, see loadSharedLibrary()
+    std::shared_ptr<Module::DynamicLibrary> module;
     bool do_not_remove_bad_module;
 
     mutable LibraryCall<void(Build &), true> build_;
@@ -60,6 +63,10 @@ private:
     path getLocation() const;
 };
 
+// Loaded libraries are cached for the whole process and reused by other contexts
+// until the file is changed.
+// On the first load module is bound immediately to find missing symbols,
+// subsequent loads of the same file use lazy binding.
 std::unique_ptr<Module> loadSharedLibrary(const path &dll, const FilesOrdered &PATH, bool do_not_remove_bad_module);
 
 }
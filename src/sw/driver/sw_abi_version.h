@@ -14,4 +14,5 @@
 // 31: PathBase::operator == and < api changes
 // 32: Some new APIs. ABI increase just for safety and clients update.
 // 33: Recurse prevention in Target::getInterfaceSettings()
-#define SW_MODULE_ABI_VERSION 33
+// 34: Interned PackagePath, module entry points table
+#define SW_MODULE_ABI_VERSION 34
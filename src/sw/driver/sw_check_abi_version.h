@@ -8,6 +8,9 @@
 #ifndef SW_PACKAGE_API
 #define SW_PACKAGE_API
 #define INLINE inline
+#else
+// we are compiled into config module
+#define SW_MODULE_TABLE
 #endif
 
 #ifndef INLINE
@@ -20,4 +23,39 @@ INLINE int sw_get_module_abi_version()
     return SW_MODULE_ABI_VERSION;
 }
 
+#ifdef __cplusplus
+
+namespace sw
+{
+struct Build;
+struct Checker;
+}
+
+// entry points of a config module,
+// exported as a single C symbol, so loader does not demangle anything
+// abi_version must stay the first member
+struct sw_module_table
+{
+    int abi_version;
+    void (*build)(sw::Build &);
+    void (*configure)(sw::Build &);
+    void (*check)(sw::Checker &);
+};
+
+#if defined(SW_MODULE_TABLE) && defined(__ELF__)
+// optional entry points, null when not defined
+__attribute__((weak)) void configure(sw::Build &);
+__attribute__((weak)) void check(sw::Checker &);
+
+extern "C" SW_PACKAGE_API
+const sw_module_table *sw_get_module_table()
+{
+    static const sw_module_table t{ SW_MODULE_ABI_VERSION, build, configure, check };
+    return &t;
+}
+#endif
+
+#endif
+
+#undef SW_MODULE_TABLE
 #undef INLINE
@@ -11,9 +11,11 @@
 #include "../compiler/detect.h"
 
 #include <sw/builder/jumppad.h>
+#include <sw/builder/scratch.h>
 #include <sw/core/sw_context.h>
 #include <sw/manager/storage.h>
 #include <sw/manager/yaml.h>
+#include <sw/support/filesystem.h>
 
 #include <boost/algorithm/string.hpp>
 #include <nlohmann/json.hpp>
@@ -50,10 +52,17 @@ SW_DEFINE_VISIBLE_FUNCTION_JUMPPAD(sw_create_def_file, create_def_file)
 
 static int copy_file(path in, path out)
 {
-    error_code ec;
     fs::create_directories(out.parent_path());
-    fs::copy_file(in, out, fs::copy_options::overwrite_existing, ec);
-    return !!ec;
+    try
+    {
+        // copies of outputs are never modified in place
+        sw::support::copy_file_fast(in, out, true);
+    }
+    catch (std::exception &)
+    {
+        return 1;
+    }
+    return 0;
 }
 SW_DEFINE_VISIBLE_FUNCTION_JUMPPAD(sw_copy_file, copy_file)
 
@@ -1127,6 +1136,7 @@ void NativeCompiledTarget::setOutputFile()
     if (isHeaderOnly())
         return;
     NativeTarget::setOutputFile();
+    resetInterfaceSettings();
 }
 
 path NativeCompiledTarget::getOutputFile() const
@@ -1348,18 +1358,22 @@ void NativeCompiledTarget::createPrecompiledHeader()
     }
     File(pch.source, getFs()).setGenerated(true); // prevents resolving issues
 
+    // gcc and clang look for pch near the header, so only msvc pch goes to scratch
+    auto scratch = getMainBuild().getScratchDirectory();
+    auto to_scratch = [scratch](const path &p, uintmax_t sz) { return scratch ? scratch->map(p, sz) : p; };
+
     //
     if (pch.pch.empty())
     {
         if (getCompilerType() == CompilerType::MSVC || getCompilerType() == CompilerType::ClangCl)
-            pch.pch = pch.get_base_pch_path() += ".pch";
+            pch.pch = to_scratch(pch.get_base_pch_path() += ".pch", 64 * 1024 * 1024);
         else if (isClangFamily(getCompilerType()))
             pch.pch = path(pch.header) += ".pch";
         else // gcc
             pch.pch = path(pch.header) += ".gch";
     }
     if (pch.obj.empty())
-        pch.obj = pch.get_base_pch_path() += ".obj";
+        pch.obj = to_scratch(pch.get_base_pch_path() += ".obj", 1024 * 1024);
     if (pch.pdb.empty())
         pch.pdb = pch.get_base_pch_path() += ".pdb";
 
@@ -2132,14 +2146,16 @@ const TargetSettings &NativeCompiledTarget::getInterfaceSettings(std::unordered_
     // Do not export any private information.
     // It MUST be extracted from getCommands() call.
 
-    auto &s = interface_settings;
-    // info may change during prepare, so we create it every time for now
-    // TODO: deny calls during prepare()
-    if (interface_settings_set)
-        return s;
+    {
+        std::unique_lock lk(m);
+        if (frozen_interface_settings)
+            return *frozen_interface_settings;
+    }
 
+    // info may change during prepare, so we create it every time until prepare is done
+    // TODO: deny calls during prepare()
     bool prepared = prepare_pass_done;
-    s = {};
+    TargetSettings s;
 
     s["source_dir"].setPathValue(getContext().getLocalStorage(), SourceDirBase);
     s["binary_dir"].setPathValue(getContext().getLocalStorage(), BinaryDir);
@@ -2326,10 +2342,26 @@ const TargetSettings &NativeCompiledTarget::getInterfaceSettings(std::unordered_
         });
     }
 
-    if (prepared)
-        interface_settings_set = true;
+    if (!prepared)
+    {
+        interface_settings = std::move(s);
+        return interface_settings;
+    }
 
-    return s;
+    // freeze, concurrent callers may compute it too, first one wins
+    s.cacheHash();
+    std::unique_lock lk(m);
+    if (!frozen_interface_settings)
+        frozen_interface_settings = std::make_shared<const TargetSettings>(std::move(s));
+    return *frozen_interface_settings;
+}
+
+void NativeCompiledTarget::resetInterfaceSettings()
+{
+    // references taken earlier must not dangle
+    std::unique_lock lk(m);
+    if (frozen_interface_settings)
+        interface_settings_keep.push_back(std::move(frozen_interface_settings));
 }
 
 bool NativeCompiledTarget::prepare()
@@ -3903,18 +3935,28 @@ void NativeCompiledTarget::prepare_pass5()
                 // create new cmd
                 //t.Storage.push_back(pp_command);
 
+                auto &cexts = getCSourceFileExtensions();
+                auto cpp = cexts.find(f->file.extension().string()) == cexts.end();
+
                 // set pp
+                // debug info keeps original file names from line markers
+                // and compilation dir (gcc -fworking-directory is on with -g)
                 pp_command.CompileWithoutLinking = false;
                 pp_command.Preprocess = true;
                 auto o = pp_command.getOutputFile();
-                o = o.parent_path() / o.stem() += ".i";
+                o = o.parent_path() / o.stem() += cpp ? ".ii" : ".i";
                 pp_command.setOutputFile(o);
                 // prepare & register
                 auto cmd = pp_command.getCommand(t);
                 t.registerCommand(*cmd);
 
                 // set input file for old command
+                // now it depends only on preprocessed file and compiler,
+                // so it can be sent to remote worker or taken from cache
                 c->setSourceFile(pp_command.getOutputFile(), c->getOutputFile());
+                c->PreprocessedInput = true;
+                String lang = c->Language ? c->Language() : (cpp ? "c++" : "c");
+                c->Language = lang == "c" ? "cpp-output" : lang + "-cpp-output";
 
                 set_fancy_name(t, cmd, f);
             };
@@ -4471,6 +4513,7 @@ void NativeCompiledTarget::processCircular(Files &obj)
         c->addInput(dlls);
         cmds.insert(c.getCommand());
         outputfile = out;
+        resetInterfaceSettings();
     }
 
     lib_exe->CreateImportLibrary = true; // set def option = create .exp(ort) file
@@ -202,8 +202,12 @@ private:
     path getPatchDir(bool binary_dir) const;
     void addFileSilently(const path &);
 
-    mutable bool interface_settings_set = false;
+    // computed once after the final prepare pass and never changed,
+    // so references and hash stay valid for all callers
+    mutable std::shared_ptr<const TargetSettings> frozen_interface_settings;
     const TargetSettings &getInterfaceSettings(std::unordered_set<void*> *visited_targets = nullptr) const override;
+    void resetInterfaceSettings();
+    std::vector<std::shared_ptr<const TargetSettings>> interface_settings_keep; // reset ones
 
     FilesOrdered gatherPrecompiledHeaders() const;
     void createPrecompiledHeader();
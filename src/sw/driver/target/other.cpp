@@ -6,6 +6,7 @@
 #include "common.h"
 
 #include "sw/driver/build.h"
+#include "sw/driver/java.h"
 #include "sw/driver/compiler/detect.h"
 
 #include <sw/core/sw_context.h>
@@ -207,6 +208,11 @@ bool GoTarget::init()
 
     compiler->Extension = getBuildSettings().TargetOS.getExecutableExtension();
     compiler->setOutputFile(getBaseOutputFileName(*this, {}, "bin"));
+    compiler->CacheDir = getContext().getLocalStorage().storage_dir_tmp / "go" / "cache";
+    if (getMainBuild().getSettings()["build-jobs"])
+        compiler->Jobs = std::stoi(getMainBuild().getSettings()["build-jobs"].getValue());
+    else
+        compiler->Jobs = std::thread::hardware_concurrency();
 
     SW_RETURN_MULTIPASS_END(init_pass);
 }
@@ -265,7 +271,22 @@ Commands JavaTarget::getCommands1() const
         compiler->setSourceFile(f->file);
     }
 
+    // dependents are rebuilt only when abi of dependency is changed
+    Files abi_files;
+    for (auto &d : this->gatherDependencies())
+    {
+        if (auto t = d->getTarget().as<const JavaTarget *>())
+        {
+            // commands may be requested several times
+            auto &cp = compiler->ClassPath;
+            if (std::find(cp.begin(), cp.end(), t->compiler->OutputDir()) == cp.end())
+                cp.push_back(t->compiler->OutputDir());
+            abi_files.insert(driver::JavaCompileCommand::getAbiFile(t->compiler->OutputDir()));
+        }
+    }
+
     auto c = compiler->getCommand(*this);
+    c->addInput(abi_files);
     cmds.insert(c);
     return cmds;
 }
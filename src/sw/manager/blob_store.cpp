@@ -0,0 +1,223 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#include "blob_store.h"
+
+#include <sw/support/filesystem.h>
+#include <sw/support/hash.h>
+
+#include <nlohmann/json.hpp>
+#include <primitives/exceptions.h>
+#include <primitives/http.h>
+
+#include <algorithm>
+#include <fstream>
+#include <unordered_set>
+
+#include <primitives/log.h>
+DECLARE_STATIC_LOGGER(logger, "blob_store");
+
+#define SW_PACK_MANIFEST_TYPE "sw.pack.manifest"
+#define SW_PACK_MANIFEST_VERSION 1
+
+namespace sw
+{
+
+BlobStore::BlobStore(const path &root)
+    : root(root)
+{
+}
+
+static bool is_valid_hash(const String &hash)
+{
+    static const auto hash_size = blake2b_512(String{}).size();
+    // hashes come from manifests and become paths
+    return hash.size() == hash_size &&
+        std::all_of(hash.begin(), hash.end(), [](auto c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); });
+}
+
+path BlobStore::getRelativePath(const String &hash)
+{
+    if (!is_valid_hash(hash))
+        throw SW_RUNTIME_ERROR("Bad blob hash: " + hash);
+    return path(hash.substr(0, 2)) / hash;
+}
+
+String BlobStore::getHash(const path &file)
+{
+    return blake2b_512(read_file(file));
+}
+
+path BlobStore::getPath(const String &hash) const
+{
+    return root / getRelativePath(hash);
+}
+
+bool BlobStore::contains(const String &hash) const
+{
+    return fs::exists(getPath(hash));
+}
+
+String BlobStore::add(const path &file)
+{
+    auto h = getHash(file);
+    add(h, file);
+    return h;
+}
+
+void BlobStore::add(const String &hash, const path &file)
+{
+    auto p = getPath(hash);
+    if (fs::exists(p))
+        return;
+    fs::create_directories(p.parent_path());
+    // other processes may read or write the same blob, so write it fully first
+    auto tmp = path(p) += "." + unique_path().string();
+    support::copy_file_fast(file, tmp);
+    error_code ec;
+    fs::rename(tmp, p, ec);
+    if (ec)
+    {
+        fs::remove(tmp, ec);
+        if (!fs::exists(p))
+            throw SW_RUNTIME_ERROR("Cannot add blob " + hash + " to " + to_string(root));
+    }
+}
+
+PackManifest PackManifest::create(const std::map<path, path> &files, BlobStore &s)
+{
+    PackManifest m;
+    for (auto &[from, to] : files)
+    {
+        File f;
+        f.hash = s.add(from);
+        f.size = fs::file_size(from);
+        f.executable = (fs::status(from).permissions() & fs::perms::owner_exec) != fs::perms::none;
+        m.files[to] = f;
+    }
+    return m;
+}
+
+bool PackManifest::isManifest(const path &fn)
+{
+    std::ifstream ifs(fn, std::ios::binary);
+    if (ifs.get() != '{')
+        return false;
+    try
+    {
+        auto j = nlohmann::json::parse(read_file(fn));
+        return j["type"] == SW_PACK_MANIFEST_TYPE;
+    }
+    catch (std::exception &)
+    {
+        return false;
+    }
+}
+
+PackManifest PackManifest::load(const path &fn)
+{
+    auto j = nlohmann::json::parse(read_file(fn));
+    if (j["type"] != SW_PACK_MANIFEST_TYPE)
+        throw SW_RUNTIME_ERROR("Not a pack manifest: " + to_string(fn));
+    if (j["version"] != SW_PACK_MANIFEST_VERSION)
+        throw SW_RUNTIME_ERROR("Unsupported pack manifest version: " + to_string(fn));
+
+    PackManifest m;
+    if (j.contains("blobs"))
+        m.blobs = j["blobs"].get<String>();
+    for (auto &v : j["files"])
+    {
+        auto p = fs::u8path(v["path"].get<String>());
+        // do not write outside of destination dir
+        if (p.empty() || p.has_root_path() || p.lexically_normal().begin()->string() == "..")
+            throw SW_RUNTIME_ERROR("Bad file path in pack manifest: " + to_string(p));
+        File f;
+        f.hash = v["hash"].get<String>();
+        if (!is_valid_hash(f.hash))
+            throw SW_RUNTIME_ERROR("Bad blob hash in pack manifest: " + f.hash);
+        f.size = v["size"].get<uint64_t>();
+        f.executable = v.contains("executable") && v["executable"].get<bool>();
+        m.files[p] = f;
+    }
+    return m;
+}
+
+void PackManifest::save(const path &fn) const
+{
+    nlohmann::json j;
+    j["type"] = SW_PACK_MANIFEST_TYPE;
+    j["version"] = SW_PACK_MANIFEST_VERSION;
+    if (!blobs.empty())
+        j["blobs"] = blobs;
+    j["files"] = nlohmann::json::array();
+    for (auto &[p, f] : files)
+    {
+        nlohmann::json v;
+        v["path"] = to_string(normalize_path(p));
+        v["hash"] = f.hash;
+        v["size"] = f.size;
+        if (f.executable)
+            v["executable"] = true;
+        j["files"].push_back(v);
+    }
+    write_file(fn, j.dump(2));
+}
+
+size_t PackManifest::push(const BlobStore &src, BlobStore &dst) const
+{
+    size_t n = 0;
+    std::unordered_set<String> hashes;
+    for (auto &[_, f] : files)
+    {
+        if (!hashes.insert(f.hash).second || dst.contains(f.hash))
+            continue;
+        dst.add(f.hash, src.getPath(f.hash));
+        n++;
+    }
+    return n;
+}
+
+void PackManifest::unpack(BlobStore &s, const path &dir) const
+{
+    auto fetch = [this, &s](const String &hash)
+    {
+        if (blobs.empty())
+            throw SW_RUNTIME_ERROR("Missing blob " + hash + " and no blob store to get it from");
+        auto rel = BlobStore::getRelativePath(hash);
+        auto tmp = support::get_temp_filename("blobs");
+        SCOPE_EXIT
+        {
+            error_code ec;
+            fs::remove(tmp, ec);
+        };
+        if (blobs.starts_with("http://") || blobs.starts_with("https://"))
+            download_file(blobs + "/" + normalize_path(rel).string(), tmp);
+        else
+        {
+            fs::create_directories(tmp.parent_path());
+            fs::copy_file(fs::u8path(blobs) / rel, tmp);
+        }
+        if (getHash(tmp) != hash)
+            throw SW_RUNTIME_ERROR("Blob hash mismatch: " + hash);
+        s.add(hash, tmp);
+    };
+
+    size_t fetched = 0;
+    for (auto &[p, f] : files)
+    {
+        if (!s.contains(f.hash))
+        {
+            fetch(f.hash);
+            fetched++;
+        }
+        auto to = dir / p;
+        fs::create_directories(to.parent_path());
+        // package sources may be patched in place, so no hardlinks to blobs
+        support::copy_file_fast(s.getPath(f.hash), to);
+        if (f.executable)
+            fs::permissions(to, fs::perms::owner_exec | fs::perms::group_exec | fs::perms::others_exec, fs::perm_options::add);
+    }
+    LOG_TRACE(logger, "unpacked " << files.size() << " files into " << to_string(dir) << ", fetched " << fetched << " blobs");
+}
+
+} // namespace sw
@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2023 Egor Pugin <egor.pugin@gmail.com>
+
+#pragma once
+
+#include <primitives/filesystem.h>
+
+#include <map>
+
+namespace sw
+{
+
+// Content addressed file store: root/<first two chars of hash>/<hash>.
+// Blobs are never changed after they are written,
+// so one store is shared by all packages and their versions.
+struct SW_MANAGER_API BlobStore
+{
+    BlobStore(const path &root);
+
+    // returns content hash
+    String add(const path &file);
+    // file must have this content hash; nothing is written when blob exists
+    void add(const String &hash, const path &file);
+    bool contains(const String &hash) const;
+    path getPath(const String &hash) const;
+    const path &getRoot() const { return root; }
+
+    static path getRelativePath(const String &hash);
+    // blake2b-512 of file content, lowercase hex
+    static String getHash(const path &file);
+
+private:
+    path root;
+};
+
+// Content addressed package archive.
+//
+// Instead of compressed archive of all files the manifest lists files with their content hashes,
+// file data lives in blob stores. Versions differing by a few files share all other blobs,
+// so only new blobs are stored, uploaded and downloaded.
+// Classic archives are still produced and unpacked as before.
+struct SW_MANAGER_API PackManifest
+{
+    struct File
+    {
+        String hash;
+        uint64_t size = 0;
+        bool executable = false;
+    };
+
+    // relative path -> file
+    std::map<path, File> files;
+    // blob store (dir or url) to get missing blobs from
+    String blobs;
+
+    // files: absolute -> relative, same as for pack_files()
+    static PackManifest create(const std::map<path, path> &files, BlobStore &);
+    static PackManifest load(const path &fn);
+    // false for classic archives
+    static bool isManifest(const path &fn);
+    void save(const path &fn) const;
+
+    // copies blobs missing in dst, returns number of copied blobs
+    size_t push(const BlobStore &src, BlobStore &dst) const;
+    // creates files in dir, missing blobs are fetched into the store first
+    void unpack(BlobStore &, const path &dir) const;
+};
+
+} // namespace sw
@@ -498,6 +498,22 @@ VersionSet PackagesDatabase::getVersionsForPackage(const PackagePath &ppath) con
     return versions;
 }
 
+std::vector<PackagesDatabase::PackageVersionSource> PackagesDatabase::getMatchingPackagesSources(const String &name) const
+{
+    std::vector<PackageVersionSource> r;
+    for (const auto &row : (*db)(
+        select(pkgs.path, pkg_ver.version, pkg_ver.prefix, t_pkg_ver_files.source)
+        .from(pkg_ver
+            .join(pkgs).on(pkg_ver.packageId == pkgs.packageId)
+            .join(t_pkg_ver_files).on(t_pkg_ver_files.packageVersionId == pkg_ver.packageVersionId))
+        .where(pkgs.path.like("%" + name + "%"))))
+    {
+        r.push_back({ PackageId{ row.path.value(), row.version.value() },
+            row.source.is_null() ? String{} : String(row.source.value()), (int)row.prefix.value() });
+    }
+    return r;
+}
+
 db::PackageId PackagesDatabase::getPackageId(const PackagePath &ppath) const
 {
     auto q = (*db)(
@@ -48,6 +48,15 @@ struct SW_MANAGER_API PackagesDatabase : Database
     std::vector<PackagePath> getMatchingPackages(const String &name = {}, int limit = 0, int offset = 0) const;
     VersionSet getVersionsForPackage(const PackagePath &) const;
 
+    struct PackageVersionSource
+    {
+        PackageId id;
+        String source;
+        int prefix;
+    };
+    // all versions of matching packages with their sources, single query
+    std::vector<PackageVersionSource> getMatchingPackagesSources(const String &name) const;
+
 private:
     std::mutex m;
     std::unique_ptr<struct PreparedStatements> pps;
@@ -3,6 +3,7 @@
 
 #include "storage.h"
 
+#include "blob_store.h"
 #include "package_database.h"
 
 #include <primitives/pack.h>
@@ -327,7 +328,7 @@ void LocalStorage::get(const IStorage2 &source, const PackageId &id, StorageFile
         fs::remove(dst);
     };
 
-    auto unpack = [&id, &dst, &lp, &t]()
+    auto unpack = [this, &id, &dst, &lp, &t]()
     {
         for (auto &d : fs::directory_iterator(lp.getDir()))
         {
@@ -336,7 +337,13 @@ void LocalStorage::get(const IStorage2 &source, const PackageId &id, StorageFile
         }
 
         LOG_INFO(logger, "Unpacking  : [" + id.toString() + "]/[" + toUserString(t) + "]");
-        unpack_file(dst, lp.getDirSrc());
+        if (PackManifest::isManifest(dst))
+        {
+            BlobStore s(storage_dir_blb);
+            PackManifest::load(dst).unpack(s, lp.getDirSrc());
+        }
+        else
+            unpack_file(dst, lp.getDirSrc());
     };
 
     // at the moment we perform check after download
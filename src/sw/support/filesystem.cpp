@@ -8,8 +8,20 @@
 #include <boost/thread/lock_types.hpp>
 #include <primitives/exceptions.h>
 
+#include <atomic>
+
 #ifndef _WIN32
+#include <fcntl.h>
 #include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+#ifdef __APPLE__
+#include <sys/clonefile.h>
 #endif
 
 #define SW_NAME "sw"
@@ -127,4 +139,94 @@ int set_max_open_files_limit(int new_limit)
     return new_limit;
 }
 
+static std::atomic<CopyStrategy> copy_strategy = CopyStrategy::Auto;
+
+void set_copy_strategy(CopyStrategy s)
+{
+    copy_strategy = s;
+}
+
+CopyStrategy get_copy_strategy()
+{
+    return copy_strategy;
+}
+
+CopyStrategy parse_copy_strategy(const String &s)
+{
+    if (s == "auto")
+        return CopyStrategy::Auto;
+    if (s == "reflink")
+        return CopyStrategy::Reflink;
+    if (s == "hardlink")
+        return CopyStrategy::Hardlink;
+    if (s == "copy")
+        return CopyStrategy::Copy;
+    throw SW_RUNTIME_ERROR("Unknown copy strategy: " + s);
+}
+
+static bool reflink_file(const path &from, const path &to)
+{
+#if defined(__linux__) && defined(FICLONE)
+    int in = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in == -1)
+        return false;
+    struct stat st;
+    if (::fstat(in, &st) == -1)
+    {
+        ::close(in);
+        return false;
+    }
+    int out = ::open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777);
+    if (out == -1)
+    {
+        ::close(in);
+        return false;
+    }
+    // fails on other filesystems and across them
+    auto r = ::ioctl(out, FICLONE, in);
+    ::close(out);
+    ::close(in);
+    if (r == 0)
+        return true;
+    error_code ec;
+    fs::remove(to, ec);
+    return false;
+#elif defined(__APPLE__)
+    return ::clonefile(from.c_str(), to.c_str(), 0) == 0;
+#else
+    return false;
+#endif
+}
+
+CopyMethod copy_file_fast(const path &from, const path &to, bool allow_hardlink)
+{
+    return copy_file_fast(from, to, get_copy_strategy(), allow_hardlink);
+}
+
+CopyMethod copy_file_fast(const path &from, const path &to, CopyStrategy s, bool allow_hardlink)
+{
+    error_code ec, ec2;
+    auto cfrom = fs::weakly_canonical(from, ec);
+    auto cto = fs::weakly_canonical(to, ec2);
+    if (!ec && !ec2 && cfrom == cto)
+        throw SW_RUNTIME_ERROR("Cannot copy file onto itself: " + to_string(to));
+
+    // destination may be a link to the old source, never write through it
+    fs::remove(to, ec);
+
+    if (s == CopyStrategy::Auto || s == CopyStrategy::Reflink)
+    {
+        if (reflink_file(from, to))
+            return CopyMethod::Reflink;
+    }
+    if (allow_hardlink && (s == CopyStrategy::Auto || s == CopyStrategy::Hardlink))
+    {
+        fs::create_hard_link(from, to, ec);
+        if (!ec)
+            return CopyMethod::Hardlink;
+    }
+    fs::copy_file(from, to, fs::copy_options::overwrite_existing);
+    return CopyMethod::Copy;
+}
+
 }
@@ -44,4 +44,41 @@ void create_directories(const path &p);
 SW_SUPPORT_API
 int set_max_open_files_limit(int newlimit);
 
+// How copy_file_fast() places files.
+// Reflinks (btrfs, xfs, apfs) share data blocks until one of files is changed.
+// Hardlinks share the file itself, so they are used only when caller allows them:
+// copy must never be modified in place.
+enum class CopyStrategy
+{
+    Auto,       // reflink, hardlink, copy
+    Reflink,    // reflink, copy
+    Hardlink,   // hardlink, copy
+    Copy,
+};
+
+enum class CopyMethod
+{
+    Reflink,
+    Hardlink,
+    Copy,
+};
+
+// process wide, default is auto
+SW_SUPPORT_API
+void set_copy_strategy(CopyStrategy);
+
+SW_SUPPORT_API
+CopyStrategy get_copy_strategy();
+
+// auto, reflink, hardlink or copy
+SW_SUPPORT_API
+CopyStrategy parse_copy_strategy(const String &);
+
+// replaces destination, returns the method used
+SW_SUPPORT_API
+CopyMethod copy_file_fast(const path &from, const path &to, bool allow_hardlink = false);
+
+SW_SUPPORT_API
+CopyMethod copy_file_fast(const path &from, const path &to, CopyStrategy, bool allow_hardlink = false);
+
 }
@@ -6,9 +6,150 @@
 #include <boost/algorithm/string.hpp>
 #include <primitives/templates.h>
 
+#include <mutex>
+#include <shared_mutex>
+
 namespace sw
 {
 
+namespace detail
+{
+
+namespace
+{
+
+struct PathTable
+{
+    using Key = std::pair<const PathNode *, String>;
+
+    struct KeyHash
+    {
+        size_t operator()(const Key &k) const
+        {
+            size_t h = std::hash<const void *>()(k.first);
+            return hash_combine(h, std::hash<String>()(k.second));
+        }
+    };
+
+    std::shared_mutex m;
+    std::unordered_map<Key, std::unique_ptr<PathNode>, KeyHash> nodes;
+};
+
+PathTable &get_path_table()
+{
+    static PathTable t;
+    return t;
+}
+
+}
+
+const PathNode *PathNode::append(const PathNode *parent, const String &element)
+{
+    auto &t = get_path_table();
+    PathTable::Key k{ parent, element };
+    {
+        std::shared_lock lk(t.m);
+        if (auto i = t.nodes.find(k); i != t.nodes.end())
+            return i->second.get();
+    }
+
+    // lowered node first, it takes the lock itself
+    const PathNode *lower = nullptr;
+    auto lower_element = boost::to_lower_copy(element);
+    if (lower_element != element || (parent && parent->lower != parent))
+        lower = append(parent ? parent->lower : nullptr, lower_element);
+
+    std::unique_lock lk(t.m);
+    auto &n = t.nodes[k];
+    if (n)
+        return n.get();
+    n = std::make_unique<PathNode>();
+    n->parent = parent;
+    n->element = element;
+    n->size = parent ? parent->size + 1 : 1;
+    if (lower)
+    {
+        n->lower = lower;
+        n->hash = lower->hash;
+    }
+    else
+    {
+        n->lower = n.get();
+        n->hash = parent ? parent->hash : 0;
+        hash_combine(n->hash, std::hash<String>()(element));
+    }
+    return n.get();
+}
+
+const PathNode *PathNode::get(const String &s)
+{
+    if (s.empty())
+        return nullptr;
+
+    // no cache of parsed strings, existing nodes are found under shared lock
+    const PathNode *n = nullptr;
+    auto prev = s.begin();
+    for (auto i = s.begin(); i != s.end(); ++i)
+    {
+        if (*i == '.')
+        {
+            n = append(n, String(prev, i));
+            prev = std::next(i);
+        }
+    }
+    return append(n, String(prev, s.end()));
+}
+
+const PathNode *PathNode::get(const String &s, CheckSymbol check_symbol)
+{
+    // nodes are never freed, so bad input must not get into the table
+    for (auto c : s)
+    {
+        if (c != '.' && !check_symbol(c))
+            throw SW_RUNTIME_ERROR("Bad symbol '"s + c + "' in path: '" + s + "'");
+    }
+    auto n = get(s);
+    if (n)
+        n->checked = check_symbol;
+    return n;
+}
+
+String PathNode::toString(const String &delim) const
+{
+    // filled from the end
+    auto sz = (size - 1) * delim.size();
+    for (auto n = this; n; n = n->parent)
+        sz += n->element.size();
+    String s(sz, 0);
+    for (auto n = this; n; n = n->parent)
+    {
+        sz -= n->element.size();
+        std::copy(n->element.begin(), n->element.end(), s.begin() + sz);
+        if (!n->parent)
+            break;
+        sz -= delim.size();
+        std::copy(delim.begin(), delim.end(), s.begin() + sz);
+    }
+    return s;
+}
+
+void PathNode::check(CheckSymbol check_symbol) const
+{
+    if (checked == check_symbol)
+        return;
+    for (auto n = this; n; n = n->parent)
+    {
+        for (auto c : n->element)
+        {
+            if (!check_symbol(c))
+                throw SW_RUNTIME_ERROR("Bad symbol '"s + c + "' in path: '" + toString(".") + "'");
+        }
+    }
+    checked = check_symbol;
+}
+
+} // namespace detail
+
 bool isValidPackagePathSymbol(int c)
 {
     return
@@ -22,11 +163,16 @@ PackagePath::PackagePath(const char *s)
 {
 }
 
-PackagePath::PackagePath(String s)
-    : Base(s, isValidPackagePathSymbol)
+static const String &check_package_path_size(const String &s)
 {
     if (s.size() > 4096)
         throw SW_RUNTIME_ERROR("Too long project path (must be <= 4096)");
+    return s;
+}
+
+PackagePath::PackagePath(String s)
+    : Base(check_package_path_size(s), isValidPackagePathSymbol)
+{
 }
 
 PackagePath::PackagePath(const PackagePath &p)
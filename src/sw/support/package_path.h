@@ -5,6 +5,10 @@
 
 #include <sw/support/hash.h>
 
+#include <algorithm>
+#include <atomic>
+#include <compare>
+
 // object path
 // users:
 // 1. package path
@@ -19,14 +23,107 @@ namespace sw
 SW_SUPPORT_API
 bool isValidPackagePathSymbol(int c);
 
+namespace detail
+{
+
+// interned path
+// nodes are never freed, so pointers to them are stable ids
+// equal spellings share the same node, lowered spelling is a node too
+// node keeps only its last element, others are taken from parents
+struct SW_SUPPORT_API PathNode
+{
+    using Elements = std::vector<String>;
+    using CheckSymbol = bool(*)(int);
+
+    const PathNode *parent = nullptr;
+    // case insensitive identity, points to itself for lowercase paths
+    const PathNode *lower = nullptr;
+    // last element, original spelling
+    String element;
+    // number of elements
+    size_t size = 0;
+    // hash of lowered elements, same value as before interning
+    size_t hash = 0;
+
+    PathNode() = default;
+    PathNode(const PathNode &) = delete;
+    PathNode &operator=(const PathNode &) = delete;
+
+    static const PathNode *get(const String &s);
+    // symbols are checked before interning
+    static const PathNode *get(const String &s, CheckSymbol);
+    static const PathNode *append(const PathNode *parent, const String &element);
+    template <class It>
+    static const PathNode *get(It b, It e)
+    {
+        const PathNode *n = nullptr;
+        for (; b != e; ++b)
+            n = append(n, *b);
+        return n;
+    }
+
+    // i-th element, paths are short
+    const String &operator[](size_t i) const
+    {
+        auto n = this;
+        while (n->size > i + 1)
+            n = n->parent;
+        return n->element;
+    }
+
+    String toString(const String &delim) const;
+
+    // check result is cached
+    void check(CheckSymbol) const;
+
+private:
+    mutable std::atomic<CheckSymbol> checked = nullptr;
+};
+
+// random access over elements of a node
+struct PathIterator
+{
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = String;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const String *;
+    using reference = const String &;
+
+    const PathNode *node = nullptr;
+    size_t i = 0;
+
+    reference operator*() const { return (*node)[i]; }
+    pointer operator->() const { return &**this; }
+    reference operator[](difference_type n) const { return (*node)[i + n]; }
+
+    PathIterator &operator++() { ++i; return *this; }
+    PathIterator operator++(int) { auto t = *this; ++i; return t; }
+    PathIterator &operator--() { --i; return *this; }
+    PathIterator operator--(int) { auto t = *this; --i; return t; }
+    PathIterator &operator+=(difference_type n) { i += n; return *this; }
+    PathIterator &operator-=(difference_type n) { i -= n; return *this; }
+    PathIterator operator+(difference_type n) const { return { node, i + n }; }
+    PathIterator operator-(difference_type n) const { return { node, i - n }; }
+    friend PathIterator operator+(difference_type n, const PathIterator &it) { return it + n; }
+    difference_type operator-(const PathIterator &rhs) const { return (difference_type)i - (difference_type)rhs.i; }
+
+    bool operator==(const PathIterator &rhs) const { return i == rhs.i; }
+    auto operator<=>(const PathIterator &rhs) const { return i <=> rhs.i; }
+};
+
+} // namespace detail
+
+// copying, hashing and comparison for equality are O(1)
 template <class ThisType, class PathElement = std::string, bool CaseSensitive = false>
 struct PathBase
 {
-    using Base = std::vector<PathElement>;
+    static_assert(std::is_same_v<PathElement, String>, "only string paths are interned");
+
+    using Base = detail::PathNode::Elements;
     using value_type = PathElement;
     using element_type = typename PathElement::value_type;
-    using iterator = typename Base::iterator;
-    using const_iterator = typename Base::const_iterator;
+    using iterator = detail::PathIterator;
+    using const_iterator = detail::PathIterator;
 
     using CheckSymbol = bool(*)(int);
 
@@ -39,51 +136,42 @@ struct PathBase
     }
 
     PathBase(PathElement s, CheckSymbol check_symbol = nullptr)
+        : node(check_symbol ? detail::PathNode::get(s, check_symbol) : detail::PathNode::get(s))
     {
-        auto prev = s.begin();
-        for (auto i = s.begin(); i != s.end(); ++i)
-        {
-            auto &c = *i;
-            if (check_symbol && !check_symbol(c))
-                throw SW_RUNTIME_ERROR("Bad symbol '"s + c + "' in path: '" + s + "'");
-            if (c == '.')
-            {
-                data.emplace_back(prev, i);
-                prev = std::next(i);
-            }
-        }
-        if (!s.empty())
-            data.emplace_back(prev, s.end());
     }
 
     PathBase(const PathBase &p)
-        : data(p.data)
+        : node(p.node)
+    {
+    }
+
+    // not a copy constructor, so it is inherited
+    PathBase(const PathBase &p, CheckSymbol check_symbol)
+        : node(p.node)
     {
+        if (node && check_symbol)
+            node->check(check_symbol);
     }
 
     PathElement toString(const PathElement &delim = ".") const
     {
-        PathElement p;
         if (empty())
-            return p;
-        for (auto &e : *this)
-            p += e + delim;
-        p.resize(p.size() - delim.size());
-        return p;
+            return {};
+        return node->toString(delim);
     }
 
     PathElement toStringLower(const PathElement &delim = ".") const
     {
-        auto s = toString(delim);
-        std::transform(s.begin(), s.end(), s.begin(), ::tolower);
-        return s;
+        if (empty())
+            return {};
+        return from_node(node->lower).toString(delim);
     }
 
     ThisType parent() const
     {
         if (empty())
             return {};
-        return { begin(), end() - 1 };
+        return from_node(node->parent);
     }
 
     ThisType slice(int start, int end = -1) const
@@ -94,51 +182,43 @@ struct PathBase
             return ThisType(PathBase{ begin() + start, begin() + end });
     }
 
-    auto empty() const { return data.empty(); }
-    auto size() const { return data.size(); }
-    auto back() const { return data.back(); }
-    auto front() const { return data.front(); }
-    auto clear() { return data.clear(); }
+    bool empty() const { return !node; }
+    size_t size() const { return node ? node->size : 0; }
+    auto back() const { return node->element; }
+    auto front() const { return (*node)[0]; }
+    void clear() { node = nullptr; }
 
     bool operator==(const PathBase &rhs) const
     {
         if constexpr (!CaseSensitive)
-        {
-            return std::equal(begin(), end(), rhs.begin(), rhs.end(), [](const auto &s1, const auto &s2) {
-                return std::equal(s1.begin(), s1.end(), s2.begin(), s2.end(), [](const auto &c1, const auto &c2) {
-                    return tolower(c1) == tolower(c2);
-                });
-            });
-        }
+            return get_lower() == rhs.get_lower();
         else
-            return std::operator==(*this, rhs);
+            return node == rhs.node;
     }
 
     bool operator<(const PathBase &rhs) const
     {
+        if (operator==(rhs))
+            return false;
+        // ids are not ordered, keep stable (alphabetical) order of maps and outputs
+        auto n1 = node, n2 = rhs.node;
         if constexpr (!CaseSensitive)
-        {
-            return std::lexicographical_compare(begin(), end(), rhs.begin(), rhs.end(), [](const auto &s1, const auto &s2) {
-                return std::lexicographical_compare(s1.begin(), s1.end(), s2.begin(), s2.end(), [](const auto &c1, const auto &c2) {
-                    return tolower(c1) < tolower(c2);
-                });
-            });
-        }
-        else
-            return std::operator<(*this, rhs);
+            n1 = get_lower(), n2 = rhs.get_lower();
+        return std::lexicographical_compare(begin(n1), end(n1), begin(n2), end(n2));
     }
 
     ThisType &operator=(const ThisType &s)
     {
-        data.operator=(s.data);
+        node = s.node;
         return (ThisType &)*this;
     }
 
     ThisType operator/(const ThisType &e) const
     {
-        ThisType tmp = (ThisType&)*this;
-        tmp.insert(tmp.end(), e.begin(), e.end());
-        return tmp;
+        auto n = node;
+        for (auto &v : e)
+            n = detail::PathNode::append(n, v);
+        return from_node(n);
     }
 
     ThisType &operator/=(const ThisType &e)
@@ -151,31 +231,43 @@ struct PathBase
         return toString();
     }
 
-    const_iterator begin() const { return data.begin(); }
-    const_iterator end() const { return data.end(); }
+    const_iterator begin() const { return begin(node); }
+    const_iterator end() const { return end(node); }
 
     size_t hash() const
     {
-        size_t h = 0;
-        for (const auto &e : *this)
-        {
-            auto lower = e;
-            std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
-            hash_combine(h, std::hash<PathElement>()(lower));
-        }
-        return h;
+        return node ? node->hash : 0;
     }
 
 protected:
-    PathBase(const_iterator b, const_iterator e) : data(b, e) {}
-    void insert(const_iterator w, const_iterator b, const_iterator e) { data.insert(w, b, e); }
-    void assign(const_iterator b, const_iterator e) { data.assign(b, e); }
-    void push_back(const value_type &t) { data.push_back(t); }
-    value_type &operator[](int i) { return data[i]; }
-    const value_type &operator[](int i) const { return data[i]; }
+    PathBase(const_iterator b, const_iterator e) : node(detail::PathNode::get(b, e)) {}
+    void insert(const_iterator w, const_iterator b, const_iterator e)
+    {
+        Base v(begin(), end());
+        v.insert(v.begin() + (w - begin()), b, e);
+        node = detail::PathNode::get(v.begin(), v.end());
+    }
+    void assign(const_iterator b, const_iterator e) { node = detail::PathNode::get(b, e); }
+    void push_back(const value_type &t) { node = detail::PathNode::append(node, t); }
+    const value_type &operator[](int i) const { return (*node)[i]; }
 
 private:
-    std::vector<PathElement> data;
+    const detail::PathNode *node = nullptr;
+
+    static const_iterator begin(const detail::PathNode *n) { return { n, 0 }; }
+    static const_iterator end(const detail::PathNode *n) { return { n, n ? n->size : 0 }; }
+
+    const detail::PathNode *get_lower() const
+    {
+        return node ? node->lower : nullptr;
+    }
+
+    static ThisType from_node(const detail::PathNode *n)
+    {
+        ThisType t;
+        ((PathBase &)t).node = n;
+        return t;
+    }
 };
 
 // able to split input on addition operations
@@ -251,7 +343,6 @@ struct SW_SUPPORT_API PackagePath : SecureSplitablePath<PackagePath>
 #undef PACKAGE_PATH
 
 private:
-    value_type &operator[](int i) { return Base::operator[](i); }
     const value_type &operator[](int i) const { return Base::operator[](i); }
 };
 
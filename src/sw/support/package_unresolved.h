@@ -25,7 +25,7 @@ struct SW_SUPPORT_API UnresolvedPackage
 
     UnresolvedPackage &operator=(const String &s);
 
-    PackagePath getPath() const { return ppath; }
+    const PackagePath &getPath() const { return ppath; }
     VersionRange getRange() const { return range; }
 
     std::optional<PackageId> toPackageId() const;
@@ -5,19 +5,63 @@
 
 #include "package_id.h"
 
+#include <atomic>
+#include <optional>
 #include <type_traits>
 
 namespace sw
 {
 
+namespace detail
+{
+
+// keeps its package id, so map iterators can return references
+// id is created once on first request and never changes
+template <class T>
+struct PackageVersionMapEntry : T
+{
+    using T::T;
+
+    PackageVersionMapEntry() = default;
+    PackageVersionMapEntry(const T &rhs) : T(rhs) {}
+    PackageVersionMapEntry(T &&rhs) : T(std::move(rhs)) {}
+    // id belongs to the position in the map, not to the value
+    PackageVersionMapEntry(const PackageVersionMapEntry &rhs) : T(rhs) {}
+    PackageVersionMapEntry(PackageVersionMapEntry &&rhs) : T(std::move(rhs)) {}
+    ~PackageVersionMapEntry() { delete id.load(); }
+
+    PackageVersionMapEntry &operator=(const PackageVersionMapEntry &rhs) { T::operator=(rhs); return *this; }
+    PackageVersionMapEntry &operator=(PackageVersionMapEntry &&rhs) { T::operator=(std::move(rhs)); return *this; }
+    PackageVersionMapEntry &operator=(const T &rhs) { T::operator=(rhs); return *this; }
+    PackageVersionMapEntry &operator=(T &&rhs) { T::operator=(std::move(rhs)); return *this; }
+
+    const PackageId &getPackageId(const PackagePath &p, const Version &v) const
+    {
+        if (auto i = id.load(std::memory_order_acquire))
+            return *i;
+        // const iteration may happen from several threads
+        auto n = new PackageId(p, v);
+        const PackageId *expected = nullptr;
+        if (id.compare_exchange_strong(expected, n, std::memory_order_acq_rel))
+            return *n;
+        delete n;
+        return *expected;
+    }
+
+private:
+    mutable std::atomic<const PackageId *> id = nullptr;
+};
+
+} // namespace detail
+
 template <
     class T,
     template <class ...> class PackagePathMap,
     template <class ...> class VersionMap
 >
-struct PackageVersionMapBase : PackagePathMap<PackagePath, VersionMap<T>>
+struct PackageVersionMapBase : PackagePathMap<PackagePath, VersionMap<detail::PackageVersionMapEntry<T>>>
 {
-    using version_map_type = VersionMap<T>;
+    using version_map_type = VersionMap<detail::PackageVersionMapEntry<T>>;
     using Base = PackagePathMap<PackagePath, version_map_type>;
     using This = PackageVersionMapBase;
 
@@ -31,7 +75,8 @@ struct PackageVersionMapBase : PackagePathMap<PackagePath, VersionMap<T>>
         using cond_iterator_t = cond_t<typename T2::const_iterator, typename F::iterator>;
 
         using reference = cond_t<const T&, T&>;
-        using value_type = std::pair<const PackageId, reference>;
+        // references into the map, no copies
+        using value_type = std::pair<const PackageId &, reference>;
 
         using base_iterator = cond_iterator_t<typename U::Base, typename U::Base>;
         using vm_iterator = cond_iterator_t<typename U::version_map_type, typename U::version_map_type>;
@@ -39,7 +84,7 @@ struct PackageVersionMapBase : PackagePathMap<PackagePath, VersionMap<T>>
         U *t;
         base_iterator p;
         vm_iterator v;
-        std::unique_ptr<value_type> ptr;
+        std::optional<value_type> value;
 
         Iterator(U &in)
             : t(&in)
@@ -69,11 +114,26 @@ struct PackageVersionMapBase : PackagePathMap<PackagePath, VersionMap<T>>
                 move_to_next(true);
         }
 
-        value_type &operator*() { return *ptr; }
-        const value_type &operator*() const { return *ptr; }
+        Iterator(const Iterator &rhs)
+            : t(rhs.t), p(rhs.p), v(rhs.v)
+        {
+            set_value();
+        }
 
-        auto operator->() { return ptr.get(); }
-        auto operator->() const { return ptr.get(); }
+        Iterator &operator=(const Iterator &rhs)
+        {
+            t = rhs.t;
+            p = rhs.p;
+            v = rhs.v;
+            set_value();
+            return *this;
+        }
+
+        value_type &operator*() { return *value; }
+        const value_type &operator*() const { return *value; }
+
+        auto operator->() { return &*value; }
+        auto operator->() const { return &*value; }
 
         bool operator==(const Iterator &rhs) const
         {
@@ -94,10 +154,12 @@ struct PackageVersionMapBase : PackagePathMap<PackagePath, VersionMap<T>>
         }
 
     private:
-        void set_ptr()
+        void set_value()
         {
-            if (v != p->second.end())
-                ptr = std::make_unique<value_type>(PackageId{ p->first, v->first }, v->second);
+            if (p == t->Base::end() || v == p->second.end())
+                value.reset();
+            else
+                value.emplace(v->second.getPackageId(p->first, v->first), v->second);
         }
 
         void move_to_next(bool init = false)
@@ -106,7 +168,7 @@ struct PackageVersionMapBase : PackagePathMap<PackagePath, VersionMap<T>>
             {
                 if (p == t->Base::end())
                 {
-                    ptr.reset();
+                    value.reset();
                     return;
                 }
                 if (v == p->second.end())
@@ -121,7 +183,7 @@ struct PackageVersionMapBase : PackagePathMap<PackagePath, VersionMap<T>>
                     ++v;
                 }
                 if (v != p->second.end())
-                    return set_ptr();
+                    return set_value();
             }
         }
     };
@@ -161,13 +223,10 @@ struct PackageVersionMapBase : PackagePathMap<PackagePath, VersionMap<T>>
         auto ip = find(u.getPath());
         if (ip == end(u.getPath()))
             return end();
-        VersionSet versions;
-        for (const auto &[v, t] : ip->second)
-            versions.insert(v);
-        auto v = u.range.getMaxSatisfyingVersion(versions);
-        if (!v)
+        auto iv = findMaxSatisfyingVersion(ip->second, u.range);
+        if (iv == ip->second.end())
             return end();
-        return { *this, ip, ip->second.find(v.value()) };
+        return { *this, ip, iv };
     }
 
     const_iterator find(const UnresolvedPackage &u) const
@@ -175,13 +234,28 @@ struct PackageVersionMapBase : PackagePathMap<PackagePath, VersionMap<T>>
         auto ip = find(u.getPath());
         if (ip == end(u.getPath()))
             return end();
-        VersionSet versions;
-        for (const auto &[v, t] : ip->second)
-            versions.insert(v);
-        auto v = u.range.getMaxSatisfyingVersion(versions);
-        if (!v)
+        auto iv = findMaxSatisfyingVersion(ip->second, u.range);
+        if (iv == ip->second.end())
             return end();
-        return { *this, ip, ip->second.find(v.value()) };
+        return { *this, ip, iv };
+    }
+
+    // same policy as VersionRange::getMaxSatisfyingVersion(), but without building VersionSet
+    template <class VM>
+    static auto findMaxSatisfyingVersion(VM &vm, const VersionRange &r)
+    {
+        // releases first
+        for (auto i = vm.rbegin_releases(); i != vm.rend_releases(); ++i)
+        {
+            if (r.hasVersion(i->first))
+                return vm.find(i->first);
+        }
+        for (auto i = vm.rbegin(); i != vm.rend(); ++i)
+        {
+            if (r.hasVersion(i->first))
+                return vm.find(i->first);
+        }
+        return vm.end();
     }
 
     auto erase(const PackageId &pkg)
@@ -213,7 +287,9 @@ struct PackageVersionMapBase : PackagePathMap<PackagePath, VersionMap<T>>
     auto emplace(const PackageId &pkg, const T &val)
     {
         auto &v = ((PackageVersionMapBase*)this)->operator[](pkg.getPath());
-        return v.emplace(pkg.getVersion(), val);
+        auto r = v.emplace(pkg.getVersion(), val);
+        r.first->second.getPackageId(pkg.getPath(), pkg.getVersion());
+        return r;
     }
 
     version_map_type &operator[](const PackagePath &p)
@@ -223,7 +299,9 @@ struct PackageVersionMapBase : PackagePathMap<PackagePath, VersionMap<T>>
 
     T &operator[](const PackageId &pkg)
     {
-        return Base::operator[](pkg.getPath())[pkg.getVersion()];
+        auto &e = Base::operator[](pkg.getPath())[pkg.getVersion()];
+        e.getPackageId(pkg.getPath(), pkg.getVersion());
+        return e;
     }
 
     iterator begin()
@@ -20,6 +20,11 @@
     template <class Archive>             \
     void serialize(Archive &ar, t &v, const unsigned) {
 
+// class version is available as 'version'
+#define SERIALIZATION_BEGIN_SERIALIZE_VERSIONED(t) \
+    template <class Archive>                       \
+    void serialize(Archive &ar, t &v, const unsigned version) {
+
 #define SERIALIZATION_BEGIN_LOAD(t) \
     template <class Archive>        \
     void load(Archive &ar, t &v, const unsigned) {
@@ -41,6 +46,10 @@
     SERIALIZATION_BEGIN             \
     SERIALIZATION_BEGIN_SERIALIZE(SERIALIZATION_TYPE)
 
+#define SERIALIZATION_BEGIN_UNIFIED_VERSIONED \
+    SERIALIZATION_BEGIN                       \
+    SERIALIZATION_BEGIN_SERIALIZE_VERSIONED(SERIALIZATION_TYPE)
+
 #define SERIALIZATION_END }
 #define SERIALIZATION_SPLIT_CONTINUE } SERIALIZATION_BEGIN_SAVE(SERIALIZATION_TYPE)
 #define SERIALIZATION_SPLIT_END } SERIALIZATION_END
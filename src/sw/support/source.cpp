@@ -8,8 +8,18 @@
 #include <nlohmann/json.hpp>
 #include <primitives/date_time.h>
 #include <primitives/exceptions.h>
+#include <primitives/http.h>
+#include <primitives/templates.h>
 #include <primitives/yaml.h>
 
+#include <curl/curl.h>
+
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+
 #include <primitives/log.h>
 DECLARE_STATIC_LOGGER(logger, "source");
 
@@ -51,32 +61,279 @@ void detail::DownloadData::remove() const
     fs::remove(stamp_file);
 }
 
-bool download(Executor &e, const std::unordered_set<SourcePtr> &sset, SourceDirMap &source_dirs, const SourceDownloadOptions &opts)
+namespace
+{
+
+struct Cancelled : std::runtime_error
+{
+    Cancelled() : std::runtime_error("Download was cancelled") {}
+};
+
+String get_url(const Source &s)
+{
+    if (auto g = dynamic_cast<const primitives::source::Git *>(&s))
+        return g->url;
+    if (auto r = dynamic_cast<const RemoteFile *>(&s))
+        return r->url;
+    return {};
+}
+
+String get_host(const String &url)
+{
+    auto b = url.find("://");
+    if (b == url.npos)
+        return {};
+    b += 3;
+    return url.substr(b, url.find_first_of("/:", b) - b);
+}
+
+// limits simultaneous connections to a single host
+struct HostSlots
+{
+    int limit;
+    std::mutex m;
+    std::condition_variable cv;
+    std::unordered_map<String, int> active;
+
+    struct Slot
+    {
+        HostSlots &hs;
+        String host;
+
+        ~Slot()
+        {
+            {
+                std::unique_lock lk(hs.m);
+                --hs.active[host];
+            }
+            hs.cv.notify_all();
+        }
+    };
+
+    Slot acquire(const String &host, const SourceDownloadOptions &opts)
+    {
+        std::unique_lock lk(m);
+        while (active[host] >= limit)
+        {
+            if (opts.cancelled && opts.cancelled())
+                throw Cancelled();
+            cv.wait_for(lk, std::chrono::milliseconds(200));
+        }
+        ++active[host];
+        return { *this, host };
+    }
+};
+
+struct TransferState
 {
+    const String &url;
+    const SourceDownloadOptions &opts;
+    CURL *curl;
+    std::ofstream &ofile;
+    const path &part;
+    curl_off_t offset;
+    bool range_checked = false;
+    std::chrono::steady_clock::time_point last_report = std::chrono::steady_clock::now();
+};
+
+size_t write_callback(char *data, size_t size, size_t nmemb, void *userp)
+{
+    auto &s = *(TransferState *)userp;
+    if (!s.range_checked)
+    {
+        s.range_checked = true;
+        long code = 0;
+        curl_easy_getinfo(s.curl, CURLINFO_RESPONSE_CODE, &code);
+        // server ignored our range, start from scratch
+        if (s.offset && code == 200)
+        {
+            s.ofile.close();
+            s.ofile.open(s.part, std::ios::binary | std::ios::trunc);
+            s.offset = 0;
+        }
+    }
+    s.ofile.write(data, size * nmemb);
+    return s.ofile ? size * nmemb : 0;
+}
+
+int progress_callback(void *userp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t, curl_off_t)
+{
+    auto &s = *(TransferState *)userp;
+    if (s.opts.cancelled && s.opts.cancelled())
+        return 1;
+    auto now = std::chrono::steady_clock::now();
+    if (dltotal && now - s.last_report > std::chrono::seconds(5))
+    {
+        s.last_report = now;
+        constexpr double mb = 1024 * 1024;
+        LOG_INFO(logger, "Downloading " << s.url << ": "
+            << std::fixed << std::setprecision(1) << (s.offset + dlnow) / mb << "/" << (s.offset + dltotal) / mb << " MB");
+    }
+    return 0;
+}
+
+// continues download into fn.part left by previous attempts
+void download_resumable(const String &url, const path &fn, const SourceDownloadOptions &opts)
+{
+    auto part = path(fn) += ".part";
+    fs::create_directories(fn.parent_path());
+    curl_off_t offset = fs::exists(part) ? fs::file_size(part) : 0;
+    std::ofstream ofile(part, std::ios::binary | std::ios::app);
+    if (!ofile)
+        throw SW_RUNTIME_ERROR("Cannot open file: " + to_string(part));
+
+    auto curl = curl_easy_init();
+    if (!curl)
+        throw SW_RUNTIME_ERROR("Cannot init curl");
+    SCOPE_EXIT
+    {
+        curl_easy_cleanup(curl);
+    };
+    TransferState s{ url, opts, curl, ofile, part, offset };
+
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30L);
+    // abort stuck transfers, retry will continue them
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 60L);
+    curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, offset);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &s);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, progress_callback);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &s);
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, httpSettings.verbose ? 1L : 0L);
+    if (!httpSettings.proxy.host.empty())
+    {
+        curl_easy_setopt(curl, CURLOPT_PROXY, httpSettings.proxy.host.c_str());
+        if (!httpSettings.proxy.user.empty())
+            curl_easy_setopt(curl, CURLOPT_PROXYUSERPWD, httpSettings.proxy.user.c_str());
+    }
+    if (httpSettings.ignore_ssl_checks)
+    {
+        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    }
+    auto ca = get_ca_certs_filename();
+    if (fs::exists(ca))
+        curl_easy_setopt(curl, CURLOPT_CAINFO, to_string(ca).c_str());
+
+    LOG_TRACE(logger, "Downloading " << url << (offset ? " from offset " + std::to_string(offset) : String{}));
+    auto r = curl_easy_perform(curl);
+    ofile.close();
+    if (r == CURLE_ABORTED_BY_CALLBACK)
+        throw Cancelled();
+    if (r == CURLE_HTTP_RETURNED_ERROR)
+    {
+        long code = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+        // broken partial file
+        if (code == 416)
+            fs::remove(part);
+        throw SW_RUNTIME_ERROR("Cannot download " + url + ": http " + std::to_string(code));
+    }
+    if (r != CURLE_OK)
+        throw SW_RUNTIME_ERROR("Cannot download " + url + ": " + curl_easy_strerror(r));
+    fs::rename(part, fn);
+}
+
+void download_source(Source &src, const path &root_dir, const SourceDownloadOptions &opts)
+{
+    auto g = dynamic_cast<primitives::source::Git *>(&src);
+    if (g && !g->tag.empty()) {
+        g->tryVTagPrefixDuringDownload();
+    }
+
+    auto r = dynamic_cast<RemoteFile *>(&src);
+    if (!r || !(r->url.starts_with("http://") || r->url.starts_with("https://")))
+    {
+        src.download(root_dir);
+        return;
+    }
+
+    // fetch the file ourselves with resume support,
+    // then let the source process (unpack) local copy as usual
+    auto dl_dir = path(root_dir) += ".dl";
+    auto fn = dl_dir / path(r->url.substr(0, r->url.find_first_of("?#"))).filename();
+    if (!fs::exists(fn))
+        download_resumable(r->url, fn, opts);
+    RemoteFile local("file://" + to_string(normalize_path(fn)));
+    try
+    {
+        local.download(root_dir);
+    }
+    catch (std::exception &)
+    {
+        // complete but broken (truncated, corrupted) file, next attempt downloads it again
+        fs::remove_all(dl_dir);
+        throw;
+    }
+    fs::remove_all(dl_dir);
+}
+
+} // namespace
+
+bool download(const std::unordered_set<SourcePtr> &sset, SourceDirMap &source_dirs, const SourceDownloadOptions &opts)
+{
+    auto is_cancelled = [&opts]() { return opts.cancelled && opts.cancelled(); };
+
     std::atomic_bool downloaded = false;
+    std::atomic_int ndownloaded = 0;
+    HostSlots hosts{ std::max(opts.max_connections_per_host, 1) };
+    // dedicated threads, downloads are mostly waiting
+    Executor e(std::max(opts.max_connections, 1));
     Futures<void> fs;
     for (auto &src : sset)
     {
-        fs.push_back(e.push([src = src.get(), &d = source_dirs[src->getHash()], &opts, &downloaded]
+        fs.push_back(e.push([src = src.get(), &d = source_dirs[src->getHash()], &opts, &downloaded, &ndownloaded, &hosts, &is_cancelled, n = sset.size()]
             {
                 auto &t = d.stamp_file;
                 t = d.root_dir;
                 t += ".stamp";
 
-                auto dl = [&src, d, &t, &downloaded]()
+                auto dl = [&]()
                 {
                     downloaded = true;
                     LOG_INFO(logger, "Downloading source:\n" << src->print());
-                    auto g = dynamic_cast<primitives::source::Git *>(src);
-                    if (g && !g->tag.empty()) {
-                        g->tryVTagPrefixDuringDownload();
+                    auto delay = opts.retry_delay;
+                    for (int attempt = 0;; attempt++)
+                    {
+                        if (is_cancelled())
+                            throw Cancelled();
+                        try
+                        {
+                            auto slot = hosts.acquire(get_host(get_url(*src)), opts);
+                            download_source(*src, d.root_dir, opts);
+                            break;
+                        }
+                        catch (Cancelled &)
+                        {
+                            throw;
+                        }
+                        catch (std::exception &e)
+                        {
+                            if (attempt >= opts.retries)
+                                throw;
+                            LOG_WARN(logger, "Download failed: " << e.what() << ". Retrying in " << delay.count() << " ms");
+                            // partial http downloads are kept near root dir
+                            fs::remove_all(d.root_dir);
+                            for (auto end = std::chrono::steady_clock::now() + delay; std::chrono::steady_clock::now() < end;)
+                            {
+                                if (is_cancelled())
+                                    throw Cancelled();
+                                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                            }
+                            delay *= 2;
+                        }
                     }
-                    src->download(d.root_dir);
                     write_file(t, timepoint2string(getUtc()));
                     // save real source
                     nlohmann::json j;
                     src->save(j);
                     write_file(d.getRealSourceJsonFile(), j.dump());
+                    LOG_INFO(logger, "[" << ++ndownloaded << "/" << n << "] Downloaded " << src->print());
                 };
 
                 if (!fs::exists(d.root_dir))
@@ -119,12 +376,12 @@ bool download(Executor &e, const std::unordered_set<SourcePtr> &sset, SourceDirM
     return downloaded;
 }
 
-SourceDirMap download(Executor &e, const std::unordered_set<SourcePtr> &sset, const SourceDownloadOptions &opts)
+SourceDirMap download(const std::unordered_set<SourcePtr> &sset, const SourceDownloadOptions &opts)
 {
     SourceDirMap sources;
     for (auto &s : sset)
         sources[s->getHash()].root_dir = opts.root_dir.empty() ? get_temp_filename("dl") : (opts.root_dir / s->getHash());
-    download(e, sset, sources, opts);
+    download(sset, sources, opts);
     return sources;
 }
 
@@ -7,6 +7,8 @@
 
 #include <primitives/executor.h>
 
+#include <functional>
+
 namespace sw
 {
 
@@ -73,14 +75,23 @@ struct SourceDownloadOptions
     bool ignore_existing_dirs = false;
     std::chrono::seconds existing_dirs_age{ 0 };
     bool adjust_root_dir = true;
+
+    // downloads run on their own threads, not on cpu bound executors
+    int max_connections = 8;
+    int max_connections_per_host = 2;
+    int retries = 3;
+    // doubled after every failed attempt
+    std::chrono::milliseconds retry_delay{ 1000 };
+    // checked between attempts and during http transfers
+    std::function<bool()> cancelled;
 };
 
 // returns true if downloaded
 SW_SUPPORT_API
-bool download(Executor &, const std::unordered_set<SourcePtr> &sources, SourceDirMap &source_dirs, const SourceDownloadOptions &opts = {});
+bool download(const std::unordered_set<SourcePtr> &sources, SourceDirMap &source_dirs, const SourceDownloadOptions &opts = {});
 
 SW_SUPPORT_API
-SourceDirMap download(Executor &, const std::unordered_set<SourcePtr> &sources, const SourceDownloadOptions &opts = {});
+SourceDirMap download(const std::unordered_set<SourcePtr> &sources, const SourceDownloadOptions &opts = {});
 
 } // namespace support
 
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: MPL-2.0
 
 //DIR(arh) // archive storage (mirrors etc.)?
+DIR(blb) // content addressed blobs of packed files
 //DIR(bin) // files are moved to pkg dir
 //DIR(cfg) // moved to etc/sw/checks
 //DIR(dat)
@@ -4,5 +4,6 @@ public class App
     {
         var hw = new HelloWorld();
         hw.print();
+        new Greeter().greeter().run();
     }
 }
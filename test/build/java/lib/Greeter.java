@@ -0,0 +1,12 @@
+public class Greeter {
+   public static class Message {
+      public String text() { return "Hello from nested class"; }
+   }
+
+   public Runnable greeter() {
+      // anonymous class produces Greeter$1.class
+      return new Runnable() {
+         public void run() { System.out.println(new Message().text()); }
+      };
+   }
+}
@@ -1,5 +1,10 @@
 void build(Solution &s)
 {
+    auto &lib = s.addTarget<JavaTarget>("lib.java");
+    lib += "lib/.*\\.java"_r;
+
     auto &j = s.addTarget<JavaExecutable>("main.java");
     j += ".*\\.java"_r;
+    j -= "lib/.*\\.java"_r;
+    j += lib;
 }
@@ -0,0 +1,82 @@
+#include "files.h"
+
+#include <sw/manager/blob_store.h>
+
+#define CATCH_CONFIG_RUNNER
+#include <catch2/catch.hpp>
+
+using namespace sw;
+
+TEST_CASE("Checking content addressed packs", "[blob_store]")
+{
+    TempDirectory d("blob_store");
+    auto src = d / "src";
+    write(src / "a.cpp", "a");
+    write(src / "b.cpp", "b");
+    write(src / "inc" / "b.h", "b");
+
+    BlobStore local(d / "local");
+    BlobStore remote(d / "remote" / "blobs");
+
+    std::map<path, path> files;
+    files[src / "a.cpp"] = "a.cpp";
+    files[src / "b.cpp"] = "b.cpp";
+    files[src / "inc" / "b.h"] = "inc/b.h";
+
+    // same content is stored once
+    auto m1 = PackManifest::create(files, local);
+    CHECK(m1.files.size() == 3);
+    CHECK(m1.files["b.cpp"].hash == m1.files["inc/b.h"].hash);
+    CHECK(m1.push(local, remote) == 2);
+    CHECK(m1.push(local, remote) == 0);
+
+    // next version sends only changed file
+    write(src / "a.cpp", "a2");
+    auto m2 = PackManifest::create(files, local);
+    CHECK(m2.files["a.cpp"].hash != m1.files["a.cpp"].hash);
+    CHECK(m2.files["b.cpp"].hash == m1.files["b.cpp"].hash);
+    CHECK(m2.push(local, remote) == 1);
+
+    // manifest round trip
+    m2.blobs = to_string(remote.getRoot());
+    auto fn = d / "1-pkg.swpack";
+    m2.save(fn);
+    CHECK(PackManifest::isManifest(fn));
+    write(d / "archive.tar.gz", "\x1f\x8b");
+    CHECK_FALSE(PackManifest::isManifest(d / "archive.tar.gz"));
+    auto m3 = PackManifest::load(fn);
+    CHECK(m3.files.size() == 3);
+    CHECK(m3.blobs == m2.blobs);
+
+    // empty store gets blobs from remote
+    BlobStore shared(d / "shared");
+    m3.unpack(shared, d / "out");
+    CHECK(read(d / "out" / "a.cpp") == "a2");
+    CHECK(read(d / "out" / "inc" / "b.h") == "b");
+    CHECK(shared.contains(m3.files["a.cpp"].hash));
+
+    // no source for missing blobs
+    m3.blobs.clear();
+    BlobStore empty(d / "empty");
+    CHECK_THROWS(m3.unpack(empty, d / "out2"));
+
+    // paths outside of destination
+    write(d / "bad.swpack", R"({"type":"sw.pack.manifest","version":1,"files":[{"path":"../x","hash":"abc","size":1}]})");
+    CHECK_THROWS(PackManifest::load(d / "bad.swpack"));
+    write(d / "bad.swpack", R"({"type":"sw.pack.manifest","version":1,"files":[{"path":"/x","hash":")" + m1.files["a.cpp"].hash + R"(","size":1}]})");
+    CHECK_THROWS(PackManifest::load(d / "bad.swpack"));
+
+    // hashes are paths inside of the store
+    write(d / "bad.swpack", R"({"type":"sw.pack.manifest","version":1,"files":[{"path":"x","hash":"../../x","size":1}]})");
+    CHECK_THROWS(PackManifest::load(d / "bad.swpack"));
+    CHECK_THROWS(BlobStore::getRelativePath("../../x"));
+    CHECK_THROWS(BlobStore::getRelativePath(String(m1.files["a.cpp"].hash.size(), 'A')));
+    CHECK_NOTHROW(BlobStore::getRelativePath(m1.files["a.cpp"].hash));
+}
+
+int main(int argc, char **argv)
+{
+    Catch::Session().run(argc, argv);
+
+    return 0;
+}
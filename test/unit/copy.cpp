@@ -0,0 +1,133 @@
+#include "files.h"
+
+#include <sw/support/filesystem.h>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#define CATCH_CONFIG_RUNNER
+#include <catch2/catch.hpp>
+
+using namespace sw::support;
+
+// changes of one file must not be visible in the other
+static void check_independent(const path &from, const path &to)
+{
+    CHECK(fs::hard_link_count(to) == 1);
+    write(to, "changed");
+    CHECK(read(from) == "data");
+}
+
+TEST_CASE("Checking copy strategies", "[copy]")
+{
+    TempDirectory d("copy");
+    auto from = d / "from";
+    auto to = d / "to";
+    write(from, "data");
+
+    SECTION("copy")
+    {
+        CHECK(copy_file_fast(from, to, CopyStrategy::Copy, true) == CopyMethod::Copy);
+        CHECK(read(to) == "data");
+        check_independent(from, to);
+    }
+
+    SECTION("hardlink")
+    {
+        CHECK(copy_file_fast(from, to, CopyStrategy::Hardlink, true) == CopyMethod::Hardlink);
+        CHECK(read(to) == "data");
+        CHECK(fs::hard_link_count(from) == 2);
+
+        // copy over the link must not write into the source
+        CHECK(copy_file_fast(from, to, CopyStrategy::Copy) == CopyMethod::Copy);
+        CHECK(fs::hard_link_count(from) == 1);
+        check_independent(from, to);
+    }
+
+    SECTION("hardlink is not allowed -> copy")
+    {
+        CHECK(copy_file_fast(from, to, CopyStrategy::Hardlink) == CopyMethod::Copy);
+        check_independent(from, to);
+    }
+
+    SECTION("reflink or copy")
+    {
+        // depends on filesystem of temp dir
+        auto m = copy_file_fast(from, to, CopyStrategy::Reflink, true);
+        CHECK(m != CopyMethod::Hardlink);
+        CHECK(read(to) == "data");
+        check_independent(from, to);
+    }
+
+    SECTION("auto")
+    {
+        auto m = copy_file_fast(from, to, CopyStrategy::Auto, true);
+        CHECK(m != CopyMethod::Copy);
+        CHECK(read(to) == "data");
+
+        m = copy_file_fast(from, to, CopyStrategy::Auto);
+        CHECK(m != CopyMethod::Hardlink);
+        check_independent(from, to);
+    }
+
+    SECTION("overwrite")
+    {
+        write(to, "old");
+        copy_file_fast(from, to, CopyStrategy::Copy);
+        CHECK(read(to) == "data");
+    }
+
+    SECTION("onto itself")
+    {
+        CHECK_THROWS(copy_file_fast(from, from, CopyStrategy::Copy));
+        CHECK_THROWS(copy_file_fast(from, d / "." / "from", CopyStrategy::Hardlink, true));
+        CHECK(read(from) == "data");
+    }
+
+    SECTION("missing source")
+    {
+        CHECK_THROWS(copy_file_fast(d / "missing", to, CopyStrategy::Auto, true));
+        CHECK_FALSE(fs::exists(to));
+    }
+
+#ifndef _WIN32
+    SECTION("hardlink across filesystems -> copy")
+    {
+        path shm = "/dev/shm";
+        struct stat s1, s2;
+        if (fs::exists(shm) && stat(shm.c_str(), &s1) == 0 && stat(d.c_str(), &s2) == 0 && s1.st_dev != s2.st_dev)
+        {
+            TempDirectory d2("copy", shm);
+            auto to2 = d2 / "to";
+            CHECK(copy_file_fast(from, to2, CopyStrategy::Hardlink, true) == CopyMethod::Copy);
+            check_independent(from, to2);
+        }
+        else
+            WARN("no other filesystem to check hardlink fallback");
+    }
+#endif
+}
+
+TEST_CASE("Checking copy strategy setting", "[copy]")
+{
+    CHECK(get_copy_strategy() == CopyStrategy::Auto);
+    CHECK(parse_copy_strategy("auto") == CopyStrategy::Auto);
+    CHECK(parse_copy_strategy("reflink") == CopyStrategy::Reflink);
+    CHECK(parse_copy_strategy("hardlink") == CopyStrategy::Hardlink);
+    CHECK(parse_copy_strategy("copy") == CopyStrategy::Copy);
+    CHECK_THROWS(parse_copy_strategy("symlink"));
+
+    TempDirectory d("copy");
+    write(d / "from", "data");
+    set_copy_strategy(CopyStrategy::Copy);
+    CHECK(copy_file_fast(d / "from", d / "to", true) == CopyMethod::Copy);
+    set_copy_strategy(CopyStrategy::Auto);
+}
+
+int main(int argc, char **argv)
+{
+    Catch::Session().run(argc, argv);
+
+    return 0;
+}
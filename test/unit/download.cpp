@@ -0,0 +1,240 @@
+#include "files.h"
+
+#include <sw/support/source.h>
+
+#include <primitives/pack.h>
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define CATCH_CONFIG_RUNNER
+#include <catch2/catch.hpp>
+
+using namespace sw;
+
+// local http stand-in serving one file,
+// every request takes the next step from the script, the last one is repeated
+struct HttpServer
+{
+    enum Step
+    {
+        Ok,         // honours range requests
+        Error,      // 503
+        Truncate,   // sends half of the file and closes connection
+        Corrupt,    // complete response with broken data
+        Slow,       // waits before the answer
+    };
+
+    String data;
+    std::vector<Step> script;
+    std::chrono::milliseconds latency{ 0 };
+
+    std::mutex m;
+    Strings requests;
+
+    HttpServer(const String &data, std::vector<Step> script)
+        : data(data), script(script)
+    {
+        s = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in a{};
+        a.sin_family = AF_INET;
+        a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        REQUIRE(::bind(s, (sockaddr *)&a, sizeof(a)) == 0);
+        socklen_t len = sizeof(a);
+        ::getsockname(s, (sockaddr *)&a, &len);
+        port = ntohs(a.sin_port);
+        ::listen(s, 16);
+        t = std::thread([this] { run(); });
+    }
+
+    ~HttpServer()
+    {
+        stop = true;
+        t.join();
+        ::close(s);
+    }
+
+    String url(const String &fn) const
+    {
+        return "http://127.0.0.1:" + std::to_string(port) + "/" + fn;
+    }
+
+    size_t nrequests()
+    {
+        std::unique_lock lk(m);
+        return requests.size();
+    }
+
+private:
+    int s;
+    int port;
+    std::atomic_bool stop = false;
+    std::thread t;
+
+    void run()
+    {
+        while (!stop)
+        {
+            pollfd p{};
+            p.fd = s;
+            p.events = POLLIN;
+            if (::poll(&p, 1, 50) <= 0)
+                continue;
+            auto c = ::accept(s, nullptr, nullptr);
+            if (c == -1)
+                continue;
+            serve(c);
+            ::close(c);
+        }
+    }
+
+    void serve(int c)
+    {
+        String req;
+        char buf[4096];
+        while (req.find("\r\n\r\n") == req.npos)
+        {
+            auto r = ::read(c, buf, sizeof(buf));
+            if (r <= 0)
+                return;
+            req.append(buf, r);
+        }
+        Step step;
+        {
+            std::unique_lock lk(m);
+            step = script[std::min(requests.size(), script.size() - 1)];
+            requests.push_back(req);
+        }
+
+        size_t offset = 0;
+        if (auto p = req.find("Range: bytes="); p != req.npos)
+            offset = std::stoull(req.substr(p + 13));
+
+        auto send = [c](const String &s) { return ::write(c, s.data(), s.size()); };
+        switch (step)
+        {
+        case Error:
+            send("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            break;
+        case Truncate:
+            send("HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(data.size()) + "\r\nConnection: close\r\n\r\n");
+            send(data.substr(0, data.size() / 2));
+            break;
+        case Corrupt:
+            send("HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(data.size()) + "\r\nConnection: close\r\n\r\n");
+            send(String(data.size(), 'x'));
+            break;
+        case Slow:
+            for (auto end = std::chrono::steady_clock::now() + latency; !stop && std::chrono::steady_clock::now() < end;)
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            [[fallthrough]];
+        case Ok:
+            if (offset)
+            {
+                send("HTTP/1.1 206 Partial Content\r\nContent-Length: " + std::to_string(data.size() - offset) +
+                    "\r\nContent-Range: bytes " + std::to_string(offset) + "-" + std::to_string(data.size() - 1) + "/" + std::to_string(data.size()) +
+                    "\r\nConnection: close\r\n\r\n");
+            }
+            else
+                send("HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(data.size()) + "\r\nConnection: close\r\n\r\n");
+            send(data.substr(offset));
+            break;
+        }
+    }
+};
+
+static String make_archive(const path &d)
+{
+    String content;
+    for (int i = 0; i < 100000; i++)
+        content += std::to_string(i) + "\n";
+    write(d / "src" / "a.txt", content);
+    std::map<path, path> files;
+    files[d / "src" / "a.txt"] = "a.txt";
+    REQUIRE(pack_files(d / "a.tar.gz", files));
+    return read(d / "a.tar.gz");
+}
+
+static support::SourceDirMap download(HttpServer &srv, const path &root, support::SourceDownloadOptions opts = {})
+{
+    std::unordered_set<support::SourcePtr> sources;
+    sources.insert(std::make_unique<RemoteFile>(srv.url("a.tar.gz")));
+    opts.root_dir = root;
+    opts.adjust_root_dir = false;
+    opts.retry_delay = std::chrono::milliseconds(1);
+    return support::download(sources, opts);
+}
+
+TEST_CASE("Checking source downloads", "[download]")
+{
+    TempDirectory d("download");
+    auto data = make_archive(d);
+    auto content = read(d / "src" / "a.txt");
+
+    SECTION("retries and resume")
+    {
+        HttpServer srv(data, { HttpServer::Error, HttpServer::Truncate, HttpServer::Ok });
+        auto dirs = download(srv, d / "out");
+        REQUIRE(dirs.size() == 1);
+        CHECK(read(dirs.begin()->second.root_dir / "a.txt") == content);
+        REQUIRE(srv.nrequests() == 3);
+        // continued from the partial file
+        CHECK(srv.requests[2].find("Range: bytes=") != String::npos);
+    }
+
+    SECTION("broken archive is downloaded again")
+    {
+        HttpServer srv(data, { HttpServer::Corrupt, HttpServer::Ok });
+        auto dirs = download(srv, d / "out");
+        REQUIRE(dirs.size() == 1);
+        CHECK(read(dirs.begin()->second.root_dir / "a.txt") == content);
+        CHECK(srv.nrequests() == 2);
+        CHECK(srv.requests[1].find("Range: bytes=") == String::npos);
+    }
+
+    SECTION("broken archive is not reused by the next run")
+    {
+        HttpServer srv(data, { HttpServer::Corrupt, HttpServer::Ok });
+        support::SourceDownloadOptions opts;
+        opts.retries = 0;
+        CHECK_THROWS(download(srv, d / "out", opts));
+        // partially unpacked dir has no stamp file
+        opts.ignore_existing_dirs = true;
+        auto dirs = download(srv, d / "out", opts);
+        CHECK(read(dirs.begin()->second.root_dir / "a.txt") == content);
+        CHECK(srv.nrequests() == 2);
+    }
+
+    SECTION("retries are limited")
+    {
+        HttpServer srv(data, { HttpServer::Error });
+        support::SourceDownloadOptions opts;
+        opts.retries = 2;
+        CHECK_THROWS(download(srv, d / "out", opts));
+        CHECK(srv.nrequests() == 3);
+    }
+
+    SECTION("cancellation")
+    {
+        HttpServer srv(data, { HttpServer::Slow });
+        srv.latency = std::chrono::seconds(30);
+        auto start = std::chrono::steady_clock::now();
+        support::SourceDownloadOptions opts;
+        opts.cancelled = [start] { return std::chrono::steady_clock::now() - start > std::chrono::milliseconds(200); };
+        CHECK_THROWS(download(srv, d / "out", opts));
+        CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(10));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Catch::Session().run(argc, argv);
+
+    return 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <primitives/filesystem.h>
+
+#include <chrono>
+#include <fstream>
+
+// unique temporary directory of a test, removed on scope exit even when the test fails
+struct TempDirectory : path
+{
+    TempDirectory(const String &name, const path &base = fs::temp_directory_path())
+        : path(base / ("sw_test_" + name) / std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()))
+    {
+        fs::create_directories(*this);
+    }
+
+    TempDirectory(const TempDirectory &) = delete;
+    TempDirectory &operator=(const TempDirectory &) = delete;
+
+    ~TempDirectory()
+    {
+        error_code ec;
+        fs::remove_all(*this, ec);
+    }
+};
+
+inline void write(const path &p, const String &s)
+{
+    if (p.has_parent_path())
+        fs::create_directories(p.parent_path());
+    std::ofstream(p, std::ios::binary | std::ios::trunc) << s;
+}
+
+inline String read(const path &p)
+{
+    std::ifstream f(p, std::ios::binary);
+    return { std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>() };
+}
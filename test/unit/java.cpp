@@ -0,0 +1,132 @@
+#include "files.h"
+
+#include <sw/builder/sw_context.h>
+#include <sw/driver/java.h>
+
+#include <thread>
+
+#define CATCH_CONFIG_RUNNER
+#include <catch2/catch.hpp>
+
+using namespace sw;
+
+static void write_source(const path &p, const String &s)
+{
+    write(p, s);
+    // class files are detected by their timestamps
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+}
+
+// new command every time, commands are executed once
+// deps are output dirs of dependency targets
+static bool compile(const SwBuilderContext &ctx, const path &javac, const path &out, const FilesOrdered &sources, const FilesOrdered &deps = {})
+{
+    auto c = std::make_shared<driver::JavaCompileCommand>(ctx);
+    c->always = true;
+    c->setProgram(javac);
+    c->working_directory = out.parent_path();
+    c->arguments.push_back("-d");
+    c->arguments.push_back(normalize_path(out));
+    auto cp = to_string(normalize_path(out));
+    for (auto &d : deps)
+    {
+        cp += ":" + to_string(normalize_path(d));
+        c->addInput(driver::JavaCompileCommand::getAbiFile(d));
+    }
+    c->arguments.push_back("-cp");
+    c->arguments.push_back(cp);
+    for (auto &s : sources)
+        c->arguments.push_back(normalize_path(s));
+    c->output_dir = out;
+    c->sources = sources;
+    c->addOutput(c->getStateFile());
+    c->addOutput(c->getAbiFile());
+    try
+    {
+        c->execute();
+        return true;
+    }
+    catch (std::exception &)
+    {
+        return false;
+    }
+}
+
+TEST_CASE("Checking failed incremental java compilation", "[java]")
+{
+    auto javac = resolveExecutable("javac");
+    if (!fs::exists(javac))
+    {
+        WARN("javac is not found, test is skipped");
+        return;
+    }
+
+    TempDirectory d("java");
+    auto out = d / "out";
+    auto a = d / "A.java";
+    auto b = d / "B.java";
+    write_source(a, "public class A { public static int f() { return 1; } }");
+    write_source(b, "public class B { public int g() { return A.f(); } }");
+
+    SwBuilderContext ctx;
+    REQUIRE(compile(ctx, javac, out, { a, b }));
+    CHECK(fs::exists(out / "A.class"));
+    CHECK(fs::exists(out / "B.class"));
+
+    // api change breaks dependent, its classes are removed before the failed round
+    write_source(a, "public class A { public static String f() { return \"\"; } }");
+    CHECK_FALSE(compile(ctx, javac, out, { a, b }));
+    CHECK_FALSE(fs::exists(out / "B.class"));
+
+    // revert restores old api, dependent must be compiled anyway
+    write_source(a, "public class A { public static int f() { return 1; } }");
+    REQUIRE(compile(ctx, javac, out, { a, b }));
+    CHECK(fs::exists(out / "A.class"));
+    CHECK(fs::exists(out / "B.class"));
+}
+
+TEST_CASE("Checking api changes of java dependencies", "[java]")
+{
+    auto javac = resolveExecutable("javac");
+    if (!fs::exists(javac))
+    {
+        WARN("javac is not found, test is skipped");
+        return;
+    }
+
+    TempDirectory d("java");
+    auto lib = d / "lib";
+    auto app = d / "app";
+    auto a = d / "lib_src" / "A.java";
+    auto b = d / "app_src" / "B.java";
+    auto c = d / "app_src" / "C.java";
+    write_source(a, "public class A { public static int f() { return 1; } static int g() { return 1; } }");
+    write_source(b, "public class B { public long h() { return A.f(); } }");
+    write_source(c, "public class C { public int h() { return 2; } }");
+
+    SwBuilderContext ctx;
+    REQUIRE(compile(ctx, javac, lib, { a }));
+    REQUIRE(compile(ctx, javac, app, { b, c }, { lib }));
+    REQUIRE(read(app / "B.class").find("()I") != String::npos);
+    auto c_time = fs::last_write_time(app / "C.class");
+
+    // implementation change keeps abi file and dependents
+    auto abi_time = fs::last_write_time(driver::JavaCompileCommand::getAbiFile(lib));
+    write_source(a, "public class A { public static int f() { return 2; } static int g() { return 2; } }");
+    REQUIRE(compile(ctx, javac, lib, { a }));
+    CHECK(fs::last_write_time(driver::JavaCompileCommand::getAbiFile(lib)) == abi_time);
+
+    // api change of dependency recompiles only its users
+    write_source(a, "public class A { public static long f() { return 2; } static int g() { return 2; } }");
+    REQUIRE(compile(ctx, javac, lib, { a }));
+    REQUIRE(compile(ctx, javac, app, { b, c }, { lib }));
+    CHECK(read(app / "B.class").find("()J") != String::npos);
+    CHECK(fs::last_write_time(app / "C.class") == c_time);
+}
+
+int main(int argc, char **argv)
+{
+    Catch::Session().run(argc, argv);
+
+    return 0;
+}
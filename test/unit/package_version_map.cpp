@@ -0,0 +1,86 @@
+#include <sw/support/package_version_map.h>
+
+#define CATCH_CONFIG_RUNNER
+#include <catch2/catch.hpp>
+
+using namespace sw;
+
+struct value
+{
+    int n = 0;
+};
+
+using Map = PackageVersionMapBase<value, std::unordered_map, VersionMap>;
+
+static const int n_packages = 10000;
+static const int n_versions = 3;
+
+static Map make_map()
+{
+    Map m;
+    for (int i = 0; i < n_packages; i++)
+    {
+        PackagePath p("org.sw.demo.pkg" + std::to_string(i));
+        for (int v = 0; v < n_versions; v++)
+            m[PackageId(p, Version(1, v))].n = i;
+    }
+    return m;
+}
+
+TEST_CASE("Checking PackageVersionMap", "[package_version_map]")
+{
+    auto m = make_map();
+    const auto &cm = m;
+
+    std::vector<PackageId> ids;
+    std::vector<UnresolvedPackage> upkgs;
+    for (int i = 0; i < n_packages; i++)
+    {
+        PackagePath p("org.sw.demo.pkg" + std::to_string(i));
+        ids.emplace_back(p, Version(1, i % n_versions));
+        upkgs.emplace_back(p, VersionRange("1"));
+    }
+
+    SECTION("iteration")
+    {
+        size_t n = 0;
+        for (auto &[pkg, v] : cm)
+            n += v.n >= 0 && !pkg.getPath().empty();
+        CHECK(n == n_packages * n_versions);
+
+        auto i = m.begin();
+        auto j = i;
+        CHECK((i == j));
+        CHECK((&i->first == &j->first)); // references to the same entry
+    }
+
+    SECTION("find")
+    {
+        size_t n = 0;
+        for (int i = 0; i < n_packages; i++)
+        {
+            auto j = cm.find(ids[i]);
+            n += j != cm.end() && j->second.n == i;
+        }
+        CHECK(n == n_packages);
+
+        n = 0;
+        for (auto &u : upkgs)
+        {
+            auto i = cm.find(u);
+            n += i != cm.end() && i->first.getVersion() == Version(1, n_versions - 1);
+        }
+        CHECK(n == n_packages);
+
+        CHECK(cm.find(UnresolvedPackage("org.sw.demo.pkg1-2")) == cm.end());
+        CHECK(cm.find(UnresolvedPackage("org.sw.demo.pkg1-1.1")) != cm.end());
+        CHECK(cm.find(UnresolvedPackage("org.sw.demo.missing")) == cm.end());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Catch::Session().run(argc, argv);
+
+    return 0;
+}
@@ -0,0 +1,224 @@
+#include <sw/core/settings.h>
+#include <sw/support/hash.h>
+
+#define CATCH_CONFIG_RUNNER
+#include <catch2/catch.hpp>
+
+using namespace sw;
+
+// hash scheme as it was before binary form and hash caching,
+// it names existing build dirs, so it must never change
+static size_t golden_hash1(const TargetSettings &);
+
+static size_t golden_hash1(const TargetSetting &s)
+{
+    size_t h = 0;
+    if (s.isValue())
+        return hash_combine(h, s.getValue());
+    if (s.isArray())
+    {
+        for (auto &v : s.getArray())
+            hash_combine(h, golden_hash1(v));
+        return h;
+    }
+    if (s.isObject())
+        return hash_combine(h, golden_hash1(s.getMap()));
+    if (s.isNull())
+        return hash_combine(h, h);
+    return h;
+}
+
+static size_t golden_hash1(const TargetSettings &ts)
+{
+    size_t h = 0;
+    for (auto &[k, v] : ts)
+    {
+        if (!v.useInHash())
+            continue;
+        auto h2 = golden_hash1(v);
+        if (h2 == 0)
+            continue;
+        hash_combine(h, k);
+        hash_combine(h, h2);
+    }
+    return h;
+}
+
+static String golden_hash(const TargetSettings &ts)
+{
+    return shorten_hash(std::to_string(golden_hash1(ts)), 6);
+}
+
+static std::vector<TargetSettings> make_settings()
+{
+    std::vector<TargetSettings> v;
+
+    v.emplace_back();
+
+    {
+        TargetSettings s;
+        s["os"]["kernel"] = "org.torvalds.linux";
+        s["os"]["arch"] = "x86_64";
+        v.push_back(s);
+    }
+
+    {
+        TargetSettings s;
+        s["os"]["kernel"] = "com.Microsoft.Windows.NT";
+        s["os"]["arch"] = "x86_64";
+        s["native"]["configuration"] = "release";
+        s["native"]["library"] = "shared";
+        s["native"]["mt"] = "false";
+        s["native"]["stdlib"]["c"] = "com.Microsoft.Windows.SDK.ucrt";
+        s["native"]["stdlib"]["cpp"] = "com.Microsoft.VisualStudio.VC.libcpp";
+        s["native"]["program"]["c"] = "com.Microsoft.VisualStudio.VC.cl";
+        s["native"]["program"]["cpp"] = "com.Microsoft.VisualStudio.VC.cl";
+        s["native"]["program"]["lib"] = "com.Microsoft.VisualStudio.VC.lib";
+        s["native"]["program"]["link"] = "com.Microsoft.VisualStudio.VC.link";
+        v.push_back(s);
+    }
+
+    // arrays, nulls, empty maps and flags
+    {
+        TargetSettings s;
+        s["os"]["kernel"] = "org.torvalds.linux";
+        s["definitions"].push_back("A=1");
+        s["definitions"].push_back("B");
+        s["definitions"].push_back(TargetSetting{});
+        s["nested"].push_back(TargetSetting{});
+        s["null"].setNull();
+        s["empty_map"].getMap();
+        s["dry-run"] = "true";
+        s["dry-run"].useInHash(false);
+        s["master_build"] = "true";
+        s["master_build"].ignoreInComparison(true);
+        s["run_dir"] = "/tmp";
+        s["run_dir"].serializable(false);
+        s["unicode"] = "\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82";
+        s["long"] = String(300, 'x');
+        s["zero"] = String("a\0b", 3);
+        v.push_back(s);
+    }
+
+    return v;
+}
+
+TEST_CASE("Checking TargetSettings hash", "[settings]")
+{
+    for (auto &s : make_settings())
+        CHECK(s.getHash() == golden_hash(s));
+}
+
+TEST_CASE("Checking TargetSettings binary form", "[settings]")
+{
+    for (auto &s : make_settings())
+    {
+        auto b = s.toString(TargetSettings::Binary);
+
+        TargetSettings s2;
+        s2.mergeFromString(b, TargetSettings::Binary);
+        CHECK(s2 == s);
+        CHECK(s2.getHash() == s.getHash());
+        CHECK(s2.getHash() == golden_hash(s2));
+        CHECK(s2.toString(TargetSettings::Json) == s.toString(TargetSettings::Json));
+        CHECK(s2.toString(TargetSettings::Binary) == b);
+    }
+
+    SECTION("flags")
+    {
+        auto s = make_settings().back();
+        TargetSettings s2;
+        s2.mergeFromString(s.toString(TargetSettings::Binary), TargetSettings::Binary);
+        CHECK_FALSE(s2["dry-run"].useInHash());
+        CHECK(s2["master_build"].ignoreInComparison());
+        CHECK(s2["null"].isNull());
+        CHECK(s2["empty_map"].isObject());
+        CHECK(s2["definitions"].getArray().size() == 3);
+        CHECK(s2["zero"] == String("a\0b", 3));
+        CHECK_FALSE(s2["run_dir"]);
+    }
+
+    SECTION("merge")
+    {
+        TargetSettings s;
+        s["os"]["kernel"] = "org.torvalds.linux";
+        s["os"]["arch"] = "x86";
+        TargetSettings s2;
+        s2["os"]["arch"] = "x86_64";
+        s2["native"]["configuration"] = "debug";
+
+        auto j = s2;
+        j.mergeFromString(s.toString(TargetSettings::Binary), TargetSettings::Binary);
+        auto e = s2;
+        e.mergeFromString(s.toString(TargetSettings::Json), TargetSettings::Json);
+        CHECK(j == e);
+        CHECK(j.getHash() == e.getHash());
+        CHECK(j["os"]["arch"] == "x86");
+        CHECK(j["native"]["configuration"] == "debug");
+    }
+
+    SECTION("stored hash")
+    {
+        auto s = make_settings()[2];
+        auto b = s.toString(TargetSettings::Binary);
+        // hash follows magic and version, flip its high byte
+        b[5 + 7] ^= 0x40;
+
+        TargetSettings s2;
+        s2.mergeFromString(b, TargetSettings::Binary);
+        CHECK(s2.getHash() != golden_hash(s2));
+
+        // any non-const access drops stored hash
+        s2["os"];
+        CHECK(s2.getHash() == golden_hash(s2));
+        s2["native"]["configuration"] = "debug";
+        CHECK(s2.getHash() == golden_hash(s2));
+        CHECK(s2.getHash() != s.getHash());
+    }
+
+    SECTION("bad input")
+    {
+        auto b = make_settings()[2].toString(TargetSettings::Binary);
+        TargetSettings s;
+        CHECK_THROWS(s.mergeFromString("", TargetSettings::Binary));
+        CHECK_THROWS(s.mergeFromString("json" + b.substr(4), TargetSettings::Binary));
+        CHECK_THROWS(s.mergeFromString(b.substr(0, b.size() - 1), TargetSettings::Binary));
+        CHECK_THROWS(s.mergeFromString(b + "x", TargetSettings::Binary));
+    }
+}
+
+TEST_CASE("Checking nested TargetSettings", "[settings]")
+{
+    // dependency settings of a package
+    auto base = make_settings()[2];
+    TargetSettings s;
+    for (int i = 0; i < 20; i++)
+        s["pkg" + std::to_string(i)] = base;
+
+    auto j = s.toString(TargetSettings::Json);
+    auto b = s.toString(TargetSettings::Binary);
+    CHECK(b.size() < j.size());
+
+    TargetSettings sj, sb;
+    sj.mergeFromString(j);
+    sb.mergeFromString(b, TargetSettings::Binary);
+    CHECK(sj == s);
+    CHECK(sb == s);
+    CHECK(sb.toString(TargetSettings::Binary) == b);
+
+    // cached hash is stable and is dropped on changes
+    auto h = sb.getHash();
+    CHECK(h == golden_hash(s));
+    CHECK(sb.getHash() == h);
+    CHECK(sj.getHash() == h);
+    sb["pkg7"]["native"]["configuration"] = "debug";
+    CHECK(sb.getHash() != h);
+    CHECK(sb.getHash() == golden_hash(sb));
+}
+
+int main(int argc, char **argv)
+{
+    Catch::Session().run(argc, argv);
+
+    return 0;
+}